@@ -0,0 +1,568 @@
+/***********************************************************
+*
+* Predictor Evaluation Driver
+*
+*   Decodes a branch trace once and runs every predictor of
+*   predictor.cc over it, one thread per predictor, then
+*   reports MPKI per predictor and per static branch.
+*
+*   Build: g++ -O2 -march=native -pthread evaluate.cc predictor.cc
+*                 predictor_checkpoint.cc -lz
+*   Usage: evaluate [-p name,...] [-c name.param=value ...] [-b bits]
+*                   [-s] [-cacti template.cfg] [-n top]
+*                   [-load prefix] [-save prefix] [trace.gz]
+*
+*   -c sets a predictor parameter, -b rejects any configuration
+*   whose exact storage exceeds the budget, -s reports the storage
+*   of every array and -cacti writes <predictor>-<array>.cfg for
+*   each one from a CACTI template (one of the lab2 cfg files),
+*   rewriting its size, block size and bus width. The trace can
+*   be left out with -s and -cacti.
+*
+*   -load starts every predictor from the checkpoint
+*   <prefix><predictor>.ckpt instead of its initial state and
+*   -save writes the state each ends the trace with, so a
+*   predictor warmed on one trace can be evaluated on others.
+*
+*   The trace (gzip or plain text) holds one conditional branch
+*   per line:
+*
+*     <pc> <taken> <target> [<insts>]
+*
+*   pc and target are hex, taken is 0/1 and insts is the number
+*   of instructions since the previous branch (including it),
+*   1 if left out. MPKI is mispredictions per 1000 of them.
+*
+***********************************************************/
+
+#include "predictor.h"
+#include "predictor_config.h"
+#include "predictor_templates.h"
+#include "predictor_checkpoint.h"
+
+#include <zlib.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <algorithm>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <vector>
+
+/*
+* Registered predictors. Each keeps its state in its own globals
+* (or its own template instance), so different predictors can run
+* in different threads.
+*/
+struct predictor_desc {
+  const char* name;
+  void (*init)();
+  bool (*get)(UINT32 PC);
+  void (*update)(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget);
+  const predictor_param* params;
+  int (*arrays)(predictor_array* out);
+  int (*state)(predictor_state* out);
+};
+
+// template instantiations have no runtime parameters
+static const predictor_param no_params[] = {
+  { NULL, NULL, 0, 0, false, NULL }
+};
+
+#define TEMPLATE_PREDICTOR(name, ...) \
+  { name, predictor_instance<__VA_ARGS__>::init, predictor_instance<__VA_ARGS__>::get, \
+    predictor_instance<__VA_ARGS__>::update, no_params, predictor_instance<__VA_ARGS__>::arrays, \
+    predictor_instance<__VA_ARGS__>::state }
+
+static const predictor_desc predictors[] = {
+  { "2bitsat", InitPredictor_2bitsat, GetPrediction_2bitsat, UpdatePredictor_2bitsat,
+    params_2bitsat, arrays_2bitsat, state_2bitsat },
+  { "2level",  InitPredictor_2level,  GetPrediction_2level,  UpdatePredictor_2level,
+    params_2level, arrays_2level, state_2level },
+  { "openend", InitPredictor_openend, GetPrediction_openend, UpdatePredictor_openend,
+    params_openend, arrays_openend, state_openend },
+  { "tage",    InitPredictor_tage,    GetPrediction_tage,    UpdatePredictor_tage,
+    params_tage, arrays_tage, state_tage },
+
+  // fixed geometries, see predictor_templates.h
+  TEMPLATE_PREDICTOR("bimod-4k",    Bimodal<12, 2>),
+  TEMPLATE_PREDICTOR("bimod-16k",   Bimodal<14, 2>),
+  TEMPLATE_PREDICTOR("bimod-4k-4b", Bimodal<12, 4>),
+  TEMPLATE_PREDICTOR("pap-6h",      TwoLevel<9, 6, 3, 2>),
+  TEMPLATE_PREDICTOR("pap-10h",     TwoLevel<10, 10, 3, 2>),
+  TEMPLATE_PREDICTOR("perc-62h",    Perceptron<8, 62, 8>),
+  TEMPLATE_PREDICTOR("perc-32h",    Perceptron<9, 32, 8>),
+};
+
+#define NUM_PREDICTORS (sizeof(predictors) / sizeof(predictors[0]))
+
+static const predictor_desc* find_predictor(const char* name) {
+  for (size_t i = 0; i < NUM_PREDICTORS; i++) {
+    if (!strcmp(predictors[i].name, name)) {
+      return &predictors[i];
+    }
+  }
+  return NULL;
+}
+
+/***********************************************************
+* Configuration and storage
+***********************************************************/
+
+// applies "name.param=value"
+static void set_param(char* arg) {
+  char* dot = strchr(arg, '.');
+  char* eq = strchr(arg, '=');
+  if (dot == NULL || eq == NULL || eq < dot) {
+    fprintf(stderr, "bad parameter `%s', expected name.param=value\n", arg);
+    exit(1);
+  }
+  *dot = *eq = '\0';
+
+  const predictor_desc* d = find_predictor(arg);
+  if (d == NULL) {
+    fprintf(stderr, "unknown predictor `%s'\n", arg);
+    exit(1);
+  }
+  const predictor_param* p = d->params;
+  while (p->name != NULL && strcmp(p->name, dot + 1)) p++;
+  if (p->name == NULL) {
+    fprintf(stderr, "predictor `%s' has no parameter `%s', it has:\n", arg, dot + 1);
+    for (p = d->params; p->name != NULL; p++) {
+      fprintf(stderr, "  %-12s %s (%d)\n", p->name, p->desc, *p->value);
+    }
+    exit(1);
+  }
+
+  char* end;
+  long value = strtol(eq + 1, &end, 0);
+  if (*end != '\0' || value < p->min || value > p->max) {
+    fprintf(stderr, "%s.%s must be an integer in [%d, %d]\n", arg, p->name, p->min, p->max);
+    exit(1);
+  }
+  if (p->pow2 && (value & (value - 1))) {
+    fprintf(stderr, "%s.%s must be a power of two\n", arg, p->name);
+    exit(1);
+  }
+  *p->value = value;
+}
+
+static long storage_bits(const predictor_desc* d) {
+  predictor_array arrays[MAX_PREDICTOR_ARRAYS];
+  int n = d->arrays(arrays);
+  long bits = 0;
+  for (int i = 0; i < n; i++) {
+    bits += arrays[i].rows * arrays[i].row_bits;
+  }
+  return bits;
+}
+
+static void print_storage(const predictor_desc* d) {
+  predictor_array arrays[MAX_PREDICTOR_ARRAYS];
+  int n = d->arrays(arrays);
+
+  printf("%-12s", d->name);
+  for (const predictor_param* p = d->params; p->name != NULL; p++) {
+    printf(" %s=%d", p->name, *p->value);
+  }
+  printf("\n");
+  for (int i = 0; i < n; i++) {
+    printf("  %-10s %10ld rows x %4d bits = %10ld bits\n", arrays[i].name,
+           arrays[i].rows, arrays[i].row_bits, arrays[i].rows * arrays[i].row_bits);
+  }
+  long bits = storage_bits(d);
+  printf("  %-10s %37ld bits (%.2f KB)\n", "total", bits, bits / 8192.0);
+}
+
+// writes <predictor>-<array>.cfg for each array from a CACTI template, a
+// row is a block rounded up to whole bytes
+static void write_cacti(const predictor_desc* d, const char* template_name) {
+  predictor_array arrays[MAX_PREDICTOR_ARRAYS];
+  int n = d->arrays(arrays);
+
+  for (int i = 0; i < n; i++) {
+    if (arrays[i].rows == 1) {
+      continue;
+    }
+    long block = (arrays[i].row_bits + 7) / 8;
+    long size = arrays[i].rows * block;
+
+    FILE* in = fopen(template_name, "r");
+    if (in == NULL) {
+      fprintf(stderr, "cannot open CACTI template `%s'\n", template_name);
+      exit(1);
+    }
+    std::string out_name = std::string(d->name) + "-" + arrays[i].name + ".cfg";
+    FILE* out = fopen(out_name.c_str(), "w");
+    if (out == NULL) {
+      fprintf(stderr, "cannot create `%s'\n", out_name.c_str());
+      exit(1);
+    }
+
+    fprintf(out, "# %s %s: %ld rows * %d bits\n", d->name, arrays[i].name,
+            arrays[i].rows, arrays[i].row_bits);
+    char line[1024];
+    while (fgets(line, sizeof(line), in) != NULL) {
+      if (!strncmp(line, "-size (bytes)", 13)) {
+        fprintf(out, "-size (bytes) %ld\n", size);
+      } else if (!strncmp(line, "-block size (bytes)", 19)) {
+        fprintf(out, "-block size (bytes) %ld\n", block);
+      } else if (!strncmp(line, "-output/input bus width", 23)) {
+        fprintf(out, "-output/input bus width %ld\n", block * 8);
+      } else {
+        fputs(line, out);
+      }
+    }
+    fclose(in);
+    fclose(out);
+    printf("wrote %s (%ld bytes, %ld byte blocks)\n", out_name.c_str(), size, block);
+  }
+}
+
+static std::string checkpoint_name(const char* prefix, const predictor_desc* d) {
+  return std::string(prefix) + d->name + ".ckpt";
+}
+
+static void load_checkpoint(const predictor_desc* d, const char* prefix) {
+  std::string name = checkpoint_name(prefix, d);
+  FILE* f = fopen(name.c_str(), "rb");
+  if (f == NULL) {
+    fprintf(stderr, "cannot open checkpoint `%s'\n", name.c_str());
+    exit(1);
+  }
+  if (!predictor_load(f, d->name, d->params, d->state)) {
+    fprintf(stderr, "cannot load checkpoint `%s'\n", name.c_str());
+    exit(1);
+  }
+  fclose(f);
+}
+
+static void save_checkpoint(const predictor_desc* d, const char* prefix) {
+  std::string name = checkpoint_name(prefix, d);
+  FILE* f = fopen(name.c_str(), "wb");
+  if (f == NULL) {
+    fprintf(stderr, "cannot create checkpoint `%s'\n", name.c_str());
+    exit(1);
+  }
+  if (!predictor_save(f, d->name, d->params, d->state) || fclose(f) != 0) {
+    fprintf(stderr, "cannot save checkpoint `%s'\n", name.c_str());
+    exit(1);
+  }
+}
+
+/***********************************************************
+* Trace decoding
+***********************************************************/
+
+#define BATCH_SIZE (64 * 1024) // branches per batch
+#define READ_SIZE (1024 * 1024) // bytes per gzread
+
+// one batch of decoded branches, one array per field
+struct branch_batch {
+  size_t n;
+  UINT32 pc[BATCH_SIZE];
+  UINT32 target[BATCH_SIZE];
+  bool taken[BATCH_SIZE];
+};
+
+struct trace_reader {
+  gzFile file;
+  char buf[READ_SIZE + 1];
+  size_t pos;
+  size_t len;
+  bool eof;
+  uint64_t line;
+  uint64_t insts;
+};
+
+static void trace_open(trace_reader* r, const char* fname) {
+  r->file = gzopen(fname, "rb");
+  if (r->file == NULL) {
+    fprintf(stderr, "cannot open trace `%s'\n", fname);
+    exit(1);
+  }
+  r->pos = r->len = 0;
+  r->eof = false;
+  r->line = 0;
+  r->insts = 0;
+}
+
+// returns the next line (NUL terminated, without the newline) or NULL at the end
+static char* trace_line(trace_reader* r) {
+  for (;;) {
+    char* nl = (char*)memchr(r->buf + r->pos, '\n', r->len - r->pos);
+    if (nl != NULL || (r->eof && r->pos < r->len)) {
+      char* line = r->buf + r->pos;
+      if (nl == NULL) {
+        // last line without a newline
+        r->buf[r->len] = '\0';
+        r->pos = r->len;
+      } else {
+        *nl = '\0';
+        r->pos = nl - r->buf + 1;
+      }
+      r->line++;
+      return line;
+    }
+    if (r->eof) {
+      return NULL;
+    }
+
+    // keep the partial line and refill behind it
+    size_t rest = r->len - r->pos;
+    if (rest == READ_SIZE) {
+      fprintf(stderr, "trace line %llu too long\n", (unsigned long long)r->line + 1);
+      exit(1);
+    }
+    memmove(r->buf, r->buf + r->pos, rest);
+    int got = gzread(r->file, r->buf + rest, READ_SIZE - rest);
+    if (got < 0) {
+      int err;
+      fprintf(stderr, "trace read error: %s\n", gzerror(r->file, &err));
+      exit(1);
+    }
+    r->pos = 0;
+    r->len = rest + got;
+    r->eof = got == 0;
+  }
+}
+
+// decodes up to BATCH_SIZE branches, returns false at the end of the trace
+static bool trace_batch(trace_reader* r, branch_batch* b) {
+  b->n = 0;
+  char* line;
+  while (b->n < BATCH_SIZE && (line = trace_line(r)) != NULL) {
+    char* p = line;
+    while (*p == ' ' || *p == '\t') p++;
+    if (*p == '\0' || *p == '#') {
+      continue;
+    }
+
+    char* end;
+    UINT32 pc = strtoul(p, &end, 16);
+    unsigned long taken = strtoul(end, &p, 10);
+    UINT32 target = strtoul(p, &end, 16);
+    if (end == p || taken > 1) {
+      fprintf(stderr, "bad trace line %llu: %s\n", (unsigned long long)r->line, line);
+      exit(1);
+    }
+    unsigned long insts = strtoul(end, &p, 10);
+    r->insts += p == end ? 1 : insts;
+
+    b->pc[b->n] = pc;
+    b->target[b->n] = target;
+    b->taken[b->n] = taken;
+    b->n++;
+  }
+  return b->n > 0;
+}
+
+/***********************************************************
+* Evaluation
+***********************************************************/
+
+struct branch_stats {
+  uint64_t count;
+  uint64_t mispred;
+};
+
+// private state of one predictor's thread
+struct predictor_run {
+  const predictor_desc* desc;
+  uint64_t mispred;
+  std::unordered_map<UINT32, branch_stats> branches;
+};
+
+static void run_batch(predictor_run* run, const branch_batch* b) {
+  const predictor_desc* d = run->desc;
+  for (size_t i = 0; i < b->n; i++) {
+    bool pred = d->get(b->pc[i]);
+    d->update(b->pc[i], b->taken[i], pred, b->target[i]);
+
+    branch_stats& s = run->branches[b->pc[i]];
+    s.count++;
+    if (pred != b->taken[i]) {
+      s.mispred++;
+      run->mispred++;
+    }
+  }
+}
+
+static double mpki(uint64_t mispred, uint64_t insts) {
+  return insts ? 1000.0 * mispred / insts : 0.0;
+}
+
+static void usage(const char* argv0) {
+  fprintf(stderr, "usage: %s [-p name,...] [-c name.param=value ...] [-b bits]\n"
+                  "                [-s] [-cacti template.cfg] [-n top]\n"
+                  "                [-load prefix] [-save prefix] [trace.gz]\n", argv0);
+  fprintf(stderr, "predictors:");
+  for (size_t i = 0; i < NUM_PREDICTORS; i++) {
+    fprintf(stderr, " %s", predictors[i].name);
+  }
+  fprintf(stderr, "\n");
+  exit(1);
+}
+
+int main(int argc, char** argv) {
+  std::vector<predictor_run> runs;
+  int top = 20;
+  long budget = 0;
+  bool storage = false;
+  const char* cacti_template = NULL;
+  const char* load_prefix = NULL;
+  const char* save_prefix = NULL;
+  int arg = 1;
+
+  for (; arg < argc && argv[arg][0] == '-'; arg++) {
+    if (!strcmp(argv[arg], "-n") && arg + 1 < argc) {
+      top = atoi(argv[++arg]);
+    } else if (!strcmp(argv[arg], "-c") && arg + 1 < argc) {
+      set_param(argv[++arg]);
+    } else if (!strcmp(argv[arg], "-b") && arg + 1 < argc) {
+      budget = atol(argv[++arg]);
+    } else if (!strcmp(argv[arg], "-s")) {
+      storage = true;
+    } else if (!strcmp(argv[arg], "-cacti") && arg + 1 < argc) {
+      cacti_template = argv[++arg];
+    } else if (!strcmp(argv[arg], "-load") && arg + 1 < argc) {
+      load_prefix = argv[++arg];
+    } else if (!strcmp(argv[arg], "-save") && arg + 1 < argc) {
+      save_prefix = argv[++arg];
+    } else if (!strcmp(argv[arg], "-p") && arg + 1 < argc) {
+      char* list = argv[++arg];
+      for (char* name = strtok(list, ","); name != NULL; name = strtok(NULL, ",")) {
+        const predictor_desc* d = find_predictor(name);
+        if (d == NULL) {
+          fprintf(stderr, "unknown predictor `%s'\n", name);
+          usage(argv[0]);
+        }
+        // the state is global, one run per predictor
+        for (size_t j = 0; j < runs.size(); j++) {
+          if (runs[j].desc == d) {
+            fprintf(stderr, "predictor `%s' given twice\n", name);
+            exit(1);
+          }
+        }
+        runs.push_back(predictor_run{ d, 0, {} });
+      }
+    } else {
+      usage(argv[0]);
+    }
+  }
+  bool trace = arg + 1 == argc;
+  if (arg + (trace ? 1 : 0) != argc || (!trace && !storage && cacti_template == NULL)) {
+    usage(argv[0]);
+  }
+  if (runs.empty()) {
+    for (size_t i = 0; i < NUM_PREDICTORS; i++) {
+      runs.push_back(predictor_run{ &predictors[i], 0, {} });
+    }
+  }
+
+  for (size_t j = 0; j < runs.size(); j++) {
+    if (storage) {
+      print_storage(runs[j].desc);
+    }
+    if (cacti_template != NULL) {
+      write_cacti(runs[j].desc, cacti_template);
+    }
+  }
+  bool over = false;
+  for (size_t j = 0; j < runs.size(); j++) {
+    long bits = storage_bits(runs[j].desc);
+    if (budget > 0 && bits > budget) {
+      fprintf(stderr, "%s needs %ld bits, over the budget of %ld bits\n",
+              runs[j].desc->name, bits, budget);
+      over = true;
+    }
+  }
+  if (over) {
+    exit(1);
+  }
+  if (!trace) {
+    return 0;
+  }
+
+  for (size_t j = 0; j < runs.size(); j++) {
+    runs[j].desc->init();
+    if (load_prefix != NULL) {
+      load_checkpoint(runs[j].desc, load_prefix);
+    }
+  }
+
+  // the next batch is decoded while the predictors run on the current one
+  trace_reader* reader = new trace_reader;
+  branch_batch* batch[2] = { new branch_batch, new branch_batch };
+  uint64_t branches = 0;
+
+  trace_open(reader, argv[arg]);
+  bool more = trace_batch(reader, batch[0]);
+  for (int cur = 0; more; cur ^= 1) {
+    std::vector<std::thread> workers;
+    for (size_t j = 0; j < runs.size(); j++) {
+      workers.push_back(std::thread(run_batch, &runs[j], batch[cur]));
+    }
+    branches += batch[cur]->n;
+    more = trace_batch(reader, batch[cur ^ 1]);
+    for (size_t j = 0; j < workers.size(); j++) {
+      workers[j].join();
+    }
+  }
+  gzclose(reader->file);
+  uint64_t insts = reader->insts;
+
+  if (save_prefix != NULL) {
+    for (size_t j = 0; j < runs.size(); j++) {
+      save_checkpoint(runs[j].desc, save_prefix);
+    }
+  }
+
+  printf("%-12s %14s %14s %10s %9s\n", "predictor", "branches", "mispredicted", "rate", "MPKI");
+  for (size_t j = 0; j < runs.size(); j++) {
+    printf("%-12s %14llu %14llu %9.4f%% %9.4f\n", runs[j].desc->name,
+           (unsigned long long)branches, (unsigned long long)runs[j].mispred,
+           branches ? 100.0 * runs[j].mispred / branches : 0.0,
+           mpki(runs[j].mispred, insts));
+  }
+  printf("instructions: %llu, static branches: %llu\n", (unsigned long long)insts,
+         (unsigned long long)runs[0].branches.size());
+
+  // static branches with the most mispredictions in any predictor
+  std::vector<std::pair<uint64_t, UINT32> > order;
+  for (auto& e : runs[0].branches) {
+    uint64_t worst = 0;
+    for (size_t j = 0; j < runs.size(); j++) {
+      worst = std::max(worst, runs[j].branches[e.first].mispred);
+    }
+    order.push_back(std::make_pair(worst, e.first));
+  }
+  std::sort(order.begin(), order.end(),
+            [](const std::pair<uint64_t, UINT32>& a, const std::pair<uint64_t, UINT32>& b) {
+              return a.first != b.first ? a.first > b.first : a.second < b.second;
+            });
+  if ((size_t)top > order.size()) {
+    top = order.size();
+  }
+
+  printf("\ntop %d static branches, MPKI per predictor:\n%-10s %12s", top, "pc", "count");
+  for (size_t j = 0; j < runs.size(); j++) {
+    printf(" %12s", runs[j].desc->name);
+  }
+  printf("\n");
+  for (int k = 0; k < top; k++) {
+    UINT32 pc = order[k].second;
+    printf("0x%08x %12llu", pc, (unsigned long long)runs[0].branches[pc].count);
+    for (size_t j = 0; j < runs.size(); j++) {
+      printf(" %12.4f", mpki(runs[j].branches[pc].mispred, insts));
+    }
+    printf("\n");
+  }
+
+  delete batch[0];
+  delete batch[1];
+  delete reader;
+  return 0;
+}
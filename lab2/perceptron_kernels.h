@@ -0,0 +1,154 @@
+#ifndef PERCEPTRON_KERNELS_H
+#define PERCEPTRON_KERNELS_H
+
+#include <stdint.h>
+
+/***********************************************************
+*
+* int8 perceptron kernels over a packed global history
+*
+*   Weight rows are HISTORY_LANES int8 weights, lanes is -1
+*   for the lanes of the history and 0 for the padding past it
+*   (the vector kernels use lanes, the scalar ones history).
+*
+***********************************************************/
+
+// Each perceptron row is padded to 64 weights so it fills whole vectors,
+// the lanes past the history see an input of 0 and stay 0
+#define HISTORY_LANES 64
+
+// Input vector x of the perceptron function: +1 where history bit i is taken,
+// -1 where it is not and 0 for the padding lanes
+#if defined(__AVX2__)
+#include <immintrin.h>
+
+static inline void ghr_inputs(uint64_t ghr, const int8_t* lanes, __m256i x[2]) {
+  // byte lane i of each half selects the history byte holding bit i ...
+  const __m256i byte_of_lane = _mm256_setr_epi8(
+    0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1,
+    2, 2, 2, 2, 2, 2, 2, 2, 3, 3, 3, 3, 3, 3, 3, 3);
+  // ... and tests its bit
+  const __m256i bit_of_lane = _mm256_set1_epi64x(0x8040201008040201LL);
+  const __m256i one = _mm256_set1_epi8(1);
+
+  for (int h = 0; h < 2; h++) {
+    __m256i bytes = _mm256_set1_epi32((uint32_t)(ghr >> (32 * h)));
+    bytes = _mm256_shuffle_epi8(bytes, byte_of_lane);
+    __m256i not_taken = _mm256_cmpeq_epi8(_mm256_and_si256(bytes, bit_of_lane),
+                                          _mm256_setzero_si256());
+    x[h] = _mm256_and_si256(_mm256_or_si256(not_taken, one),
+                            _mm256_loadu_si256((const __m256i*)(lanes + 32 * h)));
+  }
+}
+
+// sum_i w_i * x_i
+static inline int perceptron_dot(const int8_t* w, uint64_t ghr, const int8_t* lanes, int history) {
+  __m256i x[2];
+  ghr_inputs(ghr, lanes, x);
+
+  // w_i * x_i never saturates as w_i > -128; sum the bytes biased to unsigned
+  const __m256i bias = _mm256_set1_epi8((char)0x80);
+  __m256i sum = _mm256_setzero_si256();
+  for (int h = 0; h < 2; h++) {
+    __m256i wx = _mm256_sign_epi8(_mm256_loadu_si256((const __m256i*)(w + 32 * h)), x[h]);
+    sum = _mm256_add_epi64(sum, _mm256_sad_epu8(_mm256_xor_si256(wx, bias),
+                                                _mm256_setzero_si256()));
+  }
+  __m128i sum2 = _mm_add_epi64(_mm256_castsi256_si128(sum), _mm256_extracti128_si256(sum, 1));
+  sum2 = _mm_add_epi64(sum2, _mm_unpackhi_epi64(sum2, sum2));
+  return (int)_mm_cvtsi128_si64(sum2) - 128 * HISTORY_LANES;
+}
+
+// w_i = w_i + t*x_i, saturated to [weight_min, weight_max]
+static inline void perceptron_train(int8_t* w, uint64_t ghr, int target, const int8_t* lanes,
+                                    int history, int weight_min, int weight_max) {
+  __m256i x[2];
+  ghr_inputs(ghr, lanes, x);
+
+  const __m256i t = _mm256_set1_epi8((char)target);
+  const __m256i wmin = _mm256_set1_epi8((char)weight_min);
+  const __m256i wmax = _mm256_set1_epi8((char)weight_max);
+  for (int h = 0; h < 2; h++) {
+    __m256i* p = (__m256i*)(w + 32 * h);
+    __m256i nw = _mm256_adds_epi8(_mm256_loadu_si256(p), _mm256_sign_epi8(x[h], t));
+    _mm256_storeu_si256(p, _mm256_min_epi8(_mm256_max_epi8(nw, wmin), wmax));
+  }
+}
+
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+
+static inline void ghr_inputs(uint64_t ghr, const int8_t* lanes, __m128i x[4]) {
+  const __m128i byte_of_lane = _mm_setr_epi8(0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 1, 1, 1, 1);
+  const __m128i bit_of_lane = _mm_set1_epi64x(0x8040201008040201LL);
+  const __m128i one = _mm_set1_epi8(1);
+
+  for (int q = 0; q < 4; q++) {
+    __m128i bytes = _mm_set1_epi16((uint16_t)(ghr >> (16 * q)));
+    bytes = _mm_shuffle_epi8(bytes, byte_of_lane);
+    __m128i not_taken = _mm_cmpeq_epi8(_mm_and_si128(bytes, bit_of_lane),
+                                       _mm_setzero_si128());
+    x[q] = _mm_and_si128(_mm_or_si128(not_taken, one),
+                         _mm_loadu_si128((const __m128i*)(lanes + 16 * q)));
+  }
+}
+
+// sum_i w_i * x_i
+static inline int perceptron_dot(const int8_t* w, uint64_t ghr, const int8_t* lanes, int history) {
+  __m128i x[4];
+  ghr_inputs(ghr, lanes, x);
+
+  // w_i * x_i never saturates as w_i > -128; sum the bytes biased to unsigned
+  const __m128i bias = _mm_set1_epi8((char)0x80);
+  __m128i sum = _mm_setzero_si128();
+  for (int q = 0; q < 4; q++) {
+    __m128i wx = _mm_sign_epi8(_mm_loadu_si128((const __m128i*)(w + 16 * q)), x[q]);
+    sum = _mm_add_epi64(sum, _mm_sad_epu8(_mm_xor_si128(wx, bias), _mm_setzero_si128()));
+  }
+  sum = _mm_add_epi64(sum, _mm_unpackhi_epi64(sum, sum));
+  return (int)_mm_cvtsi128_si64(sum) - 128 * HISTORY_LANES;
+}
+
+// w_i = w_i + t*x_i, saturated to [weight_min, weight_max]
+static inline void perceptron_train(int8_t* w, uint64_t ghr, int target, const int8_t* lanes,
+                                    int history, int weight_min, int weight_max) {
+  __m128i x[4];
+  ghr_inputs(ghr, lanes, x);
+
+  const __m128i t = _mm_set1_epi8((char)target);
+  const __m128i wmin = _mm_set1_epi8((char)weight_min);
+  const __m128i wmax = _mm_set1_epi8((char)weight_max);
+  for (int q = 0; q < 4; q++) {
+    __m128i* p = (__m128i*)(w + 16 * q);
+    __m128i nw = _mm_adds_epi8(_mm_loadu_si128(p), _mm_sign_epi8(x[q], t));
+    _mm_storeu_si128(p, _mm_min_epi8(_mm_max_epi8(nw, wmin), wmax));
+  }
+}
+
+#else
+
+// sum_i w_i * x_i
+static inline int perceptron_dot(const int8_t* w, uint64_t ghr, const int8_t* lanes, int history) {
+  int sum = 0;
+  for (int i = 0; i < history; i++) {
+    sum += (ghr >> i) & 1 ? w[i] : -w[i];
+  }
+  return sum;
+}
+
+// w_i = w_i + t*x_i, saturated to [weight_min, weight_max]
+static inline void perceptron_train(int8_t* w, uint64_t ghr, int target, const int8_t* lanes,
+                                    int history, int weight_min, int weight_max) {
+  for (int i = 0; i < history; i++) {
+    int x = (ghr >> i) & 1 ? 1 : -1;
+    if (target == x && w[i] < weight_max) {
+      w[i]++;
+    } else if (target != x && w[i] > weight_min) {
+      w[i]--;
+    }
+  }
+}
+
+#endif
+
+#endif
@@ -1,16 +1,23 @@
 #include "predictor.h"
+#include "predictor_config.h"
+#include "perceptron_kernels.h"
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 /***********************************************************
 * 
 * 1. 2 Bit Saturating Counter
+*
+*     Size = counters * 2 = 4096 * 2 = 8192 bits by default
 * 
 ***********************************************************/
 
-#define NUM_ENTRIES 1024
 // each entry has 4*2 bit counters = 1 byte
-// total = 1024*4*2 = 8192 bits of storage
 #define COUNTERS_PER_BYTE 4
-#define NUM_COUNTERS (NUM_ENTRIES * COUNTERS_PER_BYTE)
+
+int sat_counters = 4096; // Number of 2 bit counters
 
 /*
 * Prediction Table Values:
@@ -19,7 +26,22 @@
 *   2 - Weak Taken
 *   3 - Strong Taken
 */
-uint8_t prediction_table[NUM_ENTRIES];
+uint8_t* prediction_table;
+
+const predictor_param params_2bitsat[] = {
+  { "counters", &sat_counters, COUNTERS_PER_BYTE, 1 << 24, true, "number of 2 bit counters" },
+  { NULL, NULL, 0, 0, false, NULL }
+};
+
+int arrays_2bitsat(predictor_array* out) {
+  out[0] = predictor_array{ "table", sat_counters / COUNTERS_PER_BYTE, 8 };
+  return 1;
+}
+
+int state_2bitsat(predictor_state* out) {
+  out[0] = predictor_state{ "table", prediction_table, (size_t)sat_counters / COUNTERS_PER_BYTE };
+  return 1;
+}
 
 uint8_t get_2bit_prediction(uint32_t indx) {
   uint32_t byte_indx = indx / COUNTERS_PER_BYTE;
@@ -35,16 +57,19 @@ void set_2bit_counter(uint32_t indx, uint8_t counter_val) {
 }
 
 void InitPredictor_2bitsat() {
+  delete[] prediction_table;
+  prediction_table = new uint8_t[sat_counters / COUNTERS_PER_BYTE];
+
   // Instantiate all elements of prediction table
   // to weak not taken:
-  for (int i = 0; i < NUM_ENTRIES; i++) {
+  for (int i = 0; i < sat_counters / COUNTERS_PER_BYTE; i++) {
     prediction_table[i] = 0x55; //01010101
   }
 }
 
 bool GetPrediction_2bitsat(UINT32 PC) {
-  // Get last 10 bits of PC to index:
-  int index = PC & (NUM_COUNTERS - 1);
+  // Get last log2(counters) bits of PC to index:
+  int index = PC & (sat_counters - 1);
   uint8_t prediction = get_2bit_prediction(index);
 
   // If 0/1: Predict NOT_TAKEN
@@ -53,8 +78,8 @@ bool GetPrediction_2bitsat(UINT32 PC) {
 }
 
 void UpdatePredictor_2bitsat(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget) {
-  // Get last 10 bits of PC to index:
-  int index = PC & (NUM_COUNTERS - 1);
+  // Get last log2(counters) bits of PC to index:
+  int index = PC & (sat_counters - 1);
   uint8_t prediction = get_2bit_prediction(index);
 
   // If branch was taken, increment:
@@ -71,52 +96,102 @@ void UpdatePredictor_2bitsat(UINT32 PC, bool resolveDir, bool predDir, UINT32 br
 /***********************************************************
 * 
 * 2. 2 Level PAp Predictor
+*
+*     Size = BHT entries * history bits + PHTs * 2^history bits * 2
+*          = 512 * 6 + 8 * 64 * 2 = 4096 bits by default
 * 
 ***********************************************************/
-/*
-* Since PHT has 8 tables
-* Need to index last 3 PC bits
-*/
-#define PHT_INDEX_BITS 0x007
 
 /*
-* Since BHT has 512 entries (2^9)
-* Need to index 9 PC bits
+* The PHT is selected by the last log2(PHTs) PC bits,
+* the BHT entry by the log2(BHT entries) PC bits above them
 */
-#define BHT_INDEX_BITS 0x1FF
+int twolev_bht_entries = 512; // BHT entries
+int twolev_history_bits = 6; // History bits per BHT entry
+int twolev_pht_tables = 8; // Number of PHTs
+
+int twolev_pht_shift; // log2(PHTs)
+size_t twolev_pht_size; // PHTs * 2^history bits
+
+// Largest PHTs * 2^history bits, the PHT is indexed with an int
+#define TWOLEV_MAX_PHT_COUNTERS ((size_t)1 << 28)
 
 /*
-* 6 history bits per entry
+* history bits per entry
 */
-int BHT[512] = {0};
+int* BHT;
 
 /*
-* Total Table Size = 64*8 = 512
-* Indexed by [Last 3 PC bits][6 history bits]
+* Total Table Size = PHTs * 2^history bits
+* Indexed by [Last log2(PHTs) PC bits][history bits]
 * PHT Counter Values:
 *   0 - Strongly Not Taken
 *   1 - Weak Not Taken
 *   2 - Weak Taken
 *   3 - Strong Taken
 */
-int PHT[8][64];
+int* PHT;
+
+const predictor_param params_2level[] = {
+  { "bht", &twolev_bht_entries, 1, 1 << 24, true, "BHT entries" },
+  { "history", &twolev_history_bits, 1, 20, false, "history bits per BHT entry" },
+  { "pht", &twolev_pht_tables, 1, 1 << 16, true, "number of PHTs" },
+  { NULL, NULL, 0, 0, false, NULL }
+};
+
+int arrays_2level(predictor_array* out) {
+  // the PHT counters are packed 4 to a byte like the 2 bit predictor's
+  long pht_counters = (long)twolev_pht_tables << twolev_history_bits;
+  out[0] = predictor_array{ "bht", twolev_bht_entries, twolev_history_bits };
+  if (pht_counters < COUNTERS_PER_BYTE) {
+    out[1] = predictor_array{ "pht", pht_counters, 2 };
+  } else {
+    out[1] = predictor_array{ "pht", pht_counters / COUNTERS_PER_BYTE, 8 };
+  }
+  return 2;
+}
+
+int state_2level(predictor_state* out) {
+  out[0] = predictor_state{ "bht", BHT, twolev_bht_entries * sizeof(int) };
+  out[1] = predictor_state{ "pht", PHT, twolev_pht_size * sizeof(int) };
+  return 2;
+}
 
 void InitPredictor_2level() {
+  twolev_pht_size = (size_t)twolev_pht_tables << twolev_history_bits;
+  if (twolev_pht_size > TWOLEV_MAX_PHT_COUNTERS) {
+    fprintf(stderr, "2level PHTs of %zu counters are too large, at most %zu\n",
+            twolev_pht_size, TWOLEV_MAX_PHT_COUNTERS);
+    exit(1);
+  }
+
+  twolev_pht_shift = 0;
+  while ((1 << twolev_pht_shift) < twolev_pht_tables) {
+    twolev_pht_shift++;
+  }
+
+  delete[] BHT;
+  delete[] PHT;
+  BHT = new int[twolev_bht_entries];
+  PHT = new int[twolev_pht_size];
+
+  for (int i = 0; i < twolev_bht_entries; i++) {
+    BHT[i] = 0;
+  }
+
   // Instantiate all elements of PHT
   // to weak not taken:
-  for (int i = 0; i < 8; i++) {
-    for (int j = 0; j < 64; j++) {
-      PHT[i][j] = 1;
-    }
+  for (size_t i = 0; i < twolev_pht_size; i++) {
+    PHT[i] = 1;
   }
 }
 
 bool GetPrediction_2level(UINT32 PC) {
-  int PHT_index = PC & PHT_INDEX_BITS;
-  int BHT_index = (PC >> 3) & BHT_INDEX_BITS;
+  int PHT_index = PC & (twolev_pht_tables - 1);
+  int BHT_index = (PC >> twolev_pht_shift) & (twolev_bht_entries - 1);
   
   int history = BHT[BHT_index];
-  int prediction = PHT[PHT_index][history];
+  int prediction = PHT[(PHT_index << twolev_history_bits) | history];
 
   // If 0/1: Predict NOT_TAKEN
   // If 2/3: Predict TAKEN
@@ -124,25 +199,25 @@ bool GetPrediction_2level(UINT32 PC) {
 }
 
 void UpdatePredictor_2level(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget) {
-  int PHT_index = PC & PHT_INDEX_BITS;
-  int BHT_index = (PC >> 3) & BHT_INDEX_BITS;
+  int PHT_index = PC & (twolev_pht_tables - 1);
+  int BHT_index = (PC >> twolev_pht_shift) & (twolev_bht_entries - 1);
   
 
   int history = BHT[BHT_index];
-  int prediction = PHT[PHT_index][history];
+  int* prediction = &PHT[(PHT_index << twolev_history_bits) | history];
 
   // If branch was taken, increment:
-  if (resolveDir && prediction < 3) {
-    PHT[PHT_index][history]++;
+  if (resolveDir && *prediction < 3) {
+    (*prediction)++;
   // If branch was not taken, decrement:
-  } else if (!resolveDir && prediction > 0) {
-    PHT[PHT_index][history]--;
+  } else if (!resolveDir && *prediction > 0) {
+    (*prediction)--;
   }
 
   // Update history bits:
   // Shift least recent bit out, add if taken (1/0) 
-  // and only include the 6 bits of history
-  BHT[BHT_index] = ((history << 1) + resolveDir) & 0x03F;
+  // and only include the history bits
+  BHT[BHT_index] = ((history << 1) + resolveDir) & ((1 << twolev_history_bits) - 1);
 }
 
 /***********************************************************
@@ -150,54 +225,90 @@ void UpdatePredictor_2level(UINT32 PC, bool resolveDir, bool predDir, UINT32 bra
 * 3. Open-Ended Predictor
 *     Perceptron Branch Predictor
 *
-*     Size = number of perceptrons * history bits * weight size + history bits + bias bits
-*          = 256 * 62 * 8 + 62 + 256 = 127294 bits
+*     Size = number of perceptrons * (history bits + 1 bias) * weight size + history bits
+*          = 256 * 63 * 8 + 62 = 129086 bits by default
 ***********************************************************/
 
 // branch history is the input x to the perceptron function
 
-#define NUM_PERCEPTRONS 256 // Number of Perceptron weights
-#define HISTORY_BITS 62 // Number of history bits
-#define THETA (1.93 * HISTORY_BITS + 14) // Confidence Threshold for Training
+int perc_count = 256; // Number of Perceptron weights
+int perc_history = 62; // Number of history bits
+int perc_weight_bits = 8; // Weight size
+
+// Confidence Threshold for Training
+double perc_theta;
 
 // To prevent oversaturated decisions, set MAX and MIN:
-#define WEIGHT_MAX 127
-#define WEIGHT_MIN -127
+int weight_max;
+int weight_min;
+
+int8_t* perceptron_weights; // [perc_count][HISTORY_LANES]
+int8_t* bias_weights;
 
-int8_t perceptron_weights[NUM_PERCEPTRONS][HISTORY_BITS];
-int8_t bias_weights[NUM_PERCEPTRONS];
-int8_t GHR[HISTORY_BITS]; // Global History Register stores -1/1
+// -1 for the lanes of the history, 0 for the padding
+int8_t lane_valid[HISTORY_LANES];
+
+// Global History Register, bit i is branch i back (1 = taken, 0 = not taken)
+uint64_t ghr_mask;
+uint64_t GHR;
+
+// low 32 history bits xored with the PC to index, kept up to date by the shift
+uint32_t ghr_hash;
 
 int idx;
 int result;
 
+const predictor_param params_openend[] = {
+  { "perceptrons", &perc_count, 1, 1 << 20, true, "number of perceptrons" },
+  { "history", &perc_history, 1, HISTORY_LANES, false, "global history bits" },
+  { "weight", &perc_weight_bits, 2, 8, false, "weight size in bits" },
+  { NULL, NULL, 0, 0, false, NULL }
+};
+
+int arrays_openend(predictor_array* out) {
+  out[0] = predictor_array{ "weights", perc_count, (perc_history + 1) * perc_weight_bits };
+  out[1] = predictor_array{ "ghr", 1, perc_history };
+  return 2;
+}
+
+int state_openend(predictor_state* out) {
+  out[0] = predictor_state{ "weights", perceptron_weights, (size_t)perc_count * HISTORY_LANES };
+  out[1] = predictor_state{ "bias", bias_weights, (size_t)perc_count };
+  out[2] = predictor_state{ "ghr", &GHR, sizeof(GHR) };
+  out[3] = predictor_state{ "ghr_hash", &ghr_hash, sizeof(ghr_hash) };
+  return 4;
+}
+
 void InitPredictor_openend() {
-  for (int i = 0; i < NUM_PERCEPTRONS; i ++) {
+  perc_theta = 1.93 * perc_history + 14;
+  weight_max = (1 << (perc_weight_bits - 1)) - 1;
+  weight_min = -weight_max;
+  ghr_mask = perc_history == 64 ? ~0ULL : (1ULL << perc_history) - 1;
+  for (int j = 0; j < HISTORY_LANES; j++) {
+    lane_valid[j] = j < perc_history ? -1 : 0;
+  }
+
+  delete[] perceptron_weights;
+  delete[] bias_weights;
+  perceptron_weights = new int8_t[perc_count * HISTORY_LANES];
+  bias_weights = new int8_t[perc_count];
+
+  for (int i = 0; i < perc_count; i ++) {
     bias_weights[i] = 0;
-    for (int j = 0; j < HISTORY_BITS; j++) {
-      perceptron_weights[i][j] = 0;
+    for (int j = 0; j < HISTORY_LANES; j++) {
+      perceptron_weights[i * HISTORY_LANES + j] = 0;
     }
   }
 
-  for(int i = 0; i < HISTORY_BITS; i++)
-  {
-    GHR[i] = -1;
-  }
+  // all not taken
+  GHR = 0;
+  ghr_hash = 0;
 }
 
 bool GetPrediction_openend(UINT32 PC) {
 
   // use ghr to xor with pc to reduce aliasing
-  uint32_t ghr_hash = 0;
-  for(int i = 0; i < 32 && i < HISTORY_BITS; i++)
-  {
-    if(GHR[i] == 1)
-    {
-      ghr_hash |= (1 << i);
-    }
-  }
-  
-  idx = (PC^ghr_hash) & (NUM_PERCEPTRONS - 1);
+  idx = (PC^ghr_hash) & (perc_count - 1);
 
   // perceptron function
   // y = w_0 + sum_i (x_i + w_i)
@@ -207,9 +318,8 @@ bool GetPrediction_openend(UINT32 PC) {
   // w_0
   int prediction = bias_weights[idx];
 
-  for (int i = 0; i < HISTORY_BITS; i++) {
-    prediction += perceptron_weights[idx][i] * GHR[i];
-  }
+  prediction += perceptron_dot(&perceptron_weights[idx * HISTORY_LANES], GHR,
+                               lane_valid, perc_history);
 
   result = prediction;
 
@@ -224,34 +334,353 @@ void UpdatePredictor_openend(UINT32 PC, bool resolveDir, bool predDir, UINT32 br
   // if sign(y) != t || |y| <= theta
   // w_i = w_i + t*x_i
 
-  if (predDir != resolveDir || abs(result) <= THETA) {
+  if (predDir != resolveDir || abs(result) <= perc_theta) {
 
     // update w_0 (there is no x_0)
-    if(target == 1 && bias_weights[idx] < WEIGHT_MAX)
+    if(target == 1 && bias_weights[idx] < weight_max)
     {
       bias_weights[idx]++;
     }
-    else if(target == -1 && bias_weights[idx] > WEIGHT_MIN)
+    else if(target == -1 && bias_weights[idx] > weight_min)
     {
       bias_weights[idx]--;
     }
 
-    for(int i = 0; i < HISTORY_BITS; i++)
-    {
-      if(target == GHR[i] && perceptron_weights[idx][i] < WEIGHT_MAX)
-      {
-        perceptron_weights[idx][i]++;
+    perceptron_train(&perceptron_weights[idx * HISTORY_LANES], GHR, target,
+                     lane_valid, perc_history, weight_min, weight_max);
+  }
+
+  // Shift history and save most recent history:
+  GHR = ((GHR << 1) | resolveDir) & ghr_mask;
+  ghr_hash = (uint32_t)GHR;
+}
+
+/***********************************************************
+* 
+* 4. TAGE Predictor
+*     Base bimodal table plus TAGE_NUM_TAGGED partially tagged
+*     components indexed with geometric history lengths
+*
+*     Size = base entries * 2 + sum_i tagged entries * (3 + 2 + tag_i)
+*            + history bits + 4 bit alt-on-new-alloc counter
+*     Each table is sized to the largest power of two that fits
+*     the storage budget, at the default 16 KB:
+*          = 4096 * 2 + 1024 * (8 * 5 + 72) + 160 + 4 = 123,044 bits
+***********************************************************/
+
+#define TAGE_NUM_TAGGED 8 // Number of tagged components
+#define TAGE_MIN_HIST 4 // History length of the shortest component
+#define TAGE_MAX_HIST 160 // History length of the longest component
+#define TAGE_BASE_SHIFT 2 // Base table has 4x the entries of a tagged one
+#define TAGE_CTR_MAX 3 // 3 bit signed prediction counters
+#define TAGE_CTR_MIN -4
+#define TAGE_U_MAX 3 // 2 bit usefulness counters
+#define TAGE_U_RESET_PERIOD (1 << 18) // Branches between usefulness decays
+
+// Global history is a circular buffer of bits, newest at ghist_ptr
+#define TAGE_HIST_BUF 1024
+
+#if TAGE_HIST_BUF < 2 * TAGE_MAX_HIST
+#error "the TAGE history buffer must hold at least twice the longest history"
+#endif
+
+// Tag width of each tagged component, longer histories get wider tags
+static const int tage_tag_bits[TAGE_NUM_TAGGED] = { 7, 7, 8, 8, 9, 10, 11, 12 };
+
+struct tage_entry {
+  int8_t ctr; // taken if >= 0
+  uint16_t tag;
+  uint8_t u;
+};
+
+// History of olength bits folded into clength bits, updated with each shift
+struct tage_folded {
+  uint32_t comp;
+  int clength;
+  int olength;
+  int outpoint;
+};
+
+int tage_budget_bits = 16 * 1024 * 8; // Storage budget
+
+int tage_log_entries; // log2 of the entries of each tagged component
+int tage_hist_len[TAGE_NUM_TAGGED];
+tage_entry* tage_tables[TAGE_NUM_TAGGED];
+uint8_t* tage_base; // 2 bit counters, like the 2 bit saturating predictor
+
+uint8_t tage_ghist[TAGE_HIST_BUF];
+int tage_ghist_ptr;
+tage_folded tage_index_fold[TAGE_NUM_TAGGED];
+tage_folded tage_tag_fold[2][TAGE_NUM_TAGGED];
+
+int tage_use_alt_on_na; // >= 0: trust the alternate over a weak new entry
+uint32_t tage_tick; // branches since the last usefulness decay
+uint32_t tage_seed; // allocation randomization
+
+// Lookup state handed from GetPrediction_tage to UpdatePredictor_tage
+uint32_t tage_idx[TAGE_NUM_TAGGED];
+uint16_t tage_tag[TAGE_NUM_TAGGED];
+uint32_t tage_base_idx;
+int tage_provider; // longest matching component, -1 for the base table
+int tage_alt; // next longest matching component, -1 for the base table
+bool tage_provider_pred;
+bool tage_alt_pred;
+
+// Storage of the predictor with 2^log_entries entries per tagged component
+long tage_storage_bits(int log_entries) {
+  long bits = 2L << (log_entries + TAGE_BASE_SHIFT);
+  for (int i = 0; i < TAGE_NUM_TAGGED; i++) {
+    bits += (long)(3 + 2 + tage_tag_bits[i]) << log_entries;
+  }
+  return bits + TAGE_MAX_HIST + 4;
+}
+
+// Largest log2 tagged component entries that fit the budget
+static int tage_fit_log_entries() {
+  int log_entries = 0;
+  while (log_entries < 24 && tage_storage_bits(log_entries + 1) <= tage_budget_bits) {
+    log_entries++;
+  }
+  return log_entries;
+}
+
+const predictor_param params_tage[] = {
+  // 2 KB is the smallest budget of 128 entry tagged components, as the
+  // index hash needs at least TAGE_NUM_TAGGED - 1 index bits
+  { "budget", &tage_budget_bits, 2 * 1024 * 8, 1 << 30, false, "storage budget in bits" },
+  { NULL, NULL, 0, 0, false, NULL }
+};
+
+int arrays_tage(predictor_array* out) {
+  int log_entries = tage_fit_log_entries();
+  int n = 0;
+
+  out[n++] = predictor_array{ "base", 1L << (log_entries + TAGE_BASE_SHIFT), 2 };
+  for (int i = 0; i < TAGE_NUM_TAGGED; i++) {
+    out[n] = predictor_array{ "", 1L << log_entries, 3 + 2 + tage_tag_bits[i] };
+    snprintf(out[n].name, sizeof(out[n].name), "tagged%d", i + 1);
+    n++;
+  }
+  out[n++] = predictor_array{ "ghist", 1, TAGE_MAX_HIST };
+  out[n++] = predictor_array{ "use_alt", 1, 4 };
+  return n;
+}
+
+int state_tage(predictor_state* out) {
+  int n = 0;
+
+  out[n++] = predictor_state{ "base", tage_base, (size_t)1 << (tage_log_entries + TAGE_BASE_SHIFT) };
+  for (int i = 0; i < TAGE_NUM_TAGGED; i++) {
+    out[n++] = predictor_state{ "tagged", tage_tables[i], sizeof(tage_entry) << tage_log_entries };
+  }
+  out[n++] = predictor_state{ "ghist", tage_ghist, sizeof(tage_ghist) };
+  out[n++] = predictor_state{ "ghist_ptr", &tage_ghist_ptr, sizeof(tage_ghist_ptr) };
+  out[n++] = predictor_state{ "index_fold", tage_index_fold, sizeof(tage_index_fold) };
+  out[n++] = predictor_state{ "tag_fold", tage_tag_fold, sizeof(tage_tag_fold) };
+  out[n++] = predictor_state{ "use_alt", &tage_use_alt_on_na, sizeof(tage_use_alt_on_na) };
+  out[n++] = predictor_state{ "tick", &tage_tick, sizeof(tage_tick) };
+  out[n++] = predictor_state{ "seed", &tage_seed, sizeof(tage_seed) };
+  return n;
+}
+
+static void tage_fold_init(tage_folded* f, int olength, int clength) {
+  f->comp = 0;
+  f->olength = olength;
+  f->clength = clength;
+  f->outpoint = olength % clength;
+}
+
+// shifts the newest history bit in and the one olength bits back out
+static void tage_fold_update(tage_folded* f) {
+  f->comp = (f->comp << 1) ^ tage_ghist[tage_ghist_ptr];
+  f->comp ^= tage_ghist[(tage_ghist_ptr + f->olength) & (TAGE_HIST_BUF - 1)] << f->outpoint;
+  f->comp ^= f->comp >> f->clength;
+  f->comp &= (1u << f->clength) - 1;
+}
+
+static bool tage_weak(int8_t ctr) {
+  return ctr == 0 || ctr == -1;
+}
+
+static int8_t tage_ctr_update(int8_t ctr, bool taken) {
+  if (taken) {
+    return ctr < TAGE_CTR_MAX ? ctr + 1 : ctr;
+  }
+  return ctr > TAGE_CTR_MIN ? ctr - 1 : ctr;
+}
+
+void InitPredictor_tage() {
+  // Largest power of two tables that fit the budget:
+  tage_log_entries = tage_fit_log_entries();
+  // the index hash shifts the PC right by log_entries - i for component i
+  if (tage_log_entries < TAGE_NUM_TAGGED - 1) {
+    fprintf(stderr, "TAGE budget of %d bits is too small\n", tage_budget_bits);
+    exit(1);
+  }
+
+  delete[] tage_base;
+  tage_base = new uint8_t[1 << (tage_log_entries + TAGE_BASE_SHIFT)];
+  for (int i = 0; i < (1 << (tage_log_entries + TAGE_BASE_SHIFT)); i++) {
+    tage_base[i] = 1; // weak not taken
+  }
+
+  for (int i = 0; i < TAGE_NUM_TAGGED; i++) {
+    // geometric series from TAGE_MIN_HIST to TAGE_MAX_HIST
+    tage_hist_len[i] = (int)(TAGE_MIN_HIST * pow((double)TAGE_MAX_HIST / TAGE_MIN_HIST,
+                                                 (double)i / (TAGE_NUM_TAGGED - 1)) + 0.5);
+
+    delete[] tage_tables[i];
+    // value initialized so that the padding of checkpoints is zero too
+    tage_tables[i] = new tage_entry[1 << tage_log_entries]();
+    for (int j = 0; j < (1 << tage_log_entries); j++) {
+      tage_tables[i][j].ctr = 0;
+      tage_tables[i][j].tag = 0;
+      tage_tables[i][j].u = 0;
+    }
+
+    tage_fold_init(&tage_index_fold[i], tage_hist_len[i], tage_log_entries);
+    tage_fold_init(&tage_tag_fold[0][i], tage_hist_len[i], tage_tag_bits[i]);
+    tage_fold_init(&tage_tag_fold[1][i], tage_hist_len[i], tage_tag_bits[i] - 1);
+  }
+
+  for (int i = 0; i < TAGE_HIST_BUF; i++) {
+    tage_ghist[i] = 0;
+  }
+  tage_ghist_ptr = 0;
+  tage_use_alt_on_na = 0;
+  tage_tick = 0;
+  tage_seed = 1;
+}
+
+bool GetPrediction_tage(UINT32 PC) {
+  uint32_t mask = (1u << tage_log_entries) - 1;
+
+  for (int i = 0; i < TAGE_NUM_TAGGED; i++) {
+    tage_idx[i] = (PC ^ (PC >> (tage_log_entries - i)) ^ tage_index_fold[i].comp) & mask;
+    tage_tag[i] = (PC ^ tage_tag_fold[0][i].comp ^ (tage_tag_fold[1][i].comp << 1))
+                  & ((1u << tage_tag_bits[i]) - 1);
+  }
+  tage_base_idx = PC & ((1u << (tage_log_entries + TAGE_BASE_SHIFT)) - 1);
+  bool base_pred = tage_base[tage_base_idx] <= 1 ? NOT_TAKEN : TAKEN;
+
+  // Longest and next longest matching components:
+  tage_provider = tage_alt = -1;
+  for (int i = TAGE_NUM_TAGGED - 1; i >= 0; i--) {
+    if (tage_tables[i][tage_idx[i]].tag == tage_tag[i]) {
+      if (tage_provider < 0) {
+        tage_provider = i;
+      } else {
+        tage_alt = i;
+        break;
+      }
+    }
+  }
+
+  tage_alt_pred = tage_alt < 0 ? base_pred : tage_tables[tage_alt][tage_idx[tage_alt]].ctr >= 0;
+  if (tage_provider < 0) {
+    tage_provider_pred = tage_alt_pred;
+    return tage_alt_pred;
+  }
+
+  tage_entry* e = &tage_tables[tage_provider][tage_idx[tage_provider]];
+  tage_provider_pred = e->ctr >= 0;
+
+  // A weak entry is likely newly allocated, its alternate may know better
+  if (tage_weak(e->ctr) && e->u == 0 && tage_use_alt_on_na >= 0) {
+    return tage_alt_pred;
+  }
+  return tage_provider_pred;
+}
+
+void UpdatePredictor_tage(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget) {
+
+  if (tage_provider >= 0) {
+    tage_entry* e = &tage_tables[tage_provider][tage_idx[tage_provider]];
+
+    // Learn whether weak new entries or their alternates are right:
+    if (tage_weak(e->ctr) && e->u == 0 && tage_provider_pred != tage_alt_pred) {
+      if (tage_alt_pred == resolveDir && tage_use_alt_on_na < 7) {
+        tage_use_alt_on_na++;
+      } else if (tage_alt_pred != resolveDir && tage_use_alt_on_na > -8) {
+        tage_use_alt_on_na--;
+      }
+    }
+  }
+
+  // On a misprediction allocate an entry in a longer component
+  if (predDir != resolveDir && tage_provider < TAGE_NUM_TAGGED - 1) {
+    int start = tage_provider + 1;
+
+    // skip one component half the time so that allocations spread out
+    tage_seed = tage_seed * 1103515245 + 12345;
+    if ((tage_seed >> 16) & 1 && start < TAGE_NUM_TAGGED - 1) {
+      start++;
+    }
+
+    int i = start;
+    while (i < TAGE_NUM_TAGGED && tage_tables[i][tage_idx[i]].u != 0) {
+      i++;
+    }
+    if (i < TAGE_NUM_TAGGED) {
+      tage_entry* e = &tage_tables[i][tage_idx[i]];
+      e->tag = tage_tag[i];
+      e->ctr = resolveDir ? 0 : -1;
+      e->u = 0;
+    } else {
+      // nothing free, age the candidates
+      for (int j = tage_provider + 1; j < TAGE_NUM_TAGGED; j++) {
+        if (tage_tables[j][tage_idx[j]].u > 0) {
+          tage_tables[j][tage_idx[j]].u--;
+        }
       }
-      else if(target != GHR[i] && perceptron_weights[idx][i] > WEIGHT_MIN)
-      {
-        perceptron_weights[idx][i]--;
+    }
+  }
+
+  // Train the provider, and its alternate while the provider is not useful yet
+  if (tage_provider >= 0) {
+    tage_entry* e = &tage_tables[tage_provider][tage_idx[tage_provider]];
+    if (e->u == 0) {
+      if (tage_alt >= 0) {
+        tage_entry* a = &tage_tables[tage_alt][tage_idx[tage_alt]];
+        a->ctr = tage_ctr_update(a->ctr, resolveDir);
+      } else if (resolveDir && tage_base[tage_base_idx] < 3) {
+        tage_base[tage_base_idx]++;
+      } else if (!resolveDir && tage_base[tage_base_idx] > 0) {
+        tage_base[tage_base_idx]--;
+      }
+    }
+    e->ctr = tage_ctr_update(e->ctr, resolveDir);
+
+    // Useful when it was right and the alternate was not
+    if (tage_provider_pred != tage_alt_pred) {
+      if (tage_provider_pred == resolveDir && e->u < TAGE_U_MAX) {
+        e->u++;
+      } else if (tage_provider_pred != resolveDir && e->u > 0) {
+        e->u--;
+      }
+    }
+  } else if (resolveDir && tage_base[tage_base_idx] < 3) {
+    tage_base[tage_base_idx]++;
+  } else if (!resolveDir && tage_base[tage_base_idx] > 0) {
+    tage_base[tage_base_idx]--;
+  }
+
+  // Periodically decay usefulness so stale entries can be replaced
+  if (++tage_tick == TAGE_U_RESET_PERIOD) {
+    tage_tick = 0;
+    for (int i = 0; i < TAGE_NUM_TAGGED; i++) {
+      for (int j = 0; j < (1 << tage_log_entries); j++) {
+        tage_tables[i][j].u >>= 1;
       }
     }
   }
 
   // Shift history and save most recent history:
-  for (int i = HISTORY_BITS - 1; i > 0; i--) {
-    GHR[i] = GHR[i - 1];
+  tage_ghist_ptr = (tage_ghist_ptr - 1) & (TAGE_HIST_BUF - 1);
+  tage_ghist[tage_ghist_ptr] = resolveDir;
+  for (int i = 0; i < TAGE_NUM_TAGGED; i++) {
+    tage_fold_update(&tage_index_fold[i]);
+    tage_fold_update(&tage_tag_fold[0][i]);
+    tage_fold_update(&tage_tag_fold[1][i]);
   }
-  GHR[0] = target;
 }
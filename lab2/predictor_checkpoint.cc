@@ -0,0 +1,135 @@
+#include "predictor_checkpoint.h"
+
+#include <string.h>
+
+/***********************************************************
+* Blob fields
+***********************************************************/
+
+#define CHECKPOINT_NAME_SIZE 32 // predictor and region names, NUL padded
+
+struct checkpoint_header {
+  uint32_t magic;
+  uint32_t version;
+  char name[CHECKPOINT_NAME_SIZE];
+};
+
+static bool write_bytes(FILE* f, const void* data, size_t bytes) {
+  return fwrite(data, 1, bytes, f) == bytes;
+}
+
+static bool read_bytes(FILE* f, void* data, size_t bytes) {
+  return fread(data, 1, bytes, f) == bytes;
+}
+
+static void copy_name(char* out, const char* name) {
+  memset(out, 0, CHECKPOINT_NAME_SIZE);
+  strncpy(out, name, CHECKPOINT_NAME_SIZE - 1);
+}
+
+static int count_params(const predictor_param* params) {
+  int n = 0;
+  while (params[n].name != NULL) n++;
+  return n;
+}
+
+/***********************************************************
+* Save and load
+***********************************************************/
+
+bool predictor_save(FILE* f, const char* name, const predictor_param* params,
+                    int (*state)(predictor_state* out)) {
+  checkpoint_header h;
+  h.magic = CHECKPOINT_MAGIC;
+  h.version = CHECKPOINT_VERSION;
+  copy_name(h.name, name);
+  bool ok = write_bytes(f, &h, sizeof(h));
+
+  uint32_t nparams = count_params(params);
+  ok = ok && write_bytes(f, &nparams, sizeof(nparams));
+  for (uint32_t i = 0; i < nparams; i++) {
+    int32_t value = *params[i].value;
+    ok = ok && write_bytes(f, &value, sizeof(value));
+  }
+
+  predictor_state regions[MAX_PREDICTOR_STATES];
+  uint32_t nregions = state(regions);
+  ok = ok && write_bytes(f, &nregions, sizeof(nregions));
+  for (uint32_t i = 0; i < nregions; i++) {
+    char region_name[CHECKPOINT_NAME_SIZE];
+    uint64_t bytes = regions[i].bytes;
+    copy_name(region_name, regions[i].name);
+    ok = ok && write_bytes(f, region_name, sizeof(region_name));
+    ok = ok && write_bytes(f, &bytes, sizeof(bytes));
+    ok = ok && write_bytes(f, regions[i].data, regions[i].bytes);
+  }
+
+  if (!ok) {
+    fprintf(stderr, "cannot write the %s checkpoint\n", name);
+  }
+  return ok;
+}
+
+bool predictor_load(FILE* f, const char* name, const predictor_param* params,
+                    int (*state)(predictor_state* out)) {
+  checkpoint_header h;
+  if (!read_bytes(f, &h, sizeof(h)) || h.magic != CHECKPOINT_MAGIC) {
+    fprintf(stderr, "not a predictor checkpoint\n");
+    return false;
+  }
+  if (h.version != CHECKPOINT_VERSION) {
+    fprintf(stderr, "checkpoint version %u, expected %u\n", h.version, CHECKPOINT_VERSION);
+    return false;
+  }
+  h.name[CHECKPOINT_NAME_SIZE - 1] = '\0';
+  if (strncmp(h.name, name, CHECKPOINT_NAME_SIZE - 1)) {
+    fprintf(stderr, "checkpoint of predictor %s, expected %s\n", h.name, name);
+    return false;
+  }
+
+  uint32_t nparams;
+  if (!read_bytes(f, &nparams, sizeof(nparams)) || nparams != (uint32_t)count_params(params)) {
+    fprintf(stderr, "%s checkpoint has the wrong number of parameters\n", name);
+    return false;
+  }
+  for (uint32_t i = 0; i < nparams; i++) {
+    int32_t value;
+    if (!read_bytes(f, &value, sizeof(value))) {
+      fprintf(stderr, "truncated %s checkpoint\n", name);
+      return false;
+    }
+    if (value != *params[i].value) {
+      fprintf(stderr, "%s checkpoint was taken with %s.%s=%d, not %d\n", name, name,
+              params[i].name, value, *params[i].value);
+      return false;
+    }
+  }
+
+  predictor_state regions[MAX_PREDICTOR_STATES];
+  uint32_t nregions = state(regions);
+  uint32_t saved;
+  if (!read_bytes(f, &saved, sizeof(saved)) || saved != nregions) {
+    fprintf(stderr, "%s checkpoint has the wrong number of state regions\n", name);
+    return false;
+  }
+  for (uint32_t i = 0; i < nregions; i++) {
+    char region_name[CHECKPOINT_NAME_SIZE];
+    uint64_t bytes;
+    if (!read_bytes(f, region_name, sizeof(region_name)) || !read_bytes(f, &bytes, sizeof(bytes))) {
+      fprintf(stderr, "truncated %s checkpoint\n", name);
+      return false;
+    }
+    region_name[CHECKPOINT_NAME_SIZE - 1] = '\0';
+    if (strcmp(region_name, regions[i].name) || bytes != regions[i].bytes) {
+      fprintf(stderr, "%s checkpoint region %s of %llu bytes, expected %s of %llu bytes\n",
+              name, region_name, (unsigned long long)bytes, regions[i].name,
+              (unsigned long long)regions[i].bytes);
+      return false;
+    }
+    if (!read_bytes(f, regions[i].data, regions[i].bytes)) {
+      fprintf(stderr, "truncated %s checkpoint\n", name);
+      return false;
+    }
+  }
+  return true;
+}
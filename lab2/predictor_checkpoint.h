@@ -0,0 +1,41 @@
+#ifndef PREDICTOR_CHECKPOINT_H
+#define PREDICTOR_CHECKPOINT_H
+
+#include "predictor_config.h"
+
+#include <stdio.h>
+
+/***********************************************************
+*
+* Predictor state checkpoints
+*
+*   A checkpoint is a versioned binary blob of everything a
+*   predictor has learned, so a warmed predictor can be saved
+*   once and restored at every sample point instead of replaying
+*   the warmup branches:
+*
+*     magic, version, predictor name
+*     parameter count, then each parameter value
+*     state region count, then each region: name, bytes, data
+*
+*   Fields are in host byte order, a checkpoint written on a host
+*   of the other byte order is rejected by its magic. A checkpoint
+*   is only loaded into the same predictor with the same parameters,
+*   after its InitPredictor_*() call.
+*
+***********************************************************/
+
+#define CHECKPOINT_MAGIC 0x4b435042 // "BPCK"
+#define CHECKPOINT_VERSION 1
+
+// Returns false with a message on stderr if the state cannot be written
+bool predictor_save(FILE* f, const char* name, const predictor_param* params,
+                    int (*state)(predictor_state* out));
+
+// Returns false with a message on stderr if the checkpoint is malformed
+// or does not match the predictor's configuration, the predictor's state
+// is then undefined
+bool predictor_load(FILE* f, const char* name, const predictor_param* params,
+                    int (*state)(predictor_state* out));
+
+#endif
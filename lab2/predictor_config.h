@@ -0,0 +1,83 @@
+#ifndef PREDICTOR_CONFIG_H
+#define PREDICTOR_CONFIG_H
+
+#include "predictor.h"
+
+#include <stddef.h>
+
+/***********************************************************
+*
+* Runtime configuration of the predictors in predictor.cc
+*
+*   Every predictor exposes its parameters (set before its
+*   InitPredictor_*() call, the defaults are the submitted
+*   configuration) and the storage arrays they size, so the
+*   storage can be counted exactly and handed to CACTI.
+*
+*   The state regions of a predictor are the memory that holds
+*   what it has learned, valid after its InitPredictor_*() call,
+*   so the state can be checkpointed (predictor_checkpoint.h).
+*
+***********************************************************/
+
+// One parameter of a predictor
+struct predictor_param {
+  const char* name;
+  int* value;
+  int min;
+  int max;
+  bool pow2; // must be a power of two
+  const char* desc;
+};
+
+// One storage array of a predictor: rows of row_bits bits each.
+// Single row arrays are registers, they count towards the storage
+// but are not modelled with CACTI.
+struct predictor_array {
+  char name[32];
+  long rows;
+  int row_bits;
+};
+
+#define MAX_PREDICTOR_ARRAYS 16
+
+// One region of a predictor's state. The lookup state handed from
+// GetPrediction_* to UpdatePredictor_* is not part of it, and neither
+// is anything InitPredictor_*() derives from the parameters.
+struct predictor_state {
+  const char* name;
+  void* data;
+  size_t bytes;
+};
+
+#define MAX_PREDICTOR_STATES 32
+
+void InitPredictor_2bitsat();
+bool GetPrediction_2bitsat(UINT32 PC);
+void UpdatePredictor_2bitsat(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget);
+extern const predictor_param params_2bitsat[];
+int arrays_2bitsat(predictor_array* out);
+int state_2bitsat(predictor_state* out);
+
+void InitPredictor_2level();
+bool GetPrediction_2level(UINT32 PC);
+void UpdatePredictor_2level(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget);
+extern const predictor_param params_2level[];
+int arrays_2level(predictor_array* out);
+int state_2level(predictor_state* out);
+
+void InitPredictor_openend();
+bool GetPrediction_openend(UINT32 PC);
+void UpdatePredictor_openend(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget);
+extern const predictor_param params_openend[];
+int arrays_openend(predictor_array* out);
+int state_openend(predictor_state* out);
+
+void InitPredictor_tage();
+bool GetPrediction_tage(UINT32 PC);
+void UpdatePredictor_tage(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget);
+extern const predictor_param params_tage[];
+int arrays_tage(predictor_array* out);
+int state_tage(predictor_state* out);
+
+#endif
@@ -0,0 +1,260 @@
+#ifndef PREDICTOR_TEMPLATES_H
+#define PREDICTOR_TEMPLATES_H
+
+#include "predictor.h"
+#include "predictor_config.h"
+#include "perceptron_kernels.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include <type_traits>
+
+/***********************************************************
+*
+* Compile-time specialized predictors
+*
+*   The predictors of predictor.cc as class templates over
+*   their geometry, so every index is a constant shift and
+*   mask. Each instantiation is a separate predictor:
+*
+*     Bimodal<log2 counters, counter bits>
+*     TwoLevel<log2 BHT entries, history bits, log2 PHTs, counter bits>
+*     Perceptron<log2 perceptrons, history bits, weight bits>
+*
+*   predictor_instance<P> gives an instantiation the
+*   InitPredictor_/GetPrediction_/UpdatePredictor_ entry points,
+*   its state is the whole predictor object.
+*
+***********************************************************/
+
+// 2^LOG_ENTRIES saturating counters of BITS bits packed into bytes,
+// taken in the upper half, initialized to weak not taken
+template <int LOG_ENTRIES, int BITS>
+class CounterTable {
+  static_assert(BITS == 1 || BITS == 2 || BITS == 4 || BITS == 8,
+                "counters are packed whole into bytes");
+
+  static const int LOG_PER_BYTE = BITS == 1 ? 3 : BITS == 2 ? 2 : BITS == 4 ? 1 : 0;
+  static const int MAX = (1 << BITS) - 1;
+  static const uint32_t MASK = (1u << LOG_ENTRIES) - 1;
+  static const long BYTES = LOG_ENTRIES >= LOG_PER_BYTE ? 1L << (LOG_ENTRIES - LOG_PER_BYTE) : 1;
+
+  uint8_t table[BYTES];
+
+  static int shift(uint32_t i) {
+    return (i & ((1u << LOG_PER_BYTE) - 1)) * BITS;
+  }
+
+ public:
+  CounterTable() {
+    uint8_t weak = 0;
+    for (int k = 0; k < 8; k += BITS) {
+      weak |= (MAX / 2) << k;
+    }
+    for (long i = 0; i < BYTES; i++) {
+      table[i] = weak;
+    }
+  }
+
+  int get(uint32_t i) const {
+    i &= MASK;
+    return (table[i >> LOG_PER_BYTE] >> shift(i)) & MAX;
+  }
+
+  bool taken(uint32_t i) const {
+    return get(i) > MAX / 2;
+  }
+
+  void update(uint32_t i, bool taken) {
+    int counter = get(i);
+    if (taken && counter < MAX) {
+      counter++;
+    } else if (!taken && counter > 0) {
+      counter--;
+    } else {
+      return;
+    }
+    i &= MASK;
+    table[i >> LOG_PER_BYTE] = (table[i >> LOG_PER_BYTE] & ~(MAX << shift(i))) | (counter << shift(i));
+  }
+
+  static predictor_array array(const char* name) {
+    predictor_array a = { "", BYTES, 8 };
+    if (LOG_ENTRIES < LOG_PER_BYTE) {
+      a.rows = 1L << LOG_ENTRIES;
+      a.row_bits = BITS;
+    }
+    snprintf(a.name, sizeof(a.name), "%s", name);
+    return a;
+  }
+};
+
+/*
+* 1. Bimodal table of saturating counters indexed by the PC
+*/
+template <int LOG_COUNTERS, int CTR_BITS>
+class Bimodal {
+  CounterTable<LOG_COUNTERS, CTR_BITS> counters;
+
+ public:
+  bool predict(UINT32 PC) {
+    return counters.taken(PC) ? TAKEN : NOT_TAKEN;
+  }
+
+  void update(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget) {
+    counters.update(PC, resolveDir);
+  }
+
+  static int arrays(predictor_array* out) {
+    out[0] = CounterTable<LOG_COUNTERS, CTR_BITS>::array("table");
+    return 1;
+  }
+};
+
+/*
+* 2. PAp two-level predictor: the low LOG_PHT PC bits select the PHT,
+*    the LOG_BHT bits above them the BHT entry
+*/
+template <int LOG_BHT, int HISTORY, int LOG_PHT, int CTR_BITS>
+class TwoLevel {
+  static_assert(HISTORY <= 16, "BHT entries are 16 bits");
+
+  static const uint32_t BHT_MASK = (1u << LOG_BHT) - 1;
+  static const uint32_t PHT_MASK = (1u << LOG_PHT) - 1;
+  static const uint32_t HISTORY_MASK = (1u << HISTORY) - 1;
+
+  uint16_t BHT[1 << LOG_BHT];
+  CounterTable<LOG_PHT + HISTORY, CTR_BITS> PHT;
+
+  static uint32_t bht_index(UINT32 PC) {
+    return (PC >> LOG_PHT) & BHT_MASK;
+  }
+
+  uint32_t pht_index(UINT32 PC) const {
+    return ((PC & PHT_MASK) << HISTORY) | BHT[bht_index(PC)];
+  }
+
+ public:
+  TwoLevel() {
+    for (int i = 0; i < (1 << LOG_BHT); i++) {
+      BHT[i] = 0;
+    }
+  }
+
+  bool predict(UINT32 PC) {
+    return PHT.taken(pht_index(PC)) ? TAKEN : NOT_TAKEN;
+  }
+
+  void update(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget) {
+    PHT.update(pht_index(PC), resolveDir);
+
+    uint16_t& history = BHT[bht_index(PC)];
+    history = ((history << 1) | resolveDir) & HISTORY_MASK;
+  }
+
+  static int arrays(predictor_array* out) {
+    out[0] = predictor_array{ "bht", 1L << LOG_BHT, HISTORY };
+    out[1] = CounterTable<LOG_PHT + HISTORY, CTR_BITS>::array("pht");
+    return 2;
+  }
+};
+
+/*
+* 3. Perceptron over a packed global history, indexed by the PC xored
+*    with the low history bits
+*/
+template <int LOG_PERCEPTRONS, int HISTORY, int WEIGHT_BITS>
+class Perceptron {
+  static_assert(HISTORY >= 1 && HISTORY <= HISTORY_LANES, "the history is at most 64 bits");
+  static_assert(WEIGHT_BITS >= 2 && WEIGHT_BITS <= 8, "weights are int8");
+
+  static const uint32_t MASK = (1u << LOG_PERCEPTRONS) - 1;
+  static const int WEIGHT_MAX = (1 << (WEIGHT_BITS - 1)) - 1;
+  static const uint64_t GHR_MASK = HISTORY == 64 ? ~0ULL : (1ULL << (HISTORY % 64)) - 1;
+
+  int8_t weights[1 << LOG_PERCEPTRONS][HISTORY_LANES];
+  int8_t bias[1 << LOG_PERCEPTRONS];
+  int8_t lanes[HISTORY_LANES];
+  uint64_t ghr;
+
+  // lookup state handed from predict to update
+  uint32_t idx;
+  int result;
+
+ public:
+  Perceptron() {
+    for (int i = 0; i < (1 << LOG_PERCEPTRONS); i++) {
+      bias[i] = 0;
+      for (int j = 0; j < HISTORY_LANES; j++) {
+        weights[i][j] = 0;
+      }
+    }
+    for (int j = 0; j < HISTORY_LANES; j++) {
+      lanes[j] = j < HISTORY ? -1 : 0;
+    }
+    ghr = 0;
+  }
+
+  bool predict(UINT32 PC) {
+    idx = (PC ^ (uint32_t)ghr) & MASK;
+    result = bias[idx] + perceptron_dot(weights[idx], ghr, lanes, HISTORY);
+    return result >= 0 ? TAKEN : NOT_TAKEN;
+  }
+
+  void update(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget) {
+    int target = resolveDir ? 1 : -1;
+
+    if (predDir != resolveDir || abs(result) <= 1.93 * HISTORY + 14) {
+      if (target == 1 && bias[idx] < WEIGHT_MAX) {
+        bias[idx]++;
+      } else if (target == -1 && bias[idx] > -WEIGHT_MAX) {
+        bias[idx]--;
+      }
+      perceptron_train(weights[idx], ghr, target, lanes, HISTORY, -WEIGHT_MAX, WEIGHT_MAX);
+    }
+
+    ghr = ((ghr << 1) | resolveDir) & GHR_MASK;
+  }
+
+  static int arrays(predictor_array* out) {
+    out[0] = predictor_array{ "weights", 1L << LOG_PERCEPTRONS, (HISTORY + 1) * WEIGHT_BITS };
+    out[1] = predictor_array{ "ghr", 1, HISTORY };
+    return 2;
+  }
+};
+
+// Entry points of one instance of a predictor template
+template <class P>
+struct predictor_instance {
+  static_assert(std::is_trivially_copyable<P>::value, "the state is checkpointed as bytes");
+
+  static P* instance;
+
+  static void init() {
+    delete instance;
+    instance = new P();
+  }
+
+  static bool get(UINT32 PC) {
+    return instance->predict(PC);
+  }
+
+  static void update(UINT32 PC, bool resolveDir, bool predDir, UINT32 branchTarget) {
+    instance->update(PC, resolveDir, predDir, branchTarget);
+  }
+
+  static int arrays(predictor_array* out) {
+    return P::arrays(out);
+  }
+
+  static int state(predictor_state* out) {
+    out[0] = predictor_state{ "instance", instance, sizeof(P) };
+    return 1;
+  }
+};
+
+template <class P>
+P* predictor_instance<P>::instance = NULL;
+
+#endif
@@ -4,6 +4,7 @@
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
 
 #include "instr.h"
@@ -20,61 +21,66 @@ static void print_tom_instr(instruction_t* instr) {
 }
 
 
+//creates an empty trace
+instruction_trace_t* create_trace(void) {
+
+  instruction_trace_t* trace = calloc(1, sizeof(instruction_trace_t));
+  assert(trace != NULL);
+  return trace;
+}
+
+//frees a trace and its chunks
+void free_trace(instruction_trace_t* trace) {
+
+  int nchunks = (trace->size + INSTR_TRACE_SIZE - 1) / INSTR_TRACE_SIZE;
+
+  for (int i = 0; i < nchunks; i++)
+     free(trace->chunks[i]);
+
+  free(trace->chunks);
+  free(trace);
+}
+
 //prints all the instructions inside the given trace for pipeline
 void print_all_instr(instruction_trace_t* trace, int sim_num_insn) {
 
   fprintf(stdout, "TOMASULO TABLE\n");
 
-  int printed_count = 0;
-  int index = 1;
-  while (true) {
+  for (int index = 1; index <= sim_num_insn && index < trace->size; index++) {
  
-     if (1) { // if (printed_count > 9999900) {
-        print_tom_instr(&trace->table[index]);
-     }
-
-     printed_count++;
-
-     if (printed_count == sim_num_insn)
-        break;
-      
-     if (++index == INSTR_TRACE_SIZE) {
-        trace = trace->next;
-	index = 0;
-	if (trace == NULL)
-	   break;
+     if (1) { // if (index > 9999900) {
+        print_tom_instr(get_instr(trace, index));
      }
-   }
+  }
 }
 
 //inserts the instruction into the trace
 void put_instr(instruction_trace_t* trace, instruction_t* instr) {
 
-  while ((trace->size == INSTR_TRACE_SIZE) && (trace->next != NULL)) {
-    trace = trace->next;
-  }
-  
-  if (trace->size == INSTR_TRACE_SIZE) {
-      
-     trace->next = malloc(sizeof(instruction_trace_t));
-     assert(trace->next != NULL);
-     //printf("trace=%p\n", trace);
-     trace = trace->next;
-     memset(trace, 0, sizeof(instruction_trace_t));
+  int offset = trace->size % INSTR_TRACE_SIZE;
+
+  if (offset == 0) {
+     int chunk = trace->size / INSTR_TRACE_SIZE;
+
+     //grow the directory geometrically so appends stay amortized constant
+     if (chunk == trace->dir_size) {
+        trace->dir_size = trace->dir_size ? 2 * trace->dir_size : 64;
+        trace->chunks = realloc(trace->chunks,
+                                trace->dir_size * sizeof(instruction_chunk_t*));
+        assert(trace->chunks != NULL);
+     }
+     trace->tail = trace->chunks[chunk] = malloc(sizeof(instruction_chunk_t));
+     assert(trace->tail != NULL);
   }
-  trace->table[trace->size++] = *instr;
+
+  trace->tail->table[offset] = *instr;
+  trace->size++;
 } 
 
 //gets the instruction at the index, from the trace
 instruction_t* get_instr(instruction_trace_t* trace, int index) {
 
-  while (index >= INSTR_TRACE_SIZE) {
-     index -= INSTR_TRACE_SIZE;
-     trace = trace->next;
+  assert(index >= 0 && index < trace->size);
 
-     assert(trace != NULL);
-  }
-
-  return &trace->table[index];
+  return &trace->chunks[index / INSTR_TRACE_SIZE]->table[index % INSTR_TRACE_SIZE];
 }
-
@@ -4,6 +4,15 @@
 
 #include "machine.h"
 
+struct my_instruction;
+
+//links a waiting source operand into the consumer list of its producer
+typedef struct tom_waiter
+{
+  struct my_instruction* instr; //the consumer
+  struct tom_waiter* next;
+}tom_waiter_t;
+
 //data structure representing each instruction
 typedef struct my_instruction
 {
@@ -14,28 +23,56 @@ typedef struct my_instruction
   int r_in[3]; //input registers
   enum md_opcode op; //opcode
   md_addr_t pc; //program counter the instruction executes at
+  md_addr_t next_pc; //PC execution continued at, the outcome of a branch
+  md_addr_t mem_addr; //effective address of a load or store
+  int mem_size; //bytes accessed by a load or store, 0 otherwise
 
   //the equivalents of Qj, Qk; these are pointers to the instructions producing the results
   // for the input registers of this instruction
   struct my_instruction * Q[3]; 
 
+  //number of Q[] producers that have not broadcast yet
+  int tom_pending;
+  //source operands of younger instructions waiting on this one's result
+  tom_waiter_t* consumers;
+  //list nodes for each Q[] entry
+  tom_waiter_t wait[3];
+
   //Specify the cycle an instruction **entered** this stage
   int tom_dispatch_cycle;  //dispatch
   int tom_issue_cycle;     //issue
   int tom_execute_cycle;   //execute
   int tom_cdb_cycle;       //writeback via Common Data Bus (CDB)
 
+  int tom_complete_cycle;  //cycle the execution finishes
+  int tom_lsq_slot;        //load/store queue entry of a load or store
+
 }instruction_t;
 
 #define INSTR_TRACE_SIZE 16384
 
-typedef struct my_instruction_list
+//block of INSTR_TRACE_SIZE consecutive instructions of a trace
+typedef struct my_instruction_chunk
 {
   instruction_t table[INSTR_TRACE_SIZE];
-  int size;
-  struct my_instruction_list* next;
+}instruction_chunk_t;
+
+//instruction trace; instruction i lives in chunks[i / INSTR_TRACE_SIZE], so
+//put_instr and get_instr are constant time
+typedef struct my_instruction_list
+{
+  instruction_chunk_t** chunks; //chunk directory
+  int dir_size;                 //entries allocated in the directory
+  int size;                     //instructions put in the trace
+  instruction_chunk_t* tail;    //chunk receiving the next put_instr
 }instruction_trace_t;
 
+//creates an empty trace
+extern instruction_trace_t* create_trace(void);
+
+//frees a trace and its chunks
+extern void free_trace(instruction_trace_t* trace);
+
 //prints all the instructions inside the given trace
 extern void print_all_instr(instruction_trace_t* table, int sim_num_insn);
 
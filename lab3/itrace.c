@@ -0,0 +1,544 @@
+#include <assert.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "host.h"
+#include "misc.h"
+#include "machine.h"
+#include "decode.def"
+
+#include "instr.h"
+#include "itrace.h"
+
+//largest encoded record: two 10 byte varints, the register mask and fields,
+//the instruction word, the next PC varint of a control instruction, and the
+//address varint and size of a load or store
+#define ITRACE_MAX_RECORD  (10 + 10 + 1 + 5 + sizeof(md_inst_t) + 10 + 10 + 1)
+
+//file header, stored in host byte order
+struct itrace_header
+{
+  char magic[8];
+  word_t version;
+  word_t flags;
+  word_t byte_order;    //0x01020304 as written by the host
+  word_t inst_size;     //sizeof(md_inst_t) of the target
+  word_t total_regs;    //MD_TOTAL_REGS of the target
+  word_t block_size;
+  counter_t ninsn;      //number of instructions in the trace
+};
+
+//header of each block
+struct itrace_block
+{
+  word_t ninsn;         //records in the block
+  word_t raw_size;      //size of the records
+  word_t stored_size;   //size in the file, smaller than raw_size if compressed
+};
+
+struct itrace_writer
+{
+  FILE* fd;
+  struct itrace_header header;
+  unsigned char raw[ITRACE_BLOCK_SIZE];
+  int raw_size;
+  int block_ninsn;
+  unsigned char* packed;    //compressed block
+  md_addr_t pc;             //PC of the previous record
+  md_addr_t mem_addr;       //address of the previous load or store
+};
+
+struct itrace_file
+{
+  unsigned char* map;
+  size_t size;
+  struct itrace_header header;
+};
+
+/* LZ BLOCK COMPRESSION */
+
+// LZ77 with LZ4-style sequences: a token with the literal length in the
+// high nibble and the match length - 4 in the low nibble (15 means more
+// length bytes follow), the literals, then a 16-bit match offset. The last
+// sequence only has literals.
+
+#define LZ_HASH_BITS  12
+#define LZ_MIN_MATCH  4
+#define LZ_MAX_OFFSET 0xFFFF
+
+//worst case size of a compressed block
+#define LZ_BOUND(n)   ((n) + (n) / 255 + 16)
+
+static unsigned int lz_hash(const unsigned char* p)
+{
+  unsigned int v;
+  memcpy(&v, p, sizeof(v));
+  return (v * 2654435761U) >> (32 - LZ_HASH_BITS);
+}
+
+static unsigned char* lz_put_length(unsigned char* op, int len)
+{
+  while(len >= 255)
+  {
+    *op++ = 255;
+    len -= 255;
+  }
+  *op++ = len;
+  return op;
+}
+
+static unsigned char* lz_put_sequence(unsigned char* op, const unsigned char* lit,
+                                      int nlit, int offset, int match_len)
+{
+  unsigned char* token = op++;
+  int mlen = match_len ? match_len - LZ_MIN_MATCH : 0;
+
+  *token = ((nlit < 15 ? nlit : 15) << 4) | (mlen < 15 ? mlen : 15);
+  if(nlit >= 15) op = lz_put_length(op, nlit - 15);
+
+  memcpy(op, lit, nlit);
+  op += nlit;
+
+  if(match_len)
+  {
+    *op++ = offset & 0xFF;
+    *op++ = offset >> 8;
+    if(mlen >= 15) op = lz_put_length(op, mlen - 15);
+  }
+  return op;
+}
+
+//compresses n bytes into dst (LZ_BOUND(n) bytes), returns the compressed size
+static int lz_compress(const unsigned char* src, int n, unsigned char* dst)
+{
+  int table[1 << LZ_HASH_BITS];
+  for(int i = 0; i < (1 << LZ_HASH_BITS); i++) table[i] = -1;
+
+  unsigned char* op = dst;
+  int anchor = 0;
+  int i = 0;
+  while(i + LZ_MIN_MATCH <= n)
+  {
+    unsigned int h = lz_hash(src + i);
+    int cand = table[h];
+    table[h] = i;
+
+    if(cand >= 0 && i - cand <= LZ_MAX_OFFSET && memcmp(src + cand, src + i, LZ_MIN_MATCH) == 0)
+    {
+      int len = LZ_MIN_MATCH;
+      while(i + len < n && src[cand + len] == src[i + len]) len++;
+
+      op = lz_put_sequence(op, src + anchor, i - anchor, i - cand, len);
+      i += len;
+      anchor = i;
+    }
+    else
+    {
+      i++;
+    }
+  }
+  op = lz_put_sequence(op, src + anchor, n - anchor, 0, 0);
+
+  return op - dst;
+}
+
+static int lz_get_length(const unsigned char** ip, const unsigned char* end, int len)
+{
+  if(len == 15)
+  {
+    unsigned char b;
+    do
+    {
+      if(*ip >= end) return -1;
+      b = *(*ip)++;
+      len += b;
+    } while(b == 255);
+  }
+  return len;
+}
+
+//decompresses n bytes into dst (cap bytes), returns the size or -1 if corrupt
+static int lz_decompress(const unsigned char* src, int n, unsigned char* dst, int cap)
+{
+  const unsigned char* ip = src;
+  const unsigned char* end = src + n;
+  unsigned char* op = dst;
+
+  while(ip < end)
+  {
+    unsigned char token = *ip++;
+
+    int nlit = lz_get_length(&ip, end, token >> 4);
+    if(nlit < 0 || nlit > end - ip || nlit > cap - (op - dst)) return -1;
+    memcpy(op, ip, nlit);
+    ip += nlit;
+    op += nlit;
+
+    // the last sequence has no match
+    if(ip == end) break;
+
+    if(end - ip < 2) return -1;
+    int offset = ip[0] | (ip[1] << 8);
+    ip += 2;
+
+    int len = lz_get_length(&ip, end, token & 15);
+    if(len < 0) return -1;
+    len += LZ_MIN_MATCH;
+    if(offset == 0 || offset > op - dst || len > cap - (op - dst)) return -1;
+
+    // byte by byte, the match may overlap the output
+    const unsigned char* match = op - offset;
+    while(len--) *op++ = *match++;
+  }
+
+  return op - dst;
+}
+
+/* RECORD ENCODING */
+
+static unsigned char* put_varint(unsigned char* p, qword_t v)
+{
+  while(v >= 0x80)
+  {
+    *p++ = (v & 0x7F) | 0x80;
+    v >>= 7;
+  }
+  *p++ = v;
+  return p;
+}
+
+static const unsigned char* get_varint(const unsigned char* p, const unsigned char* end, qword_t* v)
+{
+  qword_t result = 0;
+  int shift = 0;
+  while(p < end && shift < 64)
+  {
+    unsigned char b = *p++;
+    result |= (qword_t)(b & 0x7F) << shift;
+    if(!(b & 0x80))
+    {
+      *v = result;
+      return p;
+    }
+    shift += 7;
+  }
+  return NULL;
+}
+
+//register fields in record order
+#define ITRACE_NREGS 5
+
+static int* reg_field(instruction_t* instr, int i)
+{
+  return i < 2 ? &instr->r_out[i] : &instr->r_in[i - 2];
+}
+
+/* WRITER */
+
+static void itrace_flush(itrace_writer_t* writer)
+{
+  if(writer->block_ninsn == 0) return;
+
+  struct itrace_block block;
+  block.ninsn = writer->block_ninsn;
+  block.raw_size = writer->raw_size;
+  block.stored_size = writer->raw_size;
+
+  const unsigned char* data = writer->raw;
+  if(writer->header.flags & ITRACE_F_COMPRESS)
+  {
+    int packed_size = lz_compress(writer->raw, writer->raw_size, writer->packed);
+    if(packed_size < writer->raw_size)
+    {
+      block.stored_size = packed_size;
+      data = writer->packed;
+    }
+  }
+
+  if(fwrite(&block, sizeof(block), 1, writer->fd) != 1
+     || fwrite(data, block.stored_size, 1, writer->fd) != 1)
+    fatal("could not write instruction trace");
+
+  writer->raw_size = 0;
+  writer->block_ninsn = 0;
+  writer->pc = 0;
+  writer->mem_addr = 0;
+}
+
+itrace_writer_t* itrace_create(char* fname, bool compress)
+{
+  itrace_writer_t* writer = calloc(1, sizeof(itrace_writer_t));
+  if(writer == NULL)
+    fatal("out of virtual memory");
+
+  writer->fd = fopen(fname, "wb");
+  if(writer->fd == NULL)
+    fatal("cannot open instruction trace file `%s'", fname);
+
+  if(compress)
+  {
+    writer->packed = malloc(LZ_BOUND(ITRACE_BLOCK_SIZE));
+    if(writer->packed == NULL)
+      fatal("out of virtual memory");
+  }
+
+  struct itrace_header* header = &writer->header;
+  memcpy(header->magic, ITRACE_MAGIC, sizeof(header->magic));
+  header->version = ITRACE_VERSION;
+  header->flags = compress ? ITRACE_F_COMPRESS : 0;
+  header->byte_order = 0x01020304;
+  header->inst_size = sizeof(md_inst_t);
+  header->total_regs = MD_TOTAL_REGS;
+  header->block_size = ITRACE_BLOCK_SIZE;
+  header->ninsn = 0;
+
+  // rewritten with the final count by itrace_close
+  if(fwrite(header, sizeof(*header), 1, writer->fd) != 1)
+    fatal("could not write instruction trace");
+
+  return writer;
+}
+
+void itrace_write(itrace_writer_t* writer, instruction_t* instr)
+{
+  if(writer->raw_size + ITRACE_MAX_RECORD > ITRACE_BLOCK_SIZE)
+  {
+    itrace_flush(writer);
+  }
+
+  unsigned char* p = writer->raw + writer->raw_size;
+
+  // zig-zag delta from the fall-through PC
+  sqword_t delta = (sqword_t)instr->pc - (sqword_t)(writer->pc + sizeof(md_inst_t));
+  p = put_varint(p, ((qword_t)delta << 1) ^ (qword_t)(delta >> 63));
+  p = put_varint(p, instr->op);
+
+  unsigned char* mask = p++;
+  *mask = 0;
+  for(int i = 0; i < ITRACE_NREGS; i++)
+  {
+    int reg = *reg_field(instr, i);
+    if(reg != DNA)
+    {
+      assert(reg >= 0 && reg < 256);
+      *mask |= 1 << i;
+      *p++ = reg;
+    }
+  }
+
+  memcpy(p, &instr->inst, sizeof(md_inst_t));
+  p += sizeof(md_inst_t);
+
+  if(MD_OP_FLAGS(instr->op) & F_CTRL)
+  {
+    // zig-zag delta from the fall-through PC
+    delta = (sqword_t)instr->next_pc - (sqword_t)(instr->pc + sizeof(md_inst_t));
+    p = put_varint(p, ((qword_t)delta << 1) ^ (qword_t)(delta >> 63));
+  }
+
+  if(MD_OP_FLAGS(instr->op) & F_MEM)
+  {
+    // zig-zag delta from the previous effective address
+    delta = (sqword_t)instr->mem_addr - (sqword_t)writer->mem_addr;
+    p = put_varint(p, ((qword_t)delta << 1) ^ (qword_t)(delta >> 63));
+    assert(instr->mem_size >= 0 && instr->mem_size < 256);
+    *p++ = instr->mem_size;
+    writer->mem_addr = instr->mem_addr;
+  }
+
+  writer->raw_size = p - writer->raw;
+  writer->block_ninsn++;
+  writer->pc = instr->pc;
+  writer->header.ninsn++;
+}
+
+void itrace_close(itrace_writer_t* writer)
+{
+  itrace_flush(writer);
+
+  if(fseek(writer->fd, 0, SEEK_SET) != 0
+     || fwrite(&writer->header, sizeof(writer->header), 1, writer->fd) != 1
+     || fclose(writer->fd) != 0)
+    fatal("could not write instruction trace");
+
+  free(writer->packed);
+  free(writer);
+}
+
+/* READER */
+
+itrace_file_t* itrace_open(char* fname)
+{
+  itrace_file_t* file = calloc(1, sizeof(itrace_file_t));
+  if(file == NULL)
+    fatal("out of virtual memory");
+
+  int fd = open(fname, O_RDONLY);
+  if(fd < 0)
+    fatal("cannot open instruction trace file `%s'", fname);
+
+  struct stat st;
+  if(fstat(fd, &st) != 0 || st.st_size < (off_t)sizeof(struct itrace_header))
+    fatal("`%s' is not an instruction trace", fname);
+
+  file->size = st.st_size;
+  file->map = mmap(NULL, file->size, PROT_READ, MAP_PRIVATE, fd, 0);
+  close(fd);
+  if(file->map == MAP_FAILED)
+    fatal("cannot map instruction trace file `%s'", fname);
+
+  memcpy(&file->header, file->map, sizeof(file->header));
+  struct itrace_header* header = &file->header;
+  if(memcmp(header->magic, ITRACE_MAGIC, sizeof(header->magic)) != 0
+     || header->byte_order != 0x01020304)
+    fatal("`%s' is not an instruction trace for this host", fname);
+  if(header->version != ITRACE_VERSION)
+    fatal("instruction trace `%s' has version %d, expected %d",
+          fname, header->version, ITRACE_VERSION);
+  if(header->inst_size != sizeof(md_inst_t) || header->total_regs != MD_TOTAL_REGS
+     || header->block_size > ITRACE_BLOCK_SIZE)
+    fatal("instruction trace `%s' was written for another target", fname);
+
+  return file;
+}
+
+counter_t itrace_count(itrace_file_t* file)
+{
+  return file->header.ninsn;
+}
+
+void itrace_unmap(itrace_file_t* file)
+{
+  munmap(file->map, file->size);
+  free(file);
+}
+
+void itrace_cursor_init(itrace_cursor_t* cursor, itrace_file_t* file)
+{
+  cursor->file = file;
+  cursor->next_block = file->map + sizeof(struct itrace_header);
+  cursor->rec = cursor->rec_end = NULL;
+  cursor->buf = NULL;
+  cursor->pc = 0;
+  cursor->mem_addr = 0;
+  // instruction 0 is the skipped entry of the in-memory trace
+  cursor->index = 1;
+
+  if(file->header.flags & ITRACE_F_COMPRESS)
+  {
+    cursor->buf = malloc(ITRACE_BLOCK_SIZE);
+    if(cursor->buf == NULL)
+      fatal("out of virtual memory");
+  }
+}
+
+//moves the cursor to the next block, returns false at the end of the file
+static bool itrace_next_block(itrace_cursor_t* cursor)
+{
+  const unsigned char* end = cursor->file->map + cursor->file->size;
+  if(cursor->next_block >= end) return false;
+
+  struct itrace_block block;
+  if(end - cursor->next_block < (long)sizeof(block))
+    fatal("instruction trace is truncated");
+  memcpy(&block, cursor->next_block, sizeof(block));
+
+  const unsigned char* data = cursor->next_block + sizeof(block);
+  if(block.raw_size > ITRACE_BLOCK_SIZE || block.stored_size > block.raw_size
+     || block.stored_size > end - data)
+    fatal("instruction trace is corrupt");
+  cursor->next_block = data + block.stored_size;
+
+  if(block.stored_size < block.raw_size)
+  {
+    if(cursor->buf == NULL
+       || lz_decompress(data, block.stored_size, cursor->buf, ITRACE_BLOCK_SIZE) != (int)block.raw_size)
+      fatal("instruction trace is corrupt");
+    data = cursor->buf;
+  }
+
+  // uncompressed blocks are read straight from the mapping
+  cursor->rec = data;
+  cursor->rec_end = data + block.raw_size;
+  cursor->pc = 0;
+  cursor->mem_addr = 0;
+  return true;
+}
+
+bool itrace_next(itrace_cursor_t* cursor, instruction_t* instr)
+{
+  while(cursor->rec == cursor->rec_end)
+  {
+    if(!itrace_next_block(cursor)) return false;
+  }
+
+  const unsigned char* p = cursor->rec;
+  const unsigned char* end = cursor->rec_end;
+  qword_t zigzag, op;
+
+  memset(instr, 0, sizeof(instruction_t));
+
+  if((p = get_varint(p, end, &zigzag)) == NULL
+     || (p = get_varint(p, end, &op)) == NULL
+     || op >= OP_MAX || p >= end)
+    fatal("instruction trace is corrupt");
+
+  sqword_t delta = (sqword_t)(zigzag >> 1) ^ -(sqword_t)(zigzag & 1);
+  instr->pc = cursor->pc + sizeof(md_inst_t) + delta;
+  instr->op = op;
+  instr->index = cursor->index++;
+
+  unsigned char mask = *p++;
+  for(int i = 0; i < ITRACE_NREGS; i++)
+  {
+    if(mask & (1 << i))
+    {
+      if(p >= end) fatal("instruction trace is corrupt");
+      *reg_field(instr, i) = *p++;
+    }
+    else
+    {
+      *reg_field(instr, i) = DNA;
+    }
+  }
+
+  if(end - p < (long)sizeof(md_inst_t))
+    fatal("instruction trace is corrupt");
+  memcpy(&instr->inst, p, sizeof(md_inst_t));
+  p += sizeof(md_inst_t);
+
+  instr->next_pc = instr->pc + sizeof(md_inst_t);
+  if(MD_OP_FLAGS(instr->op) & F_CTRL)
+  {
+    if((p = get_varint(p, end, &zigzag)) == NULL)
+      fatal("instruction trace is corrupt");
+    delta = (sqword_t)(zigzag >> 1) ^ -(sqword_t)(zigzag & 1);
+    instr->next_pc += delta;
+  }
+
+  if(MD_OP_FLAGS(instr->op) & F_MEM)
+  {
+    if((p = get_varint(p, end, &zigzag)) == NULL || p >= end)
+      fatal("instruction trace is corrupt");
+    delta = (sqword_t)(zigzag >> 1) ^ -(sqword_t)(zigzag & 1);
+    instr->mem_addr = cursor->mem_addr + delta;
+    instr->mem_size = *p++;
+    cursor->mem_addr = instr->mem_addr;
+  }
+
+  cursor->rec = p;
+  cursor->pc = instr->pc;
+  return true;
+}
+
+void itrace_cursor_free(itrace_cursor_t* cursor)
+{
+  free(cursor->buf);
+  cursor->buf = NULL;
+}
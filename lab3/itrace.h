@@ -0,0 +1,79 @@
+#ifndef ITRACE_H
+#define ITRACE_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "host.h"
+#include "instr.h"
+
+/*
+ * On-disk instruction trace, written by sim-safe and replayed by the tomasulo
+ * model through mmap so one functional run can be reused by many timing runs.
+ *
+ * The file is a header followed by independent blocks of up to
+ * ITRACE_BLOCK_SIZE bytes of records. Each record holds the PC as a zig-zag
+ * varint delta from the fall-through of the previous PC, the opcode as a
+ * varint, a mask of the valid register fields followed by one byte per valid
+ * register, and the raw instruction word (kept for disassembly). Control
+ * instructions follow with the PC execution continued at as a zig-zag varint
+ * delta from the fall-through PC, zero if not taken. Loads and stores follow
+ * with the effective address as a zig-zag varint delta from the previous one
+ * and the access size. Blocks may be LZ compressed, the deltas
+ * restart at every block.
+ */
+
+#define ITRACE_MAGIC       "SSITRACE"
+#define ITRACE_VERSION     3
+#define ITRACE_BLOCK_SIZE  (64 * 1024)
+
+//the blocks are LZ compressed
+#define ITRACE_F_COMPRESS  0x0001
+
+//trace file being written
+typedef struct itrace_writer itrace_writer_t;
+
+//mapped trace file, can be shared by several readers
+typedef struct itrace_file itrace_file_t;
+
+//reader over a mapped trace file, one per timing run
+typedef struct itrace_cursor
+{
+  itrace_file_t* file;
+  const unsigned char* next_block;  //next block in the mapping
+  const unsigned char* rec;         //next record of the current block
+  const unsigned char* rec_end;
+  unsigned char* buf;               //decompressed block
+  md_addr_t pc;                     //PC of the previous record
+  md_addr_t mem_addr;               //address of the previous load or store
+  int index;                        //index of the next instruction
+}itrace_cursor_t;
+
+//creates a trace file, compress selects LZ compressed blocks
+extern itrace_writer_t* itrace_create(char* fname, bool compress);
+
+//appends the next executed instruction to the trace
+extern void itrace_write(itrace_writer_t* writer, instruction_t* instr);
+
+//flushes the last block and the header, and closes the file
+extern void itrace_close(itrace_writer_t* writer);
+
+//maps a trace file, calls fatal() if it is not a valid trace for this target
+extern itrace_file_t* itrace_open(char* fname);
+
+//number of instructions in the trace
+extern counter_t itrace_count(itrace_file_t* file);
+
+//unmaps a trace file
+extern void itrace_unmap(itrace_file_t* file);
+
+//positions a reader at the first instruction of the trace
+extern void itrace_cursor_init(itrace_cursor_t* cursor, itrace_file_t* file);
+
+//decodes the next instruction, returns false at the end of the trace
+extern bool itrace_next(itrace_cursor_t* cursor, instruction_t* instr);
+
+//frees the reader's buffers
+extern void itrace_cursor_free(itrace_cursor_t* cursor);
+
+#endif
@@ -126,7 +126,7 @@ __ptrace_newinst(unsigned int iseq,	/* instruction sequence number */
 		 md_addr_t addr)	/* address referenced, if load/store */
 {
   myfprintf(ptrace_outfd, "+ %u 0x%08p 0x%08p ", iseq, pc, addr);
-  md_print_insn(inst, addr, ptrace_outfd);
+  md_print_insn(inst, pc, ptrace_outfd);
   fprintf(ptrace_outfd, "\n");
 
   if (ptrace_outfd == stderr || ptrace_outfd == stdout)
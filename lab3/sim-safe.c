@@ -66,6 +66,9 @@
 #include "sim.h"
 
 #include "instr.h"
+#include "itrace.h"
+#include "ptrace.h"
+#include "tomasulo.h"
 #include "decode.def"
 #include <assert.h>
 
@@ -88,6 +91,70 @@ static counter_t sim_num_refs = 0;
 
 /* ECE552 BEGIN */
 static counter_t sim_num_tom_cycles = 0;
+
+/* where the tomasulo cycles went */
+static tom_stats_t tom_stats;
+
+/* run the tomasulo model alongside the functional simulation */
+static int tom_stream;
+
+/* tomasulo machine geometry */
+static tom_config_t tom_config;
+
+/* tomasulo design-space sweep, each entry is a machine geometry */
+#define MAX_TOM_SWEEP		64
+static int tom_sweep_nelt = 0;
+static char *tom_sweep_opts[MAX_TOM_SWEEP];
+static tom_config_t tom_sweep_configs[MAX_TOM_SWEEP];
+
+/* sweep results file */
+static char *tom_sweep_fname;
+
+/* maximum number of concurrent sweep timing runs */
+static int tom_sweep_threads;
+
+/* instruction trace file to write, and whether to compress it */
+static char *tom_trace_out;
+static int tom_trace_compress;
+
+/* instruction trace file to replay instead of executing the program */
+static char *tom_trace_in;
+
+/* instruction trace file being written */
+static itrace_writer_t *tom_trace_writer = NULL;
+
+/* tomasulo memory-dependence prediction */
+static int tom_mdp;
+
+/* tomasulo branch predictor type {nottaken|taken|perfect|bimod|2lev|comb} */
+static char *pred_type;
+
+/* bimodal predictor config (<table_size>) */
+static int bimod_nelt = 1;
+static int bimod_config[1] =
+  { /* bimod tbl size */2048 };
+
+/* 2-level predictor config (<l1size> <l2size> <hist_size> <xor>) */
+static int twolev_nelt = 4;
+static int twolev_config[4] =
+  { /* l1size */1, /* l2size */1024, /* hist */8, /* xor */FALSE};
+
+/* combining predictor config (<meta_table_size> */
+static int comb_nelt = 1;
+static int comb_config[1] =
+  { /* meta_table_size */1024 };
+
+/* return address stack (RAS) size */
+static int ras_size = 8;
+
+/* BTB predictor config (<num_sets> <associativity>) */
+static int btb_nelt = 2;
+static int btb_config[2] =
+  { /* nsets */512, /* assoc */4 };
+
+/* tomasulo pipetrace options */
+static int ptrace_nelt = 0;
+static char *ptrace_opts[2];
 /* ECE552 END */
 
 /* maximum number of inst's to execute */
@@ -110,15 +177,325 @@ sim_reg_options(struct opt_odb_t *odb)
 	       &max_insts, /* default */0,
 	       /* print */TRUE, /* format */NULL);
 
+  /* ECE552 BEGIN */
+  /* the options below override the default geometry field by field */
+  tom_config_default(&tom_config);
+
+  opt_reg_flag(odb, "-tom:stream",
+	       "stream instructions into the tomasulo model instead of "
+	       "keeping the whole trace",
+	       &tom_stream, /* default */FALSE,
+	       /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-tom:window",
+	      "tomasulo instruction window in insts (0 = size from the "
+	      "IFQ and reservation stations)",
+	      &tom_config.window, /* default */0,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-tom:ifqsize", "tomasulo instruction fetch queue size",
+	      &tom_config.ifq_size, /* default */INSTR_QUEUE_SIZE,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-tom:rs:int", "tomasulo INT reservation stations",
+	      &tom_config.rs_int_size, /* default */RESERV_INT_SIZE,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-tom:rs:fp", "tomasulo FP reservation stations",
+	      &tom_config.rs_fp_size, /* default */RESERV_FP_SIZE,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-tom:fu:int", "tomasulo INT functional units",
+	      &tom_config.fu_int_size, /* default */FU_INT_SIZE,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-tom:fu:fp", "tomasulo FP functional units",
+	      &tom_config.fu_fp_size, /* default */FU_FP_SIZE,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-tom:lat:int", "tomasulo INT functional unit latency",
+	      &tom_config.fu_int_latency, /* default */FU_INT_LATENCY,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-tom:lat:fp", "tomasulo FP functional unit latency",
+	      &tom_config.fu_fp_latency, /* default */FU_FP_LATENCY,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-tom:width",
+	      "tomasulo instructions fetched and dispatched per cycle",
+	      &tom_config.fetch_width, /* default */FETCH_WIDTH,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-tom:cdbs", "tomasulo common data buses",
+	      &tom_config.cdb_size, /* default */CDB_SIZE,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-tom:lsq",
+	      "tomasulo load/store queue entries (0 = loads and stores are "
+	      "only ordered by registers)",
+	      &tom_config.lsq_size, /* default */LSQ_SIZE,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-tom:lat:fwd",
+	      "tomasulo latency of a load forwarded from an older store",
+	      &tom_config.fwd_latency, /* default */LSQ_FWD_LATENCY,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_flag(odb, "-tom:mdp",
+	       "let tomasulo loads speculate past older stores with unknown "
+	       "addresses, using a load wait table",
+	       &tom_mdp, /* default */FALSE,
+	       /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-tom:mdp:penalty",
+	      "tomasulo dispatch cycles lost to a memory order violation",
+	      &tom_config.mdp_penalty, /* default */MDP_PENALTY,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_string(odb, "-bpred",
+		 "tomasulo branch predictor type "
+		 "{nottaken|taken|perfect|bimod|2lev|comb}",
+		 &pred_type, /* default */"perfect",
+		 /* print */TRUE, /* format */NULL);
+
+  opt_reg_int_list(odb, "-bpred:bimod",
+		   "bimodal predictor config (<table size>)",
+		   bimod_config, bimod_nelt, &bimod_nelt,
+		   /* default */bimod_config,
+		   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
+
+  opt_reg_int_list(odb, "-bpred:2lev",
+		   "2-level predictor config "
+		   "(<l1size> <l2size> <hist_size> <xor>)",
+		   twolev_config, twolev_nelt, &twolev_nelt,
+		   /* default */twolev_config,
+		   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
+
+  opt_reg_int_list(odb, "-bpred:comb",
+		   "combining predictor config (<meta_table_size>)",
+		   comb_config, comb_nelt, &comb_nelt,
+		   /* default */comb_config,
+		   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
+
+  opt_reg_int(odb, "-bpred:ras",
+	      "return address stack size (0 for no return stack)",
+	      &ras_size, /* default */ras_size,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_int_list(odb, "-bpred:btb",
+		   "BTB config (<num_sets> <associativity>)",
+		   btb_config, btb_nelt, &btb_nelt,
+		   /* default */btb_config,
+		   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
+
+  opt_reg_int(odb, "-tom:mplat",
+	      "tomasulo fetch cycles lost after a mispredicted branch leaves "
+	      "the IFQ",
+	      &tom_config.branch_penalty, /* default */BRANCH_PENALTY,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_note(odb,
+"  The tomasulo front end fetches the correct path only: a branch whose\n"
+"  predicted next PC is wrong stops fetch until it leaves the IFQ, plus\n"
+"  -tom:mplat cycles.  The -bpred options are the ones of sim-outorder, the\n"
+"  default `perfect' predictor never stops fetch.\n"
+		);
+
+  opt_reg_string_list(odb, "-tom:sweep",
+		      "replay the trace on each tomasulo geometry "
+		      "<ifq>:<rsint>:<rsfp>:<fuint>:<fufp>:<latint>:<latfp>"
+		      "[:<width>:<cdbs>]",
+		      tom_sweep_opts, /* arr_sz */MAX_TOM_SWEEP, &tom_sweep_nelt,
+		      /* default */NULL, /* !print */FALSE, /* format */NULL,
+		      /* !accrue */FALSE);
+
+  opt_reg_note(odb,
+"  The tomasulo sweep runs the functional simulation once, then replays the\n"
+"  trace on every -tom:sweep geometry (in up to -tom:sweep:threads threads)\n"
+"  and writes the cycles and IPC of each one to -tom:sweep:out as CSV, e.g.:\n"
+"\n"
+"    -tom:sweep 16:5:3:3:1:5:7 16:8:4:4:2:5:7 32:16:8:8:2:5:7:4:2\n"
+"\n"
+"  <width> and <cdbs> default to 1.  The instruction window, load/store\n"
+"  queue and branch predictor of the sweep runs are the ones set by\n"
+"  -tom:window, -tom:lsq, -tom:lat:fwd, -tom:mdp, -bpred and -tom:mplat.\n"
+		);
+
+  opt_reg_string(odb, "-tom:sweep:out", "tomasulo sweep CSV file name",
+		 &tom_sweep_fname, /* default */"tom-sweep.csv",
+		 /* print */TRUE, /* format */NULL);
+
+  opt_reg_int(odb, "-tom:sweep:threads",
+	      "maximum number of concurrent tomasulo sweep runs",
+	      &tom_sweep_threads, /* default */4,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_string(odb, "-tom:trace:out",
+		 "write the instruction trace to this file and time it from "
+		 "there",
+		 &tom_trace_out, /* default */NULL,
+		 /* print */TRUE, /* format */NULL);
+
+  opt_reg_flag(odb, "-tom:trace:compress",
+	       "LZ compress the blocks of the instruction trace file",
+	       &tom_trace_compress, /* default */FALSE,
+	       /* print */TRUE, /* format */NULL);
+
+  opt_reg_string(odb, "-tom:trace:in",
+		 "time this instruction trace file instead of executing the "
+		 "program",
+		 &tom_trace_in, /* default */NULL,
+		 /* print */TRUE, /* format */NULL);
+
+  opt_reg_note(odb,
+"  A trace written with -tom:trace:out can be replayed with -tom:trace:in on\n"
+"  other tomasulo geometries (or a -tom:sweep) without re-executing the\n"
+"  benchmark.  The trace file is mapped into memory, so it does not need to\n"
+"  fit in RAM.\n"
+		);
+
+  opt_reg_string_list(odb, "-ptrace",
+	      "generate tomasulo pipetrace, i.e., <fname|stdout|stderr> <range>",
+	      ptrace_opts, /* arr_sz */2, &ptrace_nelt, /* default */NULL,
+	      /* !print */FALSE, /* format */NULL, /* !accrue */FALSE);
+
+  opt_reg_note(odb,
+"  The tomasulo pipetrace can be viewed with pipeview.pl, which shows the\n"
+"  IFQ (dispatch) as IF, the reservation stations (issue) as DA, and the\n"
+"  CDB as WB.  Pipetrace range arguments are formatted as follows:\n"
+"\n"
+"    {{@|#}<start>}:{{@|#|+}<end>}\n"
+"\n"
+"  Both ends of the range are optional, if neither are specified, the entire\n"
+"  execution is traced.  Ranges that start with a `@' designate an address\n"
+"  range to be traced, those that start with an `#' designate a tomasulo\n"
+"  cycle range.  All other range values represent an instruction count\n"
+"  range.  The second argument, if specified with a `+', indicates a value\n"
+"  relative to the first argument, e.g., 1000:+100 == 1000:1100.  Program\n"
+"  symbols may be used in all contexts.\n"
+"\n"
+"    Examples:   -ptrace FOO.trc #0:#1000\n"
+"                -ptrace BAR.trc 10000:+200\n"
+		);
+  /* ECE552 END */
+}
+
+/* fills the tomasulo branch predictor config from the -bpred options, checking
+   them the way sim-outorder does */
+static void
+tom_bpred_check(tom_bpred_config_t *bpred)
+{
+  memset(bpred, 0, sizeof(*bpred));
+
+  if (!mystricmp(pred_type, "perfect"))
+    {
+      bpred->perfect = TRUE;
+      return;
+    }
+
+  if (!mystricmp(pred_type, "taken"))
+    bpred->pred_class = BPredTaken;
+  else if (!mystricmp(pred_type, "nottaken"))
+    bpred->pred_class = BPredNotTaken;
+  else if (!mystricmp(pred_type, "bimod"))
+    {
+      if (bimod_nelt != 1)
+	fatal("bad bimod predictor config (<table_size>)");
+      bpred->pred_class = BPred2bit;
+    }
+  else if (!mystricmp(pred_type, "2lev"))
+    {
+      if (twolev_nelt != 4)
+	fatal("bad 2-level pred config (<l1size> <l2size> <hist_size> <xor>)");
+      bpred->pred_class = BPred2Level;
+    }
+  else if (!mystricmp(pred_type, "comb"))
+    {
+      if (twolev_nelt != 4)
+	fatal("bad 2-level pred config (<l1size> <l2size> <hist_size> <xor>)");
+      if (bimod_nelt != 1)
+	fatal("bad bimod predictor config (<table_size>)");
+      if (comb_nelt != 1)
+	fatal("bad combining predictor config (<meta_table_size>)");
+      bpred->pred_class = BPredComb;
+    }
+  else
+    fatal("cannot parse predictor type `%s'", pred_type);
+
+  if (btb_nelt != 2)
+    fatal("bad btb config (<num_sets> <associativity>)");
+
+  /* only the tables of the selected class are passed to bpred_create() */
+  if (bpred->pred_class == BPred2bit || bpred->pred_class == BPredComb)
+    bpred->bimod_size = bimod_config[0];
+  if (bpred->pred_class == BPred2Level || bpred->pred_class == BPredComb)
+    {
+      bpred->l1size = twolev_config[0];
+      bpred->l2size = twolev_config[1];
+      bpred->shift_width = twolev_config[2];
+      bpred->xor = twolev_config[3];
+    }
+  if (bpred->pred_class == BPredComb)
+    bpred->meta_size = comb_config[0];
+  if (bpred->pred_class != BPredTaken && bpred->pred_class != BPredNotTaken)
+    {
+      bpred->btb_sets = btb_config[0];
+      bpred->btb_assoc = btb_config[1];
+      bpred->ras_size = ras_size;
+    }
 }
 
 /* check simulator-specific option values */
 void
 sim_check_options(struct opt_odb_t *odb, int argc, char **argv)
 {
-  /* nada */
+  /* ECE552 BEGIN */
+  int i;
+
+  tom_config.mdp = tom_mdp;
+  tom_config_check(&tom_config);
+  tom_bpred_check(&tom_config.bpred);
+
+  for (i = 0; i < tom_sweep_nelt; i++)
+    {
+      tom_config_default(&tom_sweep_configs[i]);
+      if (!tom_config_parse(&tom_sweep_configs[i], tom_sweep_opts[i]))
+	fatal("bad tomasulo sweep geometry `%s'", tom_sweep_opts[i]);
+      tom_sweep_configs[i].window = tom_config.window;
+      tom_sweep_configs[i].lsq_size = tom_config.lsq_size;
+      tom_sweep_configs[i].fwd_latency = tom_config.fwd_latency;
+      tom_sweep_configs[i].mdp = tom_config.mdp;
+      tom_sweep_configs[i].mdp_penalty = tom_config.mdp_penalty;
+      tom_sweep_configs[i].bpred = tom_config.bpred;
+      tom_sweep_configs[i].branch_penalty = tom_config.branch_penalty;
+      tom_config_check(&tom_sweep_configs[i]);
+    }
+
+  if (tom_sweep_nelt > 0 && tom_stream)
+    fatal("the tomasulo sweep replays the full trace, "
+	  "it cannot be used with -tom:stream");
+
+  if (tom_sweep_threads < 1)
+    fatal("need at least one tomasulo sweep thread");
+
+  if (tom_trace_in && (tom_trace_out || tom_stream))
+    fatal("-tom:trace:in replays a trace, it cannot be used with "
+	  "-tom:trace:out or -tom:stream");
+  /* ECE552 END */
 }
 
+/* ECE552 BEGIN */
+/* registers the share of the tomasulo CPI of a dispatch slot counter */
+static void
+tom_reg_cpi(struct stat_sdb_t *sdb, char *name, char *desc, char *slots)
+{
+  char formula[128];
+
+  sprintf(formula, "%s / (%d * sim_num_insn)", slots, tom_config.fetch_width);
+  stat_reg_formula(sdb, name, desc, formula, NULL);
+}
+/* ECE552 END */
+
 /* register simulator-specific statistics */
 void
 sim_reg_stats(struct stat_sdb_t *sdb)
@@ -141,6 +518,101 @@ sim_reg_stats(struct stat_sdb_t *sdb)
   stat_reg_counter(sdb, "sim_num_tom_cycles",
 		   "total number of cycles with tomasulo",
 		   &sim_num_tom_cycles, 0, NULL);
+  stat_reg_formula(sdb, "sim_tom_CPI",
+		   "cycles per instruction with tomasulo",
+		   "sim_num_tom_cycles / sim_num_insn", NULL);
+  stat_reg_counter(sdb, "sim_tom_window_stalls",
+		   "cycles tomasulo fetch waited on a full instruction window",
+		   &tom_stats.window_stalls, 0, NULL);
+
+  /* lost dispatch slots, these add up to the CPI */
+  stat_reg_counter(sdb, "tom_disp_used",
+		   "dispatch slots that moved an instruction out of the IFQ",
+		   &tom_stats.disp_used, 0, NULL);
+  stat_reg_counter(sdb, "tom_disp_ifq_empty",
+		   "dispatch slots lost to an empty IFQ",
+		   &tom_stats.disp_ifq_empty, 0, NULL);
+  stat_reg_counter(sdb, "tom_disp_rs_full_int",
+		   "dispatch slots lost to full INT reservation stations",
+		   &tom_stats.disp_rs_full_int, 0, NULL);
+  stat_reg_counter(sdb, "tom_disp_rs_full_fp",
+		   "dispatch slots lost to full FP reservation stations",
+		   &tom_stats.disp_rs_full_fp, 0, NULL);
+  stat_reg_counter(sdb, "tom_disp_lsq_full",
+		   "dispatch slots lost to a full load/store queue",
+		   &tom_stats.disp_lsq_full, 0, NULL);
+  stat_reg_counter(sdb, "tom_disp_mem_squash",
+		   "dispatch slots lost to memory order violations",
+		   &tom_stats.disp_mem_squash, 0, NULL);
+  stat_reg_counter(sdb, "tom_disp_branch",
+		   "dispatch slots lost to branch redirects",
+		   &tom_stats.disp_branch, 0, NULL);
+  tom_reg_cpi(sdb, "tom_cpi_base", "CPI of the used dispatch slots",
+	      "tom_disp_used");
+  tom_reg_cpi(sdb, "tom_cpi_ifq_empty", "CPI lost to an empty IFQ",
+	      "tom_disp_ifq_empty");
+  tom_reg_cpi(sdb, "tom_cpi_rs_full_int", "CPI lost to full INT stations",
+	      "tom_disp_rs_full_int");
+  tom_reg_cpi(sdb, "tom_cpi_rs_full_fp", "CPI lost to full FP stations",
+	      "tom_disp_rs_full_fp");
+  tom_reg_cpi(sdb, "tom_cpi_lsq_full", "CPI lost to a full load/store queue",
+	      "tom_disp_lsq_full");
+  tom_reg_cpi(sdb, "tom_cpi_mem_squash", "CPI lost to memory order violations",
+	      "tom_disp_mem_squash");
+  tom_reg_cpi(sdb, "tom_cpi_branch", "CPI lost to branch redirects",
+	      "tom_disp_branch");
+
+  /* why the reservation stations fill up */
+  stat_reg_counter(sdb, "tom_fu_busy_int",
+		   "ready INT instruction-cycles waiting on a busy FU",
+		   &tom_stats.fu_busy_int, 0, NULL);
+  stat_reg_counter(sdb, "tom_fu_busy_fp",
+		   "ready FP instruction-cycles waiting on a busy FU",
+		   &tom_stats.fu_busy_fp, 0, NULL);
+  stat_reg_counter(sdb, "tom_raw_wait_int",
+		   "operand-cycles waiting on an INT computation",
+		   &tom_stats.raw_wait[TOM_PROD_INT], 0, NULL);
+  stat_reg_counter(sdb, "tom_raw_wait_load",
+		   "operand-cycles waiting on a load",
+		   &tom_stats.raw_wait[TOM_PROD_LOAD], 0, NULL);
+  stat_reg_counter(sdb, "tom_raw_wait_fp",
+		   "operand-cycles waiting on an FP computation",
+		   &tom_stats.raw_wait[TOM_PROD_FP], 0, NULL);
+  stat_reg_counter(sdb, "tom_cdb_wait",
+		   "completed instruction-cycles waiting for a CDB",
+		   &tom_stats.cdb_wait, 0, NULL);
+  stat_reg_counter(sdb, "tom_lsq_wait",
+		   "ready load-cycles held back by older stores",
+		   &tom_stats.lsq_wait, 0, NULL);
+  stat_reg_counter(sdb, "tom_lsq_forwards",
+		   "loads forwarded from an older store",
+		   &tom_stats.lsq_forwards, 0, NULL);
+  stat_reg_counter(sdb, "tom_mem_violations",
+		   "loads that read memory before an older aliasing store",
+		   &tom_stats.mem_violations, 0, NULL);
+
+  /* front end */
+  stat_reg_counter(sdb, "tom_branches",
+		   "control instructions fetched",
+		   &tom_stats.branches, 0, NULL);
+  stat_reg_counter(sdb, "tom_bpred_mispred",
+		   "control instructions fetched with a wrong predicted next PC",
+		   &tom_stats.branch_mispred, 0, NULL);
+  stat_reg_formula(sdb, "tom_bpred_rate",
+		   "tomasulo next PC prediction rate",
+		   "1 - tom_bpred_mispred / tom_branches", /* format */NULL);
+
+  tom_stats.dispatch_dist =
+    stat_reg_dist(sdb, "tom_dispatch_dist",
+		  "instructions dispatched per cycle",
+		  /* init */0, /* arr sz */tom_config.fetch_width + 1,
+		  /* bucket sz */1, (PF_COUNT|PF_PDF), NULL, NULL, NULL);
+  tom_stats.issue_dist =
+    stat_reg_dist(sdb, "tom_issue_dist",
+		  "instructions issued to the FUs per cycle",
+		  /* init */0,
+		  /* arr sz */tom_config.fu_int_size + tom_config.fu_fp_size + 1,
+		  /* bucket sz */1, (PF_COUNT|PF_PDF), NULL, NULL, NULL);
   /* ECE552 END */
 
   ld_reg_stats(sdb);
@@ -171,6 +643,22 @@ sim_load_prog(char *fname,		/* program to load */
   /* load program text and data, set up environment, memory, and regs */
   ld_load_prog(fname, argc, argv, envp, &regs, mem, TRUE);
 
+  /* ECE552 BEGIN */
+  /* initialize here, so symbols can be loaded */
+  if (ptrace_nelt == 2)
+    {
+      /* generate a pipeline trace of the tomasulo model */
+      ptrace_open(/* fname */ptrace_opts[0], /* range */ptrace_opts[1]);
+      tom_config.ptrace = TRUE;
+    }
+  else if (ptrace_nelt == 0)
+    {
+      /* no pipetracing */;
+    }
+  else
+    fatal("bad pipetrace args, use: <fname|stdout|stderr> <range>");
+  /* ECE552 END */
+
   /* initialize the DLite debugger */
   dlite_init(md_reg_obj, dlite_mem_obj, dlite_mstate_obj);
 }
@@ -193,7 +681,17 @@ sim_aux_stats(FILE *stream)		/* output stream */
 void
 sim_uninit(void)
 {
-  /* nada */
+  /* ECE552 BEGIN */
+  /* the program exited before -max:inst, keep the trace usable */
+  if (tom_trace_writer)
+    {
+      itrace_close(tom_trace_writer);
+      tom_trace_writer = NULL;
+    }
+
+  if (ptrace_nelt > 0)
+    ptrace_close();
+  /* ECE552 END */
 }
 
 
@@ -262,27 +760,56 @@ sim_uninit(void)
 #error No ISA target defined...
 #endif
 
+/* ECE552 BEGIN */
+/* widens the bytes touched by the traced instruction to cover [ADDR, ADDR+SIZE) */
+static void
+tom_mem_ref(instruction_t *instr, md_addr_t addr, int size)
+{
+  if (instr->mem_size == 0)
+    {
+      instr->mem_addr = addr;
+      instr->mem_size = size;
+    }
+  else
+    {
+      md_addr_t lo = MIN(instr->mem_addr, addr);
+      md_addr_t hi = MAX(instr->mem_addr + instr->mem_size, addr + size);
+
+      instr->mem_addr = lo;
+      instr->mem_size = hi - lo;
+    }
+}
+/* ECE552 END */
+
 /* precise architected memory state accessor macros */
 #define READ_BYTE(SRC, FAULT)						\
-  ((FAULT) = md_fault_none, addr = (SRC), MEM_READ_BYTE(mem, addr))
+  ((FAULT) = md_fault_none, addr = (SRC), tom_mem_ref(&m_instr, addr, 1),\
+   MEM_READ_BYTE(mem, addr))
 #define READ_HALF(SRC, FAULT)						\
-  ((FAULT) = md_fault_none, addr = (SRC), MEM_READ_HALF(mem, addr))
+  ((FAULT) = md_fault_none, addr = (SRC), tom_mem_ref(&m_instr, addr, 2),\
+   MEM_READ_HALF(mem, addr))
 #define READ_WORD(SRC, FAULT)						\
-  ((FAULT) = md_fault_none, addr = (SRC), MEM_READ_WORD(mem, addr))
+  ((FAULT) = md_fault_none, addr = (SRC), tom_mem_ref(&m_instr, addr, 4),\
+   MEM_READ_WORD(mem, addr))
 #ifdef HOST_HAS_QWORD
 #define READ_QWORD(SRC, FAULT)						\
-  ((FAULT) = md_fault_none, addr = (SRC), MEM_READ_QWORD(mem, addr))
+  ((FAULT) = md_fault_none, addr = (SRC), tom_mem_ref(&m_instr, addr, 8),\
+   MEM_READ_QWORD(mem, addr))
 #endif /* HOST_HAS_QWORD */
 
 #define WRITE_BYTE(SRC, DST, FAULT)					\
-  ((FAULT) = md_fault_none, addr = (DST), MEM_WRITE_BYTE(mem, addr, (SRC)))
+  ((FAULT) = md_fault_none, addr = (DST), tom_mem_ref(&m_instr, addr, 1),\
+   MEM_WRITE_BYTE(mem, addr, (SRC)))
 #define WRITE_HALF(SRC, DST, FAULT)					\
-  ((FAULT) = md_fault_none, addr = (DST), MEM_WRITE_HALF(mem, addr, (SRC)))
+  ((FAULT) = md_fault_none, addr = (DST), tom_mem_ref(&m_instr, addr, 2),\
+   MEM_WRITE_HALF(mem, addr, (SRC)))
 #define WRITE_WORD(SRC, DST, FAULT)					\
-  ((FAULT) = md_fault_none, addr = (DST), MEM_WRITE_WORD(mem, addr, (SRC)))
+  ((FAULT) = md_fault_none, addr = (DST), tom_mem_ref(&m_instr, addr, 4),\
+   MEM_WRITE_WORD(mem, addr, (SRC)))
 #ifdef HOST_HAS_QWORD
 #define WRITE_QWORD(SRC, DST, FAULT)					\
-  ((FAULT) = md_fault_none, addr = (DST), MEM_WRITE_QWORD(mem, addr, (SRC)))
+  ((FAULT) = md_fault_none, addr = (DST), tom_mem_ref(&m_instr, addr, 8),\
+   MEM_WRITE_QWORD(mem, addr, (SRC)))
 #endif /* HOST_HAS_QWORD */
 
 /* system call handler macro */
@@ -290,6 +817,40 @@ sim_uninit(void)
 
 /* ECE552 BEGIN */
 instruction_trace_t* instruction_trace;
+
+/* runs the -tom:sweep geometries over the trace, or the trace file if
+   not NULL */
+static void
+tom_run_sweep(instruction_trace_t *trace, itrace_file_t *file)
+{
+  FILE *csv;
+
+  if (tom_sweep_nelt == 0)
+    return;
+
+  csv = fopen(tom_sweep_fname, "w");
+  if (!csv)
+    fatal("cannot open tomasulo sweep file `%s'", tom_sweep_fname);
+
+  fprintf(stderr, "sim: ** replaying trace on %d tomasulo geometries **\n",
+	  tom_sweep_nelt);
+  tomasulo_sweep(tom_sweep_configs, tom_sweep_nelt, trace, file,
+		 sim_num_insn, tom_sweep_threads, csv);
+  fclose(csv);
+}
+
+/* times an instruction trace file */
+static void
+tom_replay(char *fname)
+{
+  itrace_file_t *file = itrace_open(fname);
+
+  sim_num_insn = itrace_count(file);
+  sim_num_tom_cycles = tomasulo_replay(&tom_config, file, &tom_stats);
+  tom_run_sweep(NULL, file);
+
+  itrace_unmap(file);
+}
 /* ECE552 END */
 
 /* start simulation, program loaded, processor precise state initialized */
@@ -306,11 +867,34 @@ sim_main(void)
   instruction_t m_instr;
   memset(&m_instr, 0, sizeof(instruction_t));
 
-  instruction_trace = malloc(sizeof(instruction_trace_t));
-  assert(instruction_trace != NULL);
-  memset(instruction_trace, 0, sizeof(instruction_trace_t));
-  //skip the first entry
-  instruction_trace->size++;
+  tomasulo_t *tom = NULL;
+
+  if (tom_trace_in)
+    {
+      fprintf(stderr, "sim: ** replaying instruction trace `%s' **\n",
+	      tom_trace_in);
+      tom_replay(tom_trace_in);
+      return;
+    }
+
+  if (tom_trace_out)
+    {
+      tom_trace_writer = itrace_create(tom_trace_out, tom_trace_compress);
+    }
+
+  if (tom_stream)
+    {
+      tom = tomasulo_create(&tom_config, &tom_stats);
+    }
+  else if (!tom_trace_out)
+    {
+      instruction_t skipped;
+
+      instruction_trace = create_trace();
+      //skip the first entry
+      memset(&skipped, 0, sizeof(skipped));
+      put_instr(instruction_trace, &skipped);
+    }
   /* ECE552 END */
 
   fprintf(stderr, "sim: ** starting functional simulation **\n");
@@ -351,6 +935,8 @@ sim_main(void)
       m_instr.inst = inst;
       m_instr.pc = regs.regs_PC;
       m_instr.op = op;
+      m_instr.mem_addr = 0;
+      m_instr.mem_size = 0;
       /* ECE552 END */
 
       /* execute the instruction */
@@ -374,7 +960,15 @@ sim_main(void)
       }
 
       /* ECE552 BEGIN */
-      put_instr(instruction_trace, &m_instr);
+      m_instr.next_pc = regs.regs_NPC;
+
+      if (tom_trace_writer)
+	itrace_write(tom_trace_writer, &m_instr);
+
+      if (tom_stream)
+	tomasulo_put(tom, &m_instr);
+      else if (!tom_trace_writer)
+	put_instr(instruction_trace, &m_instr);
       /* ECE552 END */
 
       if (fault != md_fault_none)
@@ -416,10 +1010,32 @@ sim_main(void)
 
     /* ECE552 BEGIN */
 
-    sim_num_tom_cycles = runTomasulo(instruction_trace);
+    if (tom_trace_writer)
+      {
+	itrace_close(tom_trace_writer);
+	tom_trace_writer = NULL;
+      }
+
+    if (tom_stream)
+      {
+	sim_num_tom_cycles = tomasulo_finish(tom, sim_num_insn);
+	tomasulo_free(tom);
+      }
+    else if (tom_trace_out)
+      {
+	/* time the trace from the file instead of memory */
+	tom_replay(tom_trace_out);
+      }
+    else
+      {
+	sim_num_tom_cycles = runTomasulo(&tom_config, instruction_trace,
+					 sim_num_insn, &tom_stats);
   
-    //print_all_instr(instruction_trace, sim_num_insn);
+	//print_all_instr(instruction_trace, sim_num_insn);
+
+	tom_run_sweep(instruction_trace, NULL);
 
-    free(instruction_trace);
+	free_trace(instruction_trace);
+      }
     /* ECE552 END */
 }
@@ -1,10 +1,11 @@
-
 #include <limits.h>
 #include <assert.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <math.h>
+#include <pthread.h>
 
 #include "host.h"
 #include "misc.h"
@@ -20,19 +21,10 @@
 #include "decode.def"
 
 #include "instr.h"
+#include "itrace.h"
+#include "ptrace.h"
+#include "tomasulo.h"
 
-/* PARAMETERS OF THE TOMASULO'S ALGORITHM */
-/* ECE552 Assignment 3 - BEGIN CODE */
-#define INSTR_QUEUE_SIZE         16
-
-#define RESERV_INT_SIZE    5
-#define RESERV_FP_SIZE     3
-#define FU_INT_SIZE        3
-#define FU_FP_SIZE         1
-
-#define FU_INT_LATENCY     5
-#define FU_FP_LATENCY      7
-/* ECE552 Assignment 3 - END CODE */
 /* IDENTIFYING INSTRUCTIONS */
 
 //unconditional branch, jump or call
@@ -77,73 +69,281 @@
 
 /* VARIABLES */
 
-//instruction queue for tomasulo
-static instruction_t* instr_queue[INSTR_QUEUE_SIZE];
-//number of instructions in the instruction queue
-static int instr_queue_size = 0;
+/* ECE552 Assignment 3 - BEGIN CODE */
+// instructions are woken up by their producers instead of rescanning the
+// reservation stations every cycle: each source operand still waiting on a
+// producer is linked into that producer's consumer list, and the CDB
+// broadcast decrements the consumer's pending count. Instructions with no
+// pending operands wait in an age-ordered heap until a functional unit frees up.
+
+//min-heap of instructions ordered by index (oldest first), or by completion
+//cycle and then index
+typedef struct age_heap
+{
+  instruction_t** entries;
+  int count;
+  bool by_completion;
+} age_heap_t;
+
+// loads and stores also take a load/store queue entry in program order. A
+// store's address is known once it starts executing and its data is written
+// when it completes. A load may only start once every older store has a
+// known address (or, with memory-dependence prediction, once the ones it is
+// predicted to depend on do); it is forwarded from the youngest older
+// in-flight store covering it, and waits for one that partially overlaps it.
+typedef struct lsq_entry
+{
+  int index;              //instruction index
+  md_addr_t pc;
+  md_addr_t addr;
+  int size;
+  bool is_store;
+  bool started;           //store address known / load has read memory
+  bool done;              //the access has completed
+} lsq_entry_t;
+
+//load wait table of the memory-dependence predictor, cleared periodically so
+//loads get another chance to speculate
+#define MDP_TABLE_SIZE   1024
+#define MDP_CLEAR_CYCLES 16384
+
+//reservation stations and functional units of one class (INT or FP)
+typedef struct fu_class
+{
+  int rs_size;            //number of reservation stations
+  int rs_used;            //reservation stations holding an instruction
+  int fu_size;            //number of functional units
+  int fu_used;            //functional units holding an instruction
+  int latency;            //execution latency
+
+  age_heap_t ready;       //issued instructions with all operands available
+
+  // executing instructions in order of completion
+  age_heap_t exec;
+  // ready loads held back by older stores this cycle
+  instruction_t** blocked;
+  int nblocked;
+} fu_class_t;
+
+// all the state of one run, so that several machine geometries can be
+// simulated side by side
+struct tomasulo
+{
+  tom_config_t config;
+
+  //instruction queue for tomasulo (circular buffer)
+  instruction_t** instr_queue;
+  //number of instructions in the instruction queue
+  int instr_queue_size;
+  int ifq_head_idx;
+  int ifq_tail_idx;
+
+  fu_class_t classINT;
+  fu_class_t classFP;
+
+  //completed instructions still holding their functional unit, waiting for a CDB
+  age_heap_t cdb_wait;
+
+  //common data buses, the first cdb_used of them broadcast this cycle
+  instruction_t** commonDataBus;
+  int cdb_used;
+
+  //The map table keeps track of which instruction produces the value for each register
+  instruction_t* map_table[MD_TOTAL_REGS];
+  //number of registers with a producer in the map table
+  int map_table_count;
+
+  //the index of the next instruction to fetch
+  int fetch_index;
+  //the index of the last instruction available to fetch
+  int fetch_limit;
+  //true until tomasulo_finish, fetch may wait on tomasulo_put
+  bool stream_open;
+
+  //the current cycle of the timing model
+  int cycle;
+
+  // instructions are handed over one at a time and kept in a ring buffer of
+  // window entries; a slot is only reused once its previous instruction has
+  // left the machine and nothing points to it anymore
+  int window;
+  instruction_t* ring;
+  bool* live;
+
+  //stall accounting, points to own_stats if the caller has none
+  tom_stats_t* stats;
+  tom_stats_t own_stats;
+  //operands currently waiting on a producer of each class
+  int raw_waiting[TOM_PROD_NUM];
+
+  //load/store queue (circular buffer, entries freed in order)
+  lsq_entry_t* lsq;
+  int lsq_head;
+  int lsq_count;
+  //memory-dependence predictor: loads that must wait for older stores
+  bool mdp_table[MDP_TABLE_SIZE];
+  //dispatch is stopped until this cycle after a memory order violation
+  int squash_until;
+
+  //front end branch predictor, NULL if perfect
+  struct bpred_t* bpred;
+  //mispredicted branch fetch is waiting on, and the cycle fetch resumes
+  instruction_t* redirect;
+  int fetch_resume;
+};
+
+static void ifq_push(tomasulo_t* tom, instruction_t* instr)
+{
+  // insert instr into tail of ifq
+  tom->instr_queue[tom->ifq_tail_idx] = instr;
+  // update new tail index (circular)
+  tom->ifq_tail_idx = (tom->ifq_tail_idx + 1) % tom->config.ifq_size;
+  tom->instr_queue_size++;
+}
+
+static void ifq_pop(tomasulo_t* tom)
+{
+  // update ifq head index
+  tom->ifq_head_idx = (tom->ifq_head_idx + 1) % tom->config.ifq_size;
+  tom->instr_queue_size--;
+}
 
-//reservation stations (each reservation station entry contains a pointer to an instruction)
-static instruction_t* reservINT[RESERV_INT_SIZE];
-static instruction_t* reservFP[RESERV_FP_SIZE];
+static instruction_t* ifq_head(tomasulo_t* tom)
+{
+  if(tom->instr_queue_size != 0) return tom->instr_queue[tom->ifq_head_idx];
+  else return NULL;
+}
 
-//functional units
-static instruction_t* fuINT[FU_INT_SIZE];
-static instruction_t* fuFP[FU_FP_SIZE];
+/* AGE HEAP */
+static bool heap_before(age_heap_t* heap, instruction_t* a, instruction_t* b)
+{
+  if(heap->by_completion && a->tom_complete_cycle != b->tom_complete_cycle)
+  {
+    return a->tom_complete_cycle < b->tom_complete_cycle;
+  }
+  return a->index < b->index;
+}
 
-//common data bus
-static instruction_t* commonDataBus = NULL;
+static void age_heap_push(age_heap_t* heap, instruction_t* instr)
+{
+  int i = heap->count++;
+  while(i > 0)
+  {
+    int parent = (i - 1) / 2;
+    if(heap_before(heap, heap->entries[parent], instr)) break;
+    heap->entries[i] = heap->entries[parent];
+    i = parent;
+  }
+  heap->entries[i] = instr;
+}
 
-//The map table keeps track of which instruction produces the value for each register
-static instruction_t* map_table[MD_TOTAL_REGS];
+static instruction_t* age_heap_pop(age_heap_t* heap)
+{
+  instruction_t* oldest = heap->entries[0];
+  instruction_t* last = heap->entries[--heap->count];
 
-//the index of the last instruction fetched
-static int fetch_index = 0;
+  int i = 0;
+  while(true)
+  {
+    int child = 2 * i + 1;
+    if(child >= heap->count) break;
+    if(child + 1 < heap->count && heap_before(heap, heap->entries[child + 1], heap->entries[child]))
+    {
+      child++;
+    }
+    if(heap_before(heap, last, heap->entries[child])) break;
+    heap->entries[i] = heap->entries[child];
+    i = child;
+  }
+  if(heap->count > 0) heap->entries[i] = last;
 
-/* ECE552 Assignment 3 - BEGIN CODE */
-// use a circular buffer for the ifq entries
-static int ifq_head_idx = 0;
-static int ifq_tail_idx = 0;
+  return oldest;
+}
 
-static void ifq_push(instruction_t* instr)
+/* STALL ACCOUNTING */
+static enum tom_producer_class producer_class_of(instruction_t* producer)
 {
-  // insert instr into tail of ifq
-  instr_queue[ifq_tail_idx] = instr;
-  // update new tail index (circular)
-  ifq_tail_idx = (ifq_tail_idx + 1) % INSTR_QUEUE_SIZE;
-  instr_queue_size++;
+  if(USES_FP_FU(producer->op)) return TOM_PROD_FP;
+  if(IS_LOAD(producer->op)) return TOM_PROD_LOAD;
+  return TOM_PROD_INT;
 }
 
-static void ifq_pop()
+// charges the rest of this cycle's dispatch slots to the cause counter
+static void dispatch_lost(tomasulo_t* tom, counter_t* cause, int used)
 {
-  // update ifq head index
-  ifq_head_idx = (ifq_head_idx + 1) % INSTR_QUEUE_SIZE;
-  instr_queue_size--;
+  tom_stats_t* stats = tom->stats;
+
+  stats->disp_used += used;
+  if(stats->dispatch_dist != NULL) stat_add_sample(stats->dispatch_dist, used);
+
+  if(cause != NULL) *cause += tom->config.fetch_width - used;
 }
 
-static instruction_t* ifq_head()
+/* BRANCH PREDICTION */
+// fetch has stopped behind a mispredicted branch
+static bool fetch_redirecting(tomasulo_t* tom, int current_cycle)
 {
-  if(instr_queue_size != 0) return instr_queue[ifq_head_idx];
-  else return NULL;
+  return tom->redirect != NULL || current_cycle <= tom->fetch_resume;
 }
 
-static instruction_t* ifq_tail()
+// predicts a fetched control instruction; the trace only holds the correct
+// path, so fetch stops behind a misprediction until the branch resolves
+static void predict_branch(tomasulo_t* tom, instruction_t* instr)
 {
-  if(instr_queue_size != 0) 
+  tom->stats->branches++;
+  if(tom->bpred == NULL) return;
+
+  md_inst_t inst = instr->inst;
+  md_addr_t fall_through = instr->pc + sizeof(md_inst_t);
+  md_addr_t target = 0;
+  struct bpred_update_t update;
+  int stack_recover_idx;
+
+  // the target of a direct branch is decoded from the instruction, an
+  // indirect jump's is only known once its register is read
+  if((MD_OP_FLAGS(instr->op) & (F_DIRJMP|F_UNCOND)) == (F_DIRJMP|F_UNCOND))
+    target = (instr->pc & 036000000000) | (TARG << 2);
+  else if(MD_OP_FLAGS(instr->op) & F_DIRJMP)
+    target = fall_through + (OFS << 2);
+
+  md_addr_t pred_pc = bpred_lookup(tom->bpred, instr->pc, target, instr->op,
+                                   MD_IS_CALL(instr->op), MD_IS_RETURN(instr->op),
+                                   &update, &stack_recover_idx);
+  if(!pred_pc) pred_pc = fall_through;
+
+  // no wrong path is ever fetched, so the predictor is trained right away
+  bpred_update(tom->bpred, instr->pc, instr->next_pc,
+               /* taken? */instr->next_pc != fall_through,
+               /* pred taken? */pred_pc != fall_through,
+               /* correct pred? */pred_pc == instr->next_pc,
+               instr->op, &update);
+
+  if(pred_pc != instr->next_pc)
   {
-    return instr_queue[(ifq_tail_idx + INSTR_QUEUE_SIZE - 1) % INSTR_QUEUE_SIZE];
+    tom->stats->branch_mispred++;
+    tom->redirect = instr;
   }
-  else return NULL;
 }
 
 /* MAP TABLE */
-static void update_q_from_map_table(instruction_t *instr)
+static void update_q_from_map_table(tomasulo_t* tom, instruction_t *instr)
 {
+  instr->tom_pending = 0;
+  instr->consumers = NULL;
+
   for(int i = 0; i < 3; i++)
   {
     int reg = instr->r_in[i];
-    if(reg != DNA && reg < MD_TOTAL_REGS && map_table[reg] != NULL)
+    if(reg != DNA && reg < MD_TOTAL_REGS && tom->map_table[reg] != NULL)
     {
-      instr->Q[i] = map_table[reg];
+      // wait on the producer until it broadcasts on the CDB
+      instruction_t* producer = tom->map_table[reg];
+      instr->Q[i] = producer;
+      instr->wait[i].instr = instr;
+      instr->wait[i].next = producer->consumers;
+      producer->consumers = &instr->wait[i];
+      instr->tom_pending++;
+      tom->raw_waiting[producer_class_of(producer)]++;
     }
     else
     {
@@ -152,107 +352,238 @@ static void update_q_from_map_table(instruction_t *instr)
   }
 }
 
-static void update_map_table(instruction_t *instr)
+static void update_map_table(tomasulo_t* tom, instruction_t *instr)
 {
   for(int i = 0; i < 2; i++)
   {
     int reg = instr->r_out[i];
     if(reg != DNA && reg < MD_TOTAL_REGS)
     {
-      map_table[reg] = instr;
+      if(tom->map_table[reg] == NULL) tom->map_table_count++;
+      tom->map_table[reg] = instr;
     }
   }
 }
 
 /* RESERVATION STATIONS */
-static bool reservINT_insert(instruction_t* instr)
+static fu_class_t* fu_class_of(tomasulo_t* tom, instruction_t* instr)
+{
+  return USES_FP_FU(instr->op) ? &tom->classFP : &tom->classINT;
+}
+
+static bool reserv_insert(tomasulo_t* tom, fu_class_t* fu_class, instruction_t* instr)
 {
   // is a station available
-  for(int i = 0; i < RESERV_INT_SIZE; i++)
+  if(fu_class->rs_used == fu_class->rs_size) return false;
+
+  update_q_from_map_table(tom, instr);
+  update_map_table(tom, instr);
+  fu_class->rs_used++;
+
+  if(instr->tom_pending == 0)
   {
-    if(reservINT[i] == NULL)
-    {
-      update_q_from_map_table(instr);
-      update_map_table(instr);
-      reservINT[i] = instr;
-      return true;
-    }
+    age_heap_push(&fu_class->ready, instr);
   }
 
-  return false;
+  return true;
 }
 
-static bool reservFP_insert(instruction_t* instr)
+/* LOAD/STORE QUEUE */
+static bool uses_lsq(tomasulo_t* tom, instruction_t* instr)
 {
-  // is a station available
-  for(int i = 0; i < RESERV_FP_SIZE; i++)
+  return tom->config.lsq_size > 0 && (IS_LOAD(instr->op) || IS_STORE(instr->op));
+}
+
+static void lsq_insert(tomasulo_t* tom, instruction_t* instr)
+{
+  int slot = (tom->lsq_head + tom->lsq_count) % tom->config.lsq_size;
+  lsq_entry_t* entry = &tom->lsq[slot];
+
+  entry->index = instr->index;
+  entry->pc = instr->pc;
+  entry->addr = instr->mem_addr;
+  entry->size = instr->mem_size;
+  entry->is_store = IS_STORE(instr->op);
+  entry->started = false;
+  entry->done = false;
+
+  instr->tom_lsq_slot = slot;
+  tom->lsq_count++;
+}
+
+// the access has completed, entries leave the queue in program order
+static void lsq_complete(tomasulo_t* tom, instruction_t* instr)
+{
+  tom->lsq[instr->tom_lsq_slot].done = true;
+
+  while(tom->lsq_count > 0 && tom->lsq[tom->lsq_head].done)
+  {
+    tom->lsq_head = (tom->lsq_head + 1) % tom->config.lsq_size;
+    tom->lsq_count--;
+  }
+}
+
+// number of entries older than the one in slot
+static int lsq_age(tomasulo_t* tom, int slot)
+{
+  return (slot - tom->lsq_head + tom->config.lsq_size) % tom->config.lsq_size;
+}
+
+static bool lsq_overlap(lsq_entry_t* a, lsq_entry_t* b)
+{
+  return a->addr < b->addr + b->size && b->addr < a->addr + a->size;
+}
+
+static bool lsq_covers(lsq_entry_t* store, lsq_entry_t* load)
+{
+  return store->addr <= load->addr && load->addr + load->size <= store->addr + store->size;
+}
+
+static bool* mdp_entry(tomasulo_t* tom, md_addr_t pc)
+{
+  return &tom->mdp_table[(pc / sizeof(md_inst_t)) % MDP_TABLE_SIZE];
+}
+
+// latency of a load whose operands are ready, or -1 if older stores hold it
+// back this cycle
+static int lsq_load_latency(tomasulo_t* tom, instruction_t* instr, int latency)
+{
+  int size = tom->config.lsq_size;
+  lsq_entry_t* load = &tom->lsq[instr->tom_lsq_slot];
+
+  // from the youngest older store to the oldest
+  int slot = instr->tom_lsq_slot;
+  for(int older = lsq_age(tom, slot); older > 0; older--)
   {
-    if(reservFP[i] == NULL)
+    slot = (slot + size - 1) % size;
+    lsq_entry_t* store = &tom->lsq[slot];
+    if(!store->is_store || store->done) continue;
+
+    if(!store->started)
     {
-      update_q_from_map_table(instr);
-      update_map_table(instr);
-      reservFP[i] = instr;
-      return true;
+      // unknown address, only go ahead if predicted independent
+      if(!tom->config.mdp || *mdp_entry(tom, load->pc)) return -1;
+      continue;
+    }
+
+    if(lsq_overlap(store, load))
+    {
+      if(!lsq_covers(store, load)) return -1;
+
+      tom->stats->lsq_forwards++;
+      return tom->config.fwd_latency;
     }
   }
 
-  return false;
+  return latency;
 }
 
-static bool is_execute_complete(instruction_t* instr, int current_cycle) {
-  if (IS_ICOMP(instr->op) || IS_LOAD(instr->op) || IS_STORE(instr->op)) {
-    return (current_cycle - instr->tom_execute_cycle) >= FU_INT_LATENCY;
-  } else if (IS_FCOMP(instr->op)) {
-    return (current_cycle - instr->tom_execute_cycle) >= FU_FP_LATENCY;
+// the store's address is now known; younger loads that already read an
+// overlapping address, and did not get it from a store in between, read a
+// stale value
+static void lsq_store_resolved(tomasulo_t* tom, instruction_t* instr, int current_cycle)
+{
+  int size = tom->config.lsq_size;
+  lsq_entry_t* store = &tom->lsq[instr->tom_lsq_slot];
+  store->started = true;
+
+  bool violated = false;
+  int slot = instr->tom_lsq_slot;
+  for(int younger = tom->lsq_count - 1 - lsq_age(tom, slot); younger > 0; younger--)
+  {
+    slot = (slot + 1) % size;
+    lsq_entry_t* load = &tom->lsq[slot];
+    if(load->is_store || !load->started || !lsq_overlap(store, load)) continue;
+
+    bool shadowed = false;
+    for(int s = (instr->tom_lsq_slot + 1) % size; s != slot && !shadowed; s = (s + 1) % size)
+    {
+      lsq_entry_t* between = &tom->lsq[s];
+      shadowed = between->is_store && between->started && lsq_overlap(between, load);
+    }
+    if(shadowed) continue;
+
+    // the load must wait for older stores from now on
+    *mdp_entry(tom, load->pc) = true;
+    violated = true;
   }
-  else
+
+  if(violated)
   {
-    printf("Received instruction that does not execute INT or FP");
-    return false;
+    // the load and everything after it are replayed
+    tom->stats->mem_violations++;
+    if(tom->squash_until < current_cycle + tom->config.mdp_penalty)
+    {
+      tom->squash_until = current_cycle + tom->config.mdp_penalty;
+    }
   }
 }
 
-static void clear_map_table_entry(instruction_t* instr)
+static void clear_map_table_entry(tomasulo_t* tom, instruction_t* instr)
 {
   // clear map table entry
   for(int i = 0; i < 2; i++)
   {
     int reg = instr->r_out[i];
-    if(reg != DNA && reg < MD_TOTAL_REGS && (map_table[reg] == instr))
+    if(reg != DNA && reg < MD_TOTAL_REGS && (tom->map_table[reg] == instr))
     {
-      map_table[reg] = NULL;
+      tom->map_table[reg] = NULL;
+      tom->map_table_count--;
     }
   }
 }
 
-static void free_rs_and_fu(instruction_t* instr)
+// pipetrace stages, pipeview.pl only knows the sim-outorder ones: the IFQ
+// (dispatch) shows as IF, the reservation stations (issue) as DA, and the
+// CDB as WB
+#define TOM_PST_DISPATCH  PST_IFETCH
+#define TOM_PST_ISSUE     PST_DISPATCH
+#define TOM_PST_EXECUTE   PST_EXECUTE
+#define TOM_PST_CDB       PST_WRITEBACK
+
+// records the instruction entering a stage in the pipetrace
+static void trace_stage(tomasulo_t* tom, instruction_t* instr, char* stage)
 {
-  if (USES_INT_FU(instr->op)) {
-    for (int i = 0; i < RESERV_INT_SIZE; i++) {
-      if (reservINT[i] == instr) {
-        reservINT[i] = NULL;
-      }
-    }
-    for (int i = 0; i < FU_INT_SIZE; i++) {
-      if (fuINT[i] == instr) {
-        fuINT[i] = NULL;
-      }
-    }
+  if(tom->config.ptrace)
+  {
+    ptrace_newstage(instr->index, stage, 0);
   }
+}
 
-  
-  if (USES_FP_FU(instr->op)) {
-    for (int i = 0; i < RESERV_FP_SIZE; i++) {
-      if (reservFP[i] == instr) {
-        reservFP[i] = NULL;
-      }
-    }
-    for (int i = 0; i < FU_FP_SIZE; i++) {
-      if (fuFP[i] == instr) {
-        fuFP[i] = NULL;
-      }
+// the instruction has left the machine, its ring slot can be reused
+static void release_instr(tomasulo_t* tom, instruction_t* instr)
+{
+  tom->live[instr->index & (tom->window - 1)] = false;
+
+  if(tom->config.ptrace)
+  {
+    ptrace_endinst(instr->index);
+  }
+}
+
+// the value is on the CDB: wake up the consumers, the ones left without
+// pending operands become ready to execute
+static void wakeup_consumers(tomasulo_t* tom, instruction_t* instr)
+{
+  int woken = 0;
+  for(tom_waiter_t* w = instr->consumers; w != NULL; w = w->next, woken++)
+  {
+    instruction_t* consumer = w->instr;
+    consumer->Q[w - consumer->wait] = NULL;
+    if(--consumer->tom_pending == 0)
+    {
+      age_heap_push(&fu_class_of(tom, consumer)->ready, consumer);
     }
   }
+  instr->consumers = NULL;
+  tom->raw_waiting[producer_class_of(instr)] -= woken;
+}
+
+static void free_rs_and_fu(tomasulo_t* tom, instruction_t* instr)
+{
+  fu_class_t* fu_class = fu_class_of(tom, instr);
+  fu_class->rs_used--;
+  fu_class->fu_used--;
 }
 /* ECE552 Assignment 3 - END CODE */
 
@@ -261,57 +592,27 @@ static void free_rs_and_fu(instruction_t* instr)
  * 	Checks if simulation is done by finishing the very last instruction
  *      Remember that simulation is done only if the entire pipeline is empty
  * Inputs:
+ *      tom: the timing model
  * 	sim_insn: the total number of instructions simulated
  * Returns:
  * 	True: if simulation is finished
  */
-static bool is_simulation_done(counter_t sim_insn) {
+static bool is_simulation_done(tomasulo_t* tom, counter_t sim_insn) {
   /* ECE552 Assignment 3 - BEGIN CODE */
 
   // If # of fetched instructions = total # instruction:
-  if(fetch_index < sim_insn) return false;
+  if(tom->fetch_index < sim_insn) return false;
   
   // all pipelines empty
-  if(instr_queue_size != 0) return false;
-
-  for(int i = 0; i < RESERV_INT_SIZE; i++)
-  {
-    if(reservINT[i] != NULL)
-    {
-      return false;
-    }
-  }
-
-  for(int i = 0; i < RESERV_FP_SIZE; i++)
-  {
-    if(reservFP[i] != NULL)
-    {
-      return false;
-    }
-  }
+  if(tom->instr_queue_size != 0) return false;
 
-  for(int i = 0; i < FU_INT_SIZE; i++)
-  {
-    if(fuINT[i] != NULL)
-    {
-      return false;
-    }
-  }
+  if(tom->classINT.rs_used != 0 || tom->classFP.rs_used != 0) return false;
 
-  for(int i = 0; i < FU_FP_SIZE; i++)
-  {
-    if(fuFP[i] != NULL)
-    {
-      return false;
-    }
-  }
+  if(tom->classINT.fu_used != 0 || tom->classFP.fu_used != 0) return false;
 
-  if(commonDataBus != NULL) return false;
+  if(tom->cdb_used != 0) return false;
 
-  for(int i = 0; i < MD_TOTAL_REGS; i++)
-  {
-    if(map_table[i] != NULL) return false;
-  }
+  if(tom->map_table_count != 0) return false;
 
   return true;
   /* ECE552 Assignment 3 - END CODE */
@@ -319,87 +620,138 @@ static bool is_simulation_done(counter_t sim_insn) {
 
 /* 
  * Description: 
- * 	Retires the instruction from writing to the Common Data Bus
+ * 	Retires the instructions from writing to the Common Data Buses
  * Inputs:
+ *      tom: the timing model
  * 	current_cycle: the cycle we are at
  * Returns:
  * 	None
  */
-void CDB_To_retire(int current_cycle) {
+static void CDB_To_retire(tomasulo_t* tom, int current_cycle) {
 
   /* ECE552 Assignment 3 - BEGIN CODE */
-  if(commonDataBus != NULL)
+  for(int i = 0; i < tom->cdb_used; i++)
   {
-    clear_map_table_entry(commonDataBus);
-    commonDataBus = NULL;
+    instruction_t* instr = tom->commonDataBus[i];
+    clear_map_table_entry(tom, instr);
+    wakeup_consumers(tom, instr);
+    release_instr(tom, instr);
   }
+  tom->cdb_used = 0;
   /* ECE552 Assignment 3 - END CODE */
 
 }
 
+/* ECE552 Assignment 3 - BEGIN CODE */
+// moves the instructions that finished executing out of the execute heap
+static void complete_execute(tomasulo_t* tom, fu_class_t* fu_class, int current_cycle)
+{
+  while(fu_class->exec.count > 0)
+  {
+    instruction_t* instr = fu_class->exec.entries[0];
+    if(instr->tom_complete_cycle > current_cycle) break;
+
+    age_heap_pop(&fu_class->exec);
+    if(uses_lsq(tom, instr))
+    {
+      lsq_complete(tom, instr);
+    }
+
+    if(WRITES_CDB(instr->op))
+    {
+      // keeps the functional unit until it gets the CDB
+      age_heap_push(&tom->cdb_wait, instr);
+    }
+    else
+    {
+      free_rs_and_fu(tom, instr);
+      release_instr(tom, instr);
+    }
+  }
+}
+/* ECE552 Assignment 3 - END CODE */
 
 /* 
  * Description: 
- * 	Moves an instruction from the execution stage to common data bus (if possible)
+ * 	Moves instruction(s) from the execution stage to the common data buses (if possible)
  * Inputs:
+ *      tom: the timing model
  * 	current_cycle: the cycle we are at
  * Returns:
  * 	None
  */
-void execute_To_CDB(int current_cycle) {
+static void execute_To_CDB(tomasulo_t* tom, int current_cycle) {
 
   /* ECE552 Assignment 3 - BEGIN CODE */
   // An instruction broadcasts its results via the
   // Common Data Bus (enters the CDB stage) the cycle after it completes execution
-  // only oldest completed instruction can broadcast to cdb
-  instruction_t *oldest_completed_instr = NULL;
-  for (int i = 0; i < FU_INT_SIZE; i++) {
-    instruction_t* instr = fuINT[i];
-    if (instr == NULL || !is_execute_complete(instr, current_cycle)) {
-      continue;
-    }
+  // only the oldest completed instructions (one per bus) can broadcast
+  complete_execute(tom, &tom->classINT, current_cycle);
+  complete_execute(tom, &tom->classFP, current_cycle);
 
-    if(WRITES_CDB(instr->op))
-    {
-      if(oldest_completed_instr == NULL || oldest_completed_instr->index > instr->index)
-      {
-        oldest_completed_instr = instr;
-      }
-    }
-    else
-    {
-      free_rs_and_fu(instr);
-    }
+  while(tom->cdb_used < tom->config.cdb_size && tom->cdb_wait.count > 0)
+  {
+    instruction_t* oldest_completed_instr = age_heap_pop(&tom->cdb_wait);
+    oldest_completed_instr->tom_cdb_cycle = current_cycle;
+    trace_stage(tom, oldest_completed_instr, TOM_PST_CDB);
+    tom->commonDataBus[tom->cdb_used++] = oldest_completed_instr;
+    free_rs_and_fu(tom, oldest_completed_instr);
   }
 
-  for (int i = 0; i < FU_FP_SIZE; i++) {
-    instruction_t* instr = fuFP[i];
-    if (instr == NULL || !is_execute_complete(instr, current_cycle)) {
-      continue;
-    }
+  // the rest hold their functional unit for another cycle
+  tom->stats->cdb_wait += tom->cdb_wait.count;
+  /* ECE552 Assignment 3 - END CODE */
 
-    if(WRITES_CDB(instr->op))
+}
+
+/* ECE552 Assignment 3 - BEGIN CODE */
+// starts the oldest ready instructions on the free functional units,
+// returns how many were started
+static int issue_class(tomasulo_t* tom, fu_class_t* fu_class, int current_cycle)
+{
+  // loads held back by older stores last cycle try again
+  for(int i = 0; i < fu_class->nblocked; i++)
+  {
+    age_heap_push(&fu_class->ready, fu_class->blocked[i]);
+  }
+  fu_class->nblocked = 0;
+
+  int issued = 0;
+  while(fu_class->fu_used < fu_class->fu_size && fu_class->ready.count > 0)
+  {
+    instruction_t* instr = age_heap_pop(&fu_class->ready);
+    int latency = fu_class->latency;
+
+    if(uses_lsq(tom, instr))
     {
-      if(oldest_completed_instr == NULL || oldest_completed_instr->index > instr->index)
+      if(IS_LOAD(instr->op))
       {
-        oldest_completed_instr = instr;
+        latency = lsq_load_latency(tom, instr, latency);
+        if(latency < 0)
+        {
+          tom->stats->lsq_wait++;
+          fu_class->blocked[fu_class->nblocked++] = instr;
+          continue;
+        }
+        tom->lsq[instr->tom_lsq_slot].started = true;
+      }
+      else
+      {
+        lsq_store_resolved(tom, instr, current_cycle);
       }
     }
-    else
-    {
-      free_rs_and_fu(instr);
-    }
-  }
 
-  if(commonDataBus == NULL && oldest_completed_instr != NULL)
-  {
-    oldest_completed_instr->tom_cdb_cycle = current_cycle;
-    commonDataBus = oldest_completed_instr;
-    free_rs_and_fu(oldest_completed_instr);
-  }
-  /* ECE552 Assignment 3 - END CODE */
+    instr->tom_execute_cycle = current_cycle;
+    instr->tom_complete_cycle = current_cycle + latency;
+    trace_stage(tom, instr, TOM_PST_EXECUTE);
+    fu_class->fu_used++;
 
+    age_heap_push(&fu_class->exec, instr);
+    issued++;
+  }
+  return issued;
 }
+/* ECE552 Assignment 3 - END CODE */
 
 /* 
  * Description: 
@@ -407,93 +759,29 @@ void execute_To_CDB(int current_cycle) {
  *      (in program order) over new ones, if they both contend for the same functional unit.
  *      All RAW dependences need to have been resolved with stalls before an instruction enters execute.
  * Inputs:
+ *      tom: the timing model
  * 	current_cycle: the cycle we are at
  * Returns:
  * 	None
  */
-void issue_To_execute(int current_cycle) {
+static void issue_To_execute(tomasulo_t* tom, int current_cycle) {
 
   /* ECE552 Assignment 3 - BEGIN CODE */
-
-  // INT Instructions:
-  for (int i = 0; i < FU_INT_SIZE; i++) {
-
-    // function unit is busy
-    if (fuINT[i] != NULL) {
-      continue;
-    }
-    // Need to prioritize the oldest instruction (based on index):
-    instruction_t* oldestInstr = NULL;
-    for (int j = 0; j < RESERV_INT_SIZE; j++) {
-      instruction_t* instr = reservINT[j];
-
-      // RS has an entry, it has been issued, and has not already been executed
-      if (instr == NULL || instr->tom_issue_cycle == 0 || instr->tom_execute_cycle != 0) {
-        continue;
-      }
-      // An instruction spends at least 1 cycle in this stage:
-      if (instr->tom_issue_cycle == current_cycle) {
-        continue;
-      }
-
-      // Check RAW hazards:
-      bool hasRAWHazard = false;
-      for (int k = 0; k < 3; k++) {
-        if (instr->Q[k] != NULL && (instr->Q[k]->tom_cdb_cycle == 0 || instr->Q[k]->tom_cdb_cycle >= current_cycle)) {
-              hasRAWHazard = true;
-        }
-      }
-
-      if (!hasRAWHazard) {
-        if (oldestInstr == NULL || oldestInstr->index > instr->index) {
-          oldestInstr = instr;
-        }
-      }
-    }
-
-    if (oldestInstr != NULL) {
-      oldestInstr->tom_execute_cycle = current_cycle;
-      fuINT[i] = oldestInstr;
-    }
-  }
-
-  // FP Instructions:
-  for (int i = 0; i < FU_FP_SIZE; i++) {
-    if (fuFP[i] != NULL) {
-      continue;
-    }
-    instruction_t* oldestInstr = NULL;
-    for (int j = 0; j < RESERV_FP_SIZE; j++) {
-      instruction_t* instr = reservFP[j];
-
-      if (instr == NULL || instr->tom_issue_cycle == 0 || instr->tom_execute_cycle != 0) {
-        continue;
-      }
-      // An instruction spends at least 1 cycle in this stage:
-      if (instr->tom_issue_cycle == current_cycle) {
-        continue;
-      }
-
-      // Check RAW hazards:
-      bool hasRAWHazard = false;
-      for (int k = 0; k < 3; k++) {
-        if (instr->Q[k] != NULL && (instr->Q[k]->tom_cdb_cycle == 0 || instr->Q[k]->tom_cdb_cycle >= current_cycle)) {
-              hasRAWHazard = true;
-        }
-      }
-
-      if (!hasRAWHazard) {
-        if (oldestInstr == NULL || oldestInstr->index > instr->index) {
-          oldestInstr = instr;
-        }
-      }
-    }
-
-    if (oldestInstr != NULL) {
-      oldestInstr->tom_execute_cycle = current_cycle;
-      fuFP[i] = oldestInstr;
-    }
+  // the ready heaps only hold instructions issued in an earlier cycle whose
+  // producers have all broadcast, so RAW hazards are already resolved here
+  int issued = issue_class(tom, &tom->classINT, current_cycle)
+               + issue_class(tom, &tom->classFP, current_cycle);
+
+  // whatever is still ready found every functional unit busy, and whatever
+  // waits on operands is charged to the class of its producers
+  tom_stats_t* stats = tom->stats;
+  stats->fu_busy_int += tom->classINT.ready.count;
+  stats->fu_busy_fp += tom->classFP.ready.count;
+  for(int i = 0; i < TOM_PROD_NUM; i++)
+  {
+    stats->raw_wait[i] += tom->raw_waiting[i];
   }
+  if(stats->issue_dist != NULL) stat_add_sample(stats->issue_dist, issued);
   /* ECE552 Assignment 3 - END CODE */
 }
 
@@ -501,179 +789,589 @@ void issue_To_execute(int current_cycle) {
  * Description: 
  * 	Moves instruction(s) from the dispatch stage to the issue stage
  * Inputs:
+ *      tom: the timing model
  * 	current_cycle: the cycle we are at
  * Returns:
  * 	None
  */
-void dispatch_To_issue(int current_cycle) {
+static void dispatch_To_issue(tomasulo_t* tom, int current_cycle) {
   /* ECE552 Assignment 3 - BEGIN CODE */
-  instruction_t* instr = ifq_head();
-  if(instr == NULL) return;
+  // dispatch in program order, up to fetch_width instructions per cycle;
+  // once the oldest cannot be dispatched all younger instructions stall
+  tom_stats_t* stats = tom->stats;
+  counter_t* cause = NULL;
 
-  // control instructions do not use subsequent stages
-  if(IS_COND_CTRL(instr->op) || IS_UNCOND_CTRL(instr->op))
+  // instructions after a memory order violation are being replayed
+  if(current_cycle < tom->squash_until)
   {
-    // remove instr from dispatch queue
-    ifq_pop();
+    dispatch_lost(tom, &stats->disp_mem_squash, 0);
     return;
   }
 
-  // dispatch instruction if reservation station is available
-  if(USES_INT_FU(instr->op))
+  int slot;
+  for(slot = 0; slot < tom->config.fetch_width; slot++)
   {
-    if(reservINT_insert(instr))
+    instruction_t* instr = ifq_head(tom);
+    if(instr == NULL)
     {
-      instr->tom_issue_cycle = current_cycle;
-      ifq_pop();
+      cause = fetch_redirecting(tom, current_cycle) ? &stats->disp_branch : &stats->disp_ifq_empty;
+      break;
     }
-  }
-  else if(USES_FP_FU(instr->op))
-  {
-    if(reservFP_insert(instr))
+
+    // control instructions do not use subsequent stages
+    if(IS_COND_CTRL(instr->op) || IS_UNCOND_CTRL(instr->op))
     {
+      // a mispredicted branch resolves here, fetch restarts on the right path
+      if(instr == tom->redirect)
+      {
+        tom->redirect = NULL;
+        tom->fetch_resume = current_cycle + tom->config.branch_penalty;
+      }
+
+      // remove instr from dispatch queue
+      ifq_pop(tom);
+      release_instr(tom, instr);
+      continue;
+    }
+
+    // dispatch instruction if reservation station is available
+    if(USES_INT_FU(instr->op) || USES_FP_FU(instr->op))
+    {
+      // loads and stores also need a load/store queue entry
+      if(uses_lsq(tom, instr) && tom->lsq_count == tom->config.lsq_size)
+      {
+        cause = &stats->disp_lsq_full;
+        break;
+      }
+      if(!reserv_insert(tom, fu_class_of(tom, instr), instr))
+      {
+        cause = USES_FP_FU(instr->op) ? &stats->disp_rs_full_fp : &stats->disp_rs_full_int;
+        break;
+      }
+      if(uses_lsq(tom, instr))
+      {
+        lsq_insert(tom, instr);
+      }
       instr->tom_issue_cycle = current_cycle;
-      ifq_pop();
+      trace_stage(tom, instr, TOM_PST_ISSUE);
+      ifq_pop(tom);
+    }
+    else
+    {
+      printf("This instruction is none of the above, removing from ifq\n");
+      ifq_pop(tom);
+      release_instr(tom, instr);
     }
   }
-  else
-  {
-    printf("This instruction is none of the above, removing from ifq\n");
-    ifq_pop();
-  }
+
+  dispatch_lost(tom, cause, slot);
   /* ECE552 Assignment 3 - END CODE */
 }
 
 /* 
  * Description: 
- * 	Grabs an instruction from the instruction trace (if possible)
+ * 	Grabs an instruction from the instruction window (if possible)
  * Inputs:
- *      trace: instruction trace with all the instructions executed
+ *      tom: the timing model
  * Returns:
- * 	None
+ * 	The fetched instruction, NULL if none
  */
-void fetch(instruction_trace_t* trace) {
+static instruction_t* fetch(tomasulo_t* tom) {
 
   /* ECE552 Assignment 3 - BEGIN CODE */
+  // nothing is fetched behind a mispredicted branch
+  if (tom->redirect != NULL || tom->cycle < tom->fetch_resume) return NULL;
+
   // Only fetch if there is room in the queue:
-  if (instr_queue_size < INSTR_QUEUE_SIZE) { 
+  if (tom->instr_queue_size < tom->config.ifq_size) { 
     instruction_t* next_instr = NULL;
 
+    // the next instruction has not been handed over yet
+    if(tom->stream_open && tom->fetch_index > tom->fetch_limit)
+    {
+      tom->stats->window_stalls++;
+      return NULL;
+    }
+
     // Fetch next instr and skip all TRAP instructions:
-    while(fetch_index <= sim_num_insn)
+    while(tom->fetch_index <= tom->fetch_limit)
     {
-      next_instr = get_instr(trace, fetch_index);
-      fetch_index++;
+      next_instr = &tom->ring[tom->fetch_index & (tom->window - 1)];
+      tom->fetch_index++;
       // "the first instruction of your trace should be skipped"
-      if(next_instr != NULL && !IS_TRAP(next_instr->op) && next_instr->index > 0)
+      if(!IS_TRAP(next_instr->op) && next_instr->index > 0)
       {
         // set all initial cycle paramaters
         next_instr->tom_dispatch_cycle = 0;
         next_instr->tom_issue_cycle = 0;
         next_instr->tom_execute_cycle = 0;
         next_instr->tom_cdb_cycle = 0;
-        ifq_push(next_instr);
-        return;
+        tom->live[next_instr->index & (tom->window - 1)] = true;
+        ifq_push(tom, next_instr);
+        if(IS_COND_CTRL(next_instr->op) || IS_UNCOND_CTRL(next_instr->op))
+        {
+          predict_branch(tom, next_instr);
+        }
+        return next_instr;
       }
     }
   }
+
+  return NULL;
   /* ECE552 Assignment 3 - END CODE */
 }
 
 /* 
  * Description: 
- * 	Calls fetch and dispatches an instruction at the same cycle (if possible)
+ * 	Calls fetch and dispatches up to fetch_width instructions at the same cycle (if possible)
  * Inputs:
- *      trace: instruction trace with all the instructions executed
+ *      tom: the timing model
  * 	current_cycle: the cycle we are at
  * Returns:
  * 	None
  */
-void fetch_To_dispatch(instruction_trace_t* trace, int current_cycle) {
+static void fetch_To_dispatch(tomasulo_t* tom, int current_cycle) {
 
   /* ECE552 Assignment 3 - BEGIN CODE */
-  // fetch next instruction and place into IFQ
-  fetch(trace);
+  // fetch next instructions and place into IFQ, a fetched instruction
+  // enters dispatch in the same cycle
+  for(int slot = 0; slot < tom->config.fetch_width; slot++)
+  {
+    instruction_t* instr = fetch(tom);
+    if(instr == NULL)
+    {
+      return;
+    }
 
-  // A fetched instruction can be dispatched in the same cycle,
-  // check if the oldest instruction can be dispatched
-  // if not, all younger instructions must stall
-  if(instr_queue_size == 0)
+    instr->tom_dispatch_cycle = current_cycle;
+
+    if(tom->config.ptrace)
+    {
+      ptrace_newinst(instr->index, instr->inst, instr->pc, 0);
+    }
+    trace_stage(tom, instr, TOM_PST_DISPATCH);
+  }
+
+  return;
+
+  /* ECE552 Assignment 3 - END CODE */
+}
+
+/* ECE552 Assignment 3 - BEGIN CODE */
+// simulates a single cycle of the pipeline
+static void tomasulo_cycle(tomasulo_t* tom)
+{
+  if(tom->config.ptrace)
   {
-    return;
+    // the range is checked against the next instruction to fetch
+    md_addr_t pc = 0;
+    if(tom->fetch_index <= tom->fetch_limit)
+    {
+      pc = tom->ring[tom->fetch_index & (tom->window - 1)].pc;
+    }
+    ptrace_check_active(pc, tom->fetch_index - 1, tom->cycle);
+    ptrace_newcycle(tom->cycle);
+  }
+
+  // loads predicted dependent get another chance to speculate
+  if(tom->config.mdp && tom->cycle % MDP_CLEAR_CYCLES == 0)
+  {
+    memset(tom->mdp_table, 0, sizeof(tom->mdp_table));
   }
 
-  // instr that was just fetched
-  instruction_t* instr = ifq_tail();
+  // do not chain stages within one cycle
+  CDB_To_retire(tom, tom->cycle);
+  execute_To_CDB(tom, tom->cycle);
+  issue_To_execute(tom, tom->cycle);
+  dispatch_To_issue(tom, tom->cycle);
+  fetch_To_dispatch(tom, tom->cycle);
 
-  if(instr->tom_dispatch_cycle == 0)
+  tom->cycle++;
+}
+
+/* CONFIGURATION */
+void tom_config_default(tom_config_t* config)
+{
+  config->ifq_size = INSTR_QUEUE_SIZE;
+  config->rs_int_size = RESERV_INT_SIZE;
+  config->rs_fp_size = RESERV_FP_SIZE;
+  config->fu_int_size = FU_INT_SIZE;
+  config->fu_fp_size = FU_FP_SIZE;
+  config->fu_int_latency = FU_INT_LATENCY;
+  config->fu_fp_latency = FU_FP_LATENCY;
+  config->fetch_width = FETCH_WIDTH;
+  config->cdb_size = CDB_SIZE;
+  config->window = 0;
+  config->lsq_size = LSQ_SIZE;
+  config->fwd_latency = LSQ_FWD_LATENCY;
+  config->mdp = false;
+  config->mdp_penalty = MDP_PENALTY;
+  memset(&config->bpred, 0, sizeof(config->bpred));
+  config->bpred.perfect = true;
+  config->branch_penalty = BRANCH_PENALTY;
+  config->ptrace = false;
+}
+
+bool tom_config_parse(tom_config_t* config, char* str)
+{
+  char extra;
+  config->fetch_width = FETCH_WIDTH;
+  config->cdb_size = CDB_SIZE;
+  int n = sscanf(str, "%d:%d:%d:%d:%d:%d:%d:%d:%d%c",
+                 &config->ifq_size, &config->rs_int_size, &config->rs_fp_size,
+                 &config->fu_int_size, &config->fu_fp_size,
+                 &config->fu_int_latency, &config->fu_fp_latency,
+                 &config->fetch_width, &config->cdb_size, &extra);
+  return n == 7 || n == 9;
+}
+
+void tom_config_check(tom_config_t* config)
+{
+  if(config->ifq_size < 1)
+    fatal("tomasulo IFQ size must be positive");
+  if(config->rs_int_size < 1 || config->rs_fp_size < 1)
+    fatal("tomasulo must have at least one INT and one FP reservation station");
+  if(config->fu_int_size < 1 || config->fu_fp_size < 1)
+    fatal("tomasulo must have at least one INT and one FP functional unit");
+  if(config->fu_int_latency < 1 || config->fu_fp_latency < 1)
+    fatal("tomasulo functional unit latencies must be positive");
+  if(config->fetch_width < 1)
+    fatal("tomasulo fetch width must be positive");
+  if(config->cdb_size < 1)
+    fatal("tomasulo must have at least one common data bus");
+  if(config->window < 0)
+    fatal("tomasulo window must be non-negative");
+  if(config->lsq_size < 0)
+    fatal("tomasulo load/store queue size must be non-negative");
+  if(config->fwd_latency < 1)
+    fatal("tomasulo store forwarding latency must be positive");
+  if(config->mdp_penalty < 0)
+    fatal("tomasulo memory order violation penalty must be non-negative");
+  if(config->mdp && config->lsq_size == 0)
+    fatal("tomasulo memory-dependence prediction needs a load/store queue");
+  if(config->branch_penalty < 0)
+    fatal("tomasulo branch misprediction penalty must be non-negative");
+}
+
+static void fu_class_init(fu_class_t* fu_class, int rs_size, int fu_size, int latency)
+{
+  fu_class->rs_size = rs_size;
+  fu_class->rs_used = 0;
+  fu_class->fu_size = fu_size;
+  fu_class->fu_used = 0;
+  fu_class->latency = latency;
+
+  fu_class->ready.entries = calloc(rs_size, sizeof(instruction_t*));
+  fu_class->ready.count = 0;
+
+  fu_class->exec.entries = calloc(fu_size, sizeof(instruction_t*));
+  fu_class->exec.count = 0;
+  fu_class->exec.by_completion = true;
+
+  fu_class->blocked = calloc(rs_size, sizeof(instruction_t*));
+  fu_class->nblocked = 0;
+
+  if(fu_class->ready.entries == NULL || fu_class->exec.entries == NULL
+     || fu_class->blocked == NULL)
+    fatal("out of virtual memory");
+}
+
+/* 
+ * Description: 
+ * 	Creates a timing model with the given machine geometry
+ * Inputs:
+ *      config: the machine geometry, window 0 picks a size from the IFQ and
+ *              reservation station depth (rounded up to a power of two)
+ * Returns:
+ * 	The new timing model
+ */
+tomasulo_t* tomasulo_create(tom_config_t* config, tom_stats_t* stats)
+{
+  tomasulo_t* tom = calloc(1, sizeof(tomasulo_t));
+  if(tom == NULL)
+    fatal("out of virtual memory");
+
+  tom->config = *config;
+  tom->stats = (stats != NULL) ? stats : &tom->own_stats;
+
+  tom->instr_queue = calloc(config->ifq_size, sizeof(instruction_t*));
+  if(tom->instr_queue == NULL)
+    fatal("out of virtual memory");
+
+  fu_class_init(&tom->classINT, config->rs_int_size, config->fu_int_size, config->fu_int_latency);
+  fu_class_init(&tom->classFP, config->rs_fp_size, config->fu_fp_size, config->fu_fp_latency);
+
+  tom->cdb_wait.entries = calloc(config->fu_int_size + config->fu_fp_size, sizeof(instruction_t*));
+  tom->commonDataBus = calloc(config->cdb_size, sizeof(instruction_t*));
+  if(tom->cdb_wait.entries == NULL || tom->commonDataBus == NULL)
+    fatal("out of virtual memory");
+
+  int window = config->window;
+  int min_window = 4 * (config->ifq_size + config->rs_int_size + config->rs_fp_size)
+                   * config->fetch_width;
+  if(window < min_window) window = min_window;
+
+  tom->window = 1;
+  while(tom->window < window) tom->window <<= 1;
+
+  if(!config->bpred.perfect)
   {
-    instr->tom_dispatch_cycle = current_cycle;
+    tom_bpred_config_t* bpred = &config->bpred;
+    tom->bpred = bpred_create(bpred->pred_class, bpred->bimod_size,
+                              bpred->l1size, bpred->l2size, bpred->meta_size,
+                              bpred->shift_width, bpred->xor,
+                              bpred->btb_sets, bpred->btb_assoc, bpred->ras_size);
   }
 
-  return;
+  if(config->lsq_size > 0)
+  {
+    tom->lsq = calloc(config->lsq_size, sizeof(lsq_entry_t));
+    if(tom->lsq == NULL)
+      fatal("out of virtual memory");
+  }
 
-  /* ECE552 Assignment 3 - END CODE */
+  tom->ring = calloc(tom->window, sizeof(instruction_t));
+  tom->live = calloc(tom->window, sizeof(bool));
+  if(tom->ring == NULL || tom->live == NULL)
+    fatal("out of virtual memory");
+
+  // instruction 0 is never handed over, as with the trace it is skipped
+  tom->fetch_index = 1;
+  tom->fetch_limit = 0;
+  tom->stream_open = true;
+  tom->cycle = 1;
+
+  return tom;
+}
+
+void tomasulo_free(tomasulo_t* tom)
+{
+  free(tom->instr_queue);
+  free(tom->classINT.ready.entries);
+  free(tom->classINT.exec.entries);
+  free(tom->classINT.blocked);
+  free(tom->classFP.ready.entries);
+  free(tom->classFP.exec.entries);
+  free(tom->classFP.blocked);
+  free(tom->lsq);
+  if(tom->bpred != NULL) bpred_free(tom->bpred);
+  free(tom->cdb_wait.entries);
+  free(tom->commonDataBus);
+  free(tom->ring);
+  free(tom->live);
+  free(tom);
+}
+
+/* 
+ * Description: 
+ * 	Hands the next executed instruction to the timing model, running cycles
+ *      until its slot in the window is free
+ * Inputs:
+ *      tom: the timing model
+ *      instr: the instruction, with index one past the last one handed over
+ * Returns:
+ * 	None
+ */
+void tomasulo_put(tomasulo_t* tom, instruction_t* instr)
+{
+  assert(instr->index == tom->fetch_limit + 1);
+
+  // the previous occupant must be fetched and out of the pipeline
+  int slot = instr->index & (tom->window - 1);
+  while(instr->index - tom->window >= tom->fetch_index || tom->live[slot])
+  {
+    tomasulo_cycle(tom);
+  }
+
+  tom->ring[slot] = *instr;
+  tom->fetch_limit = instr->index;
 }
 
+/* 
+ * Description: 
+ * 	Drains the pipeline once all instructions have been handed over
+ * Inputs:
+ *      tom: the timing model
+ * 	sim_insn: the total number of instructions simulated
+ * Returns:
+ * 	The total number of cycles it takes to execute the instructions.
+ */
+counter_t tomasulo_finish(tomasulo_t* tom, counter_t sim_insn)
+{
+  tom->stream_open = false;
+
+  while (true) {
+    tomasulo_cycle(tom);
+
+    if (is_simulation_done(tom, sim_insn))
+      break;
+  }
+
+  return tom->cycle;
+}
+
+/* ECE552 Assignment 3 - END CODE */
+
 /* 
  * Description: 
  * 	Performs a cycle-by-cycle simulation of the 4-stage pipeline
  * Inputs:
+ *      config: the machine geometry
  *      trace: instruction trace with all the instructions executed
+ * 	sim_insn: the number of instructions in the trace
+ *      stats: if not NULL, the stall accounting is added to it
  * Returns:
  * 	The total number of cycles it takes to execute the instructions.
- * Extra Notes:
- * 	sim_num_insn: the number of instructions in the trace
  */
-counter_t runTomasulo(instruction_trace_t* trace)
+counter_t runTomasulo(tom_config_t* config, instruction_trace_t* trace, counter_t sim_insn,
+                      tom_stats_t* stats)
 {
-  //initialize instruction queue
-  int i;
-  for (i = 0; i < INSTR_QUEUE_SIZE; i++) {
-    instr_queue[i] = NULL;
-  }
+  /* ECE552 Assignment 3 - BEGIN CODE */
+  tomasulo_t* tom = tomasulo_create(config, stats);
 
-  //initialize reservation stations
-  for (i = 0; i < RESERV_INT_SIZE; i++) {
-      reservINT[i] = NULL;
+  // the trace is only read, so it can be shared by concurrent runs
+  for(int index = 1; index <= sim_insn && index < trace->size; index++)
+  {
+    tomasulo_put(tom, get_instr(trace, index));
   }
 
-  for(i = 0; i < RESERV_FP_SIZE; i++) {
-      reservFP[i] = NULL;
-  }
+  counter_t cycles = tomasulo_finish(tom, sim_insn);
+  tomasulo_free(tom);
 
-  //initialize functional units
-  for (i = 0; i < FU_INT_SIZE; i++) {
-    fuINT[i] = NULL;
-  }
+  return cycles;
+  /* ECE552 Assignment 3 - END CODE */
+}
 
-  for (i = 0; i < FU_FP_SIZE; i++) {
-    fuFP[i] = NULL;
+/* ECE552 Assignment 3 - BEGIN CODE */
+/* 
+ * Description: 
+ * 	Performs a cycle-by-cycle simulation of the 4-stage pipeline over a
+ *      trace file written by sim-safe
+ * Inputs:
+ *      config: the machine geometry
+ *      file: the mapped instruction trace
+ *      stats: if not NULL, the stall accounting is added to it
+ * Returns:
+ * 	The total number of cycles it takes to execute the instructions.
+ */
+counter_t tomasulo_replay(tom_config_t* config, itrace_file_t* file, tom_stats_t* stats)
+{
+  tomasulo_t* tom = tomasulo_create(config, stats);
+
+  itrace_cursor_t cursor;
+  instruction_t instr;
+  itrace_cursor_init(&cursor, file);
+  while(itrace_next(&cursor, &instr))
+  {
+    tomasulo_put(tom, &instr);
   }
+  itrace_cursor_free(&cursor);
+
+  counter_t cycles = tomasulo_finish(tom, itrace_count(file));
+  tomasulo_free(tom);
+
+  return cycles;
+}
+
+/* DESIGN-SPACE SWEEP */
+
+//work shared by the sweep threads
+typedef struct tom_sweep
+{
+  tom_config_t* configs;
+  counter_t* cycles;
+  int nconfigs;
+  int next;                     //next configuration to simulate
+  pthread_mutex_t lock;
+  instruction_trace_t* trace;   //in-memory trace, or
+  itrace_file_t* file;          //mapped trace file
+  counter_t sim_insn;
+} tom_sweep_t;
+
+static void* tomasulo_sweep_worker(void* arg)
+{
+  tom_sweep_t* sweep = arg;
 
-  //initialize map_table to no producers
-  int reg;
-  for (reg = 0; reg < MD_TOTAL_REGS; reg++) {
-    map_table[reg] = NULL;
+  while(true)
+  {
+    pthread_mutex_lock(&sweep->lock);
+    int i = sweep->next++;
+    pthread_mutex_unlock(&sweep->lock);
+
+    if(i >= sweep->nconfigs) break;
+
+    if(sweep->file != NULL)
+      sweep->cycles[i] = tomasulo_replay(&sweep->configs[i], sweep->file, NULL);
+    else
+      sweep->cycles[i] = runTomasulo(&sweep->configs[i], sweep->trace, sweep->sim_insn, NULL);
   }
-  
-  int cycle = 1;
-  while (true) {
 
-    /* ECE552 Assignment 3 - BEGIN CODE */
-    // do not chain stages within one cycle
-    CDB_To_retire(cycle);
-    execute_To_CDB(cycle);
-    issue_To_execute(cycle);
-    dispatch_To_issue(cycle);
-    fetch_To_dispatch(trace, cycle);
-    /* ECE552 Assignment 3 - END CODE */
+  return NULL;
+}
 
-    cycle++;
+/* 
+ * Description: 
+ * 	Replays one trace against several machine geometries
+ * Inputs:
+ *      configs: the machine geometries
+ *      nconfigs: the number of geometries
+ *      trace: instruction trace with all the instructions executed
+ *      file: mapped trace file, used instead of trace if not NULL
+ * 	sim_insn: the number of instructions in the trace
+ *      nthreads: the maximum number of timing runs at once
+ *      csv: where the results are written
+ * Returns:
+ * 	None
+ */
+void tomasulo_sweep(tom_config_t* configs, int nconfigs,
+                    instruction_trace_t* trace, itrace_file_t* file,
+                    counter_t sim_insn, int nthreads, FILE* csv)
+{
+  tom_sweep_t sweep;
+  sweep.configs = configs;
+  sweep.nconfigs = nconfigs;
+  sweep.next = 0;
+  sweep.trace = trace;
+  sweep.file = file;
+  sweep.sim_insn = sim_insn;
+  sweep.cycles = calloc(nconfigs, sizeof(counter_t));
+  if(sweep.cycles == NULL)
+    fatal("out of virtual memory");
+  pthread_mutex_init(&sweep.lock, NULL);
+
+  if(nthreads > nconfigs) nthreads = nconfigs;
+  if(nthreads < 1) nthreads = 1;
+
+  pthread_t* threads = calloc(nthreads, sizeof(pthread_t));
+  if(threads == NULL)
+    fatal("out of virtual memory");
+
+  for(int i = 0; i < nthreads; i++)
+  {
+    if(pthread_create(&threads[i], NULL, tomasulo_sweep_worker, &sweep) != 0)
+      fatal("cannot create tomasulo sweep thread");
+  }
+  for(int i = 0; i < nthreads; i++)
+  {
+    pthread_join(threads[i], NULL);
+  }
 
-    if (is_simulation_done(sim_num_insn))
-      break;
+  fprintf(csv, "ifq_size,rs_int,rs_fp,fu_int,fu_fp,fu_int_latency,fu_fp_latency,"
+               "fetch_width,cdbs,insts,cycles,ipc\n");
+  for(int i = 0; i < nconfigs; i++)
+  {
+    tom_config_t* config = &configs[i];
+    myfprintf(csv, "%d,%d,%d,%d,%d,%d,%d,%d,%d,%n,%n,%.4f\n",
+              config->ifq_size, config->rs_int_size, config->rs_fp_size,
+              config->fu_int_size, config->fu_fp_size,
+              config->fu_int_latency, config->fu_fp_latency,
+              config->fetch_width, config->cdb_size,
+              sim_insn, sweep.cycles[i],
+              (double)sim_insn / (double)sweep.cycles[i]);
   }
-  
-  return cycle;
+
+  pthread_mutex_destroy(&sweep.lock);
+  free(threads);
+  free(sweep.cycles);
 }
+/* ECE552 Assignment 3 - END CODE */
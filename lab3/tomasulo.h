@@ -0,0 +1,149 @@
+#ifndef TOMASULO_H
+#define TOMASULO_H
+
+#include <stdbool.h>
+#include <stdio.h>
+
+#include "host.h"
+#include "stats.h"
+#include "bpred.h"
+#include "instr.h"
+#include "itrace.h"
+
+/* DEFAULT PARAMETERS OF THE TOMASULO'S ALGORITHM */
+#define INSTR_QUEUE_SIZE         16
+
+#define RESERV_INT_SIZE    5
+#define RESERV_FP_SIZE     3
+#define FU_INT_SIZE        3
+#define FU_FP_SIZE         1
+
+#define FU_INT_LATENCY     5
+#define FU_FP_LATENCY      7
+
+#define FETCH_WIDTH        1
+#define CDB_SIZE           1
+
+#define LSQ_SIZE           0    //no load/store queue, memory is only ordered by registers
+#define LSQ_FWD_LATENCY    1
+#define MDP_PENALTY        10
+
+#define BRANCH_PENALTY     3
+
+//front end branch predictor, the arguments of bpred_create()
+typedef struct tom_bpred_config
+{
+  bool perfect;         //no predictor, fetch always follows the trace
+  enum bpred_class pred_class;
+  int bimod_size;
+  int l1size;
+  int l2size;
+  int meta_size;
+  int shift_width;
+  int xor;
+  int btb_sets;
+  int btb_assoc;
+  int ras_size;
+}tom_bpred_config_t;
+
+//machine geometry of one tomasulo run
+typedef struct tom_config
+{
+  int ifq_size;         //instruction fetch queue entries
+  int rs_int_size;      //INT reservation stations
+  int rs_fp_size;       //FP reservation stations
+  int fu_int_size;      //INT functional units
+  int fu_fp_size;       //FP functional units
+  int fu_int_latency;   //INT execution latency
+  int fu_fp_latency;    //FP execution latency
+  int fetch_width;      //instructions fetched and dispatched per cycle
+  int cdb_size;         //common data buses
+  int window;           //instructions kept in flight by the model (0 = auto)
+  int lsq_size;         //load/store queue entries (0 = no load/store queue)
+  int fwd_latency;      //latency of a load forwarded from an older store
+  bool mdp;             //loads speculate past unknown store addresses
+  int mdp_penalty;      //cycles dispatch stops after a memory order violation
+  tom_bpred_config_t bpred; //front end branch predictor
+  int branch_penalty;   //cycles fetch stops after a mispredicted branch dispatches
+  bool ptrace;          //emit a pipetrace through ptrace.c (one run at a time)
+}tom_config_t;
+
+//classes of producers a RAW wait is charged to
+enum tom_producer_class
+{
+  TOM_PROD_INT,         //INT computation
+  TOM_PROD_LOAD,        //load
+  TOM_PROD_FP,          //FP computation
+  TOM_PROD_NUM
+};
+
+//where the cycles of one run went; every dispatch slot (fetch_width per
+//cycle) is either used or lost to exactly one cause, the issue side counts
+//instruction-cycles spent waiting in the reservation stations
+typedef struct tom_stats
+{
+  counter_t window_stalls;      //cycles fetch waited on a full window
+  counter_t disp_used;          //dispatch slots that moved an instruction
+  counter_t disp_ifq_empty;     //dispatch slots lost to an empty IFQ
+  counter_t disp_rs_full_int;   //dispatch slots lost to full INT stations
+  counter_t disp_rs_full_fp;    //dispatch slots lost to full FP stations
+  counter_t disp_lsq_full;      //dispatch slots lost to a full load/store queue
+  counter_t disp_mem_squash;    //dispatch slots lost to memory order violations
+  counter_t disp_branch;        //dispatch slots lost to branch redirects
+  counter_t fu_busy_int;        //ready INT instructions waiting on a busy FU
+  counter_t fu_busy_fp;         //ready FP instructions waiting on a busy FU
+  counter_t raw_wait[TOM_PROD_NUM]; //operands waiting on a producer of a class
+  counter_t cdb_wait;           //completed instructions waiting for a CDB
+  counter_t lsq_wait;           //ready loads held back by older stores
+  counter_t lsq_forwards;       //loads forwarded from an older store
+  counter_t mem_violations;     //loads that speculated past an aliasing store
+  counter_t branches;           //control instructions fetched
+  counter_t branch_mispred;     //control instructions with a wrong next PC
+
+  //instructions dispatched and issued per cycle, sampled if not NULL
+  struct stat_stat_t* dispatch_dist;
+  struct stat_stat_t* issue_dist;
+}tom_stats_t;
+
+//state of one tomasulo run
+typedef struct tomasulo tomasulo_t;
+
+//fills the configuration with the default geometry
+extern void tom_config_default(tom_config_t* config);
+
+//parses "ifq:rsint:rsfp:fuint:fufp:latint:latfp[:width:cdbs]", returns false
+//if malformed; width and cdbs default to one
+extern bool tom_config_parse(tom_config_t* config, char* str);
+
+//checks a configuration, calls fatal() if it cannot be simulated
+extern void tom_config_check(tom_config_t* config);
+
+//creates a timing model, instructions are then handed over with tomasulo_put;
+//the stall accounting is added to stats if not NULL
+extern tomasulo_t* tomasulo_create(tom_config_t* config, tom_stats_t* stats);
+
+//frees a timing model
+extern void tomasulo_free(tomasulo_t* tom);
+
+//hands the next executed instruction to the timing model, running cycles
+//until there is room for it in the window
+extern void tomasulo_put(tomasulo_t* tom, instruction_t* instr);
+
+//drains the pipeline, returns the total number of cycles
+extern counter_t tomasulo_finish(tomasulo_t* tom, counter_t sim_insn);
+
+//runs the tomasulo timing model over a complete trace, returns the cycle count
+extern counter_t runTomasulo(tom_config_t* config, instruction_trace_t* trace,
+                             counter_t sim_insn, tom_stats_t* stats);
+
+//runs the tomasulo timing model over a trace file, returns the cycle count
+extern counter_t tomasulo_replay(tom_config_t* config, itrace_file_t* file,
+                                 tom_stats_t* stats);
+
+//replays the trace (or the trace file if not NULL) against every configuration
+//using up to nthreads threads and writes one CSV line of cycles/IPC per configuration
+extern void tomasulo_sweep(tom_config_t* configs, int nconfigs,
+                           instruction_trace_t* trace, itrace_file_t* file,
+                           counter_t sim_insn, int nthreads, FILE* csv);
+
+#endif
@@ -62,6 +62,61 @@
 /* turn this on to enable the SimpleScalar 2.0 RAS bug */
 /* #define RAS_BUG_COMPATIBLE */
 
+/* TAGE tag width of each tagged component */
+static const int tage_tag_bits[BPRED_TAGE_TABLES] =
+  { 7, 7, 8, 8, 9, 10, 11, 12 };
+
+/* TAGE counter ranges */
+#define TAGE_CTR_MAX		3	/* 3-bit signed prediction counters */
+#define TAGE_CTR_MIN		-4
+#define TAGE_U_MAX		3	/* 2-bit usefulness counters */
+#define TAGE_U_RESET_PERIOD	(1 << 18) /* updates between usefulness decay */
+#define TAGE_WEAK(CTR)		((CTR) == 0 || (CTR) == -1)
+
+/* perceptron weight range, 8-bit weights */
+#define PERC_WEIGHT_MAX		127
+
+/* round N up to a multiple of the BTB line size */
+#define BTB_LINE_ROUND(N)	(((N) + BTB_LINE_SIZE - 1) & ~(BTB_LINE_SIZE - 1))
+
+/* allocate the BTB arrays of PRED from one block, each line aligned */
+static void
+bpred_btb_alloc(struct bpred_t *pred)	/* branch predictor instance */
+{
+  int n = pred->btb.sets * pred->btb.assoc;
+  size_t addr_size = BTB_LINE_ROUND(n * sizeof(md_addr_t));
+  size_t op_size = BTB_LINE_ROUND(n * sizeof(enum md_opcode));
+  size_t age_size = BTB_LINE_ROUND(n * sizeof(unsigned char));
+  char *mem;
+
+  if (!(mem = calloc(2 * addr_size + op_size + age_size + BTB_LINE_SIZE, 1)))
+    fatal("cannot allocate BTB");
+  mem = (char *)(((unsigned long)mem + BTB_LINE_SIZE - 1)
+		 & ~(unsigned long)(BTB_LINE_SIZE - 1));
+
+  pred->btb.addr = (md_addr_t *)mem;
+  pred->btb.target = (md_addr_t *)(mem + addr_size);
+  pred->btb.op = (enum md_opcode *)(mem + 2 * addr_size);
+  pred->btb.age = (unsigned char *)(mem + 2 * addr_size + op_size);
+}
+
+/* index of the BTB entry of branch BADDR in the set starting at index SET,
+   or -1 if it is not in the BTB */
+static int
+bpred_btb_probe(struct bpred_t *pred,	/* branch predictor instance */
+		int set,		/* index of the first entry of the set */
+		md_addr_t baddr)	/* branch address */
+{
+  md_addr_t *addr = pred->btb.addr + set;
+  int i;
+
+  for (i = 0; i < pred->btb.assoc; i++)
+    if (addr[i] == baddr)
+      return set + i;
+
+  return -1;
+}
+
 /* create a branch predictor */
 struct bpred_t *			/* branch predictory instance */
 bpred_create(enum bpred_class class,	/* type of predictor to create */
@@ -107,6 +162,17 @@ bpred_create(enum bpred_class class,	/* type of predictor to create */
   case BPred2bit:
     pred->dirpred.bimod = 
       bpred_dir_create(class, bimod_size, 0, 0, 0);
+    break;
+
+  case BPredPerc:
+    pred->dirpred.perc =
+      bpred_dir_create(class, l1size, 0, shift_width, 0);
+    break;
+
+  case BPredTAGE:
+    pred->dirpred.tage =
+      bpred_dir_create(class, l1size, bimod_size, shift_width, 0);
+    break;
 
   case BPredTaken:
   case BPredNotTaken:
@@ -122,6 +188,8 @@ bpred_create(enum bpred_class class,	/* type of predictor to create */
   case BPredComb:
   case BPred2Level:
   case BPred2bit:
+  case BPredPerc:
+  case BPredTAGE:
     {
       int i;
 
@@ -130,25 +198,16 @@ bpred_create(enum bpred_class class,	/* type of predictor to create */
 	fatal("number of BTB sets must be non-zero and a power of two");
       if (!btb_assoc || (btb_assoc & (btb_assoc-1)) != 0)
 	fatal("BTB associativity must be non-zero and a power of two");
-
-      if (!(pred->btb.btb_data = calloc(btb_sets * btb_assoc,
-					sizeof(struct bpred_btb_ent_t))))
-	fatal("cannot allocate BTB");
+      if (btb_assoc > 256)
+	fatal("BTB associativity must be at most 256");
 
       pred->btb.sets = btb_sets;
       pred->btb.assoc = btb_assoc;
+      bpred_btb_alloc(pred);
 
-      if (pred->btb.assoc > 1)
-	for (i=0; i < (pred->btb.assoc*pred->btb.sets); i++)
-	  {
-	    if (i % pred->btb.assoc != pred->btb.assoc - 1)
-	      pred->btb.btb_data[i].next = &pred->btb.btb_data[i+1];
-	    else
-	      pred->btb.btb_data[i].next = NULL;
-	    
-	    if (i % pred->btb.assoc != pred->btb.assoc - 1)
-	      pred->btb.btb_data[i+1].prev = &pred->btb.btb_data[i];
-	  }
+      /* entries start out in LRU order by way */
+      for (i=0; i < (pred->btb.assoc*pred->btb.sets); i++)
+	pred->btb.age[i] = i % pred->btb.assoc;
 
       /* allocate retstack */
       if ((retstack_size & (retstack_size-1)) != 0)
@@ -251,6 +310,83 @@ bpred_dir_create (
 
     break;
 
+  case BPredPerc:
+    if (!l1size || (l1size & (l1size-1)) != 0)
+      fatal("number of perceptrons, `%d', must be non-zero and a power of two",
+	    l1size);
+    pred_dir->config.perc.size = l1size;
+
+    if (!shift_width || shift_width > 64)
+      fatal("perceptron history length, `%d', must be between 1 and 64",
+	    shift_width);
+    pred_dir->config.perc.history = shift_width;
+
+    /* training threshold of Jimenez and Lin */
+    pred_dir->config.perc.theta = (int)(1.93 * shift_width + 14);
+
+    if (!(pred_dir->config.perc.weights =
+	  calloc(l1size * (shift_width + 1), sizeof(signed char))))
+      fatal("cannot allocate perceptron weights");
+    pred_dir->config.perc.ghr = 0;
+
+    break;
+
+  case BPredTAGE:
+    {
+      int i, log_size;
+
+      if (l1size < (1 << BPRED_TAGE_TABLES) || (l1size & (l1size-1)) != 0)
+	fatal("TAGE component size, `%d', must be a power of two "
+	      "and at least %d", l1size, 1 << BPRED_TAGE_TABLES);
+      for (log_size = 0; (1 << log_size) < l1size; log_size++)
+	/* nada */;
+      pred_dir->config.tage.size = l1size;
+      pred_dir->config.tage.log_size = log_size;
+
+      if (!l2size || (l2size & (l2size-1)) != 0)
+	fatal("TAGE base table size, `%d', must be non-zero and a power of two",
+	      l2size);
+      pred_dir->config.tage.base_size = l2size;
+
+      if (shift_width < BPRED_TAGE_MIN_HIST
+	  || shift_width > BPRED_TAGE_HIST_BUF / 2)
+	fatal("TAGE history length, `%d', must be between %d and %d",
+	      shift_width, BPRED_TAGE_MIN_HIST, BPRED_TAGE_HIST_BUF / 2);
+
+      if (!(pred_dir->config.tage.base = calloc(l2size, sizeof(unsigned char))))
+	fatal("cannot allocate TAGE base table");
+      /* initialize counters to weakly this-or-that */
+      flipflop = 1;
+      for (cnt = 0; cnt < l2size; cnt++)
+	{
+	  pred_dir->config.tage.base[cnt] = flipflop;
+	  flipflop = 3 - flipflop;
+	}
+
+      for (i = 0; i < BPRED_TAGE_TABLES; i++)
+	{
+	  /* geometric series of history lengths, longer histories get
+	     wider tags */
+	  pred_dir->config.tage.hist_len[i] =
+	    (int)(BPRED_TAGE_MIN_HIST
+		  * pow((double)shift_width / BPRED_TAGE_MIN_HIST,
+			(double)i / (BPRED_TAGE_TABLES - 1)) + 0.5);
+	  pred_dir->config.tage.tag_bits[i] = tage_tag_bits[i];
+
+	  if (!(pred_dir->config.tage.tables[i] =
+		calloc(l1size, sizeof(struct bpred_tage_ent_t))))
+	    fatal("cannot allocate TAGE component");
+	}
+
+      /* the history starts out all not taken, folded to all zeros */
+      pred_dir->config.tage.ghist_ptr = 0;
+      pred_dir->config.tage.use_alt_on_na = 0;
+      pred_dir->config.tage.tick = 0;
+      pred_dir->config.tage.seed = 1;
+
+      break;
+    }
+
   case BPredTaken:
   case BPredNotTaken:
     /* no other state */
@@ -283,6 +419,21 @@ bpred_dir_config(
       name, pred_dir->config.bimod.size);
     break;
 
+  case BPredPerc:
+    fprintf(stream,
+      "pred_dir: %s: perceptron: %d perceptrons, %d history bits, 8-bit weights\n",
+      name, pred_dir->config.perc.size, pred_dir->config.perc.history);
+    break;
+
+  case BPredTAGE:
+    fprintf(stream,
+      "pred_dir: %s: TAGE: %d base entries, %d x %d tagged entries, "
+      "%d-%d history\n",
+      name, pred_dir->config.tage.base_size, BPRED_TAGE_TABLES,
+      pred_dir->config.tage.size, pred_dir->config.tage.hist_len[0],
+      pred_dir->config.tage.hist_len[BPRED_TAGE_TABLES - 1]);
+    break;
+
   case BPredTaken:
     fprintf(stream, "pred_dir: %s: predict taken\n", name);
     break;
@@ -325,6 +476,20 @@ bpred_config(struct bpred_t *pred,	/* branch predictor instance */
     fprintf(stream, "ret_stack: %d entries", pred->retstack.size);
     break;
 
+  case BPredPerc:
+    bpred_dir_config (pred->dirpred.perc, "perc", stream);
+    fprintf(stream, "btb: %d sets x %d associativity",
+	    pred->btb.sets, pred->btb.assoc);
+    fprintf(stream, "ret_stack: %d entries", pred->retstack.size);
+    break;
+
+  case BPredTAGE:
+    bpred_dir_config (pred->dirpred.tage, "tage", stream);
+    fprintf(stream, "btb: %d sets x %d associativity",
+	    pred->btb.sets, pred->btb.assoc);
+    fprintf(stream, "ret_stack: %d entries", pred->retstack.size);
+    break;
+
   case BPredTaken:
     bpred_dir_config (pred->dirpred.bimod, "taken", stream);
     break;
@@ -373,6 +538,12 @@ bpred_reg_stats(struct bpred_t *pred,	/* branch predictor instance */
     case BPredNotTaken:
       name = "bpred_nottaken";
       break;
+    case BPredPerc:
+      name = "bpred_perc";
+      break;
+    case BPredTAGE:
+      name = "bpred_tage";
+      break;
     default:
       panic("bogus branch predictor class");
     }
@@ -536,6 +707,9 @@ bpred_dir_lookup(struct bpred_dir_t *pred_dir,	/* branch dir predictor inst */
     case BPredTaken:
     case BPredNotTaken:
       break;
+    case BPredPerc:
+    case BPredTAGE:
+      panic("perceptron and TAGE predictions need an update record");
     default:
       panic("bogus branch direction predictor class");
     }
@@ -543,6 +717,403 @@ bpred_dir_lookup(struct bpred_dir_t *pred_dir,	/* branch dir predictor inst */
   return (char *)p;
 }
 
+/* shift the direction TAKEN into perceptron history GHR, making it the
+   current history */
+static void
+bpred_perc_push(struct bpred_dir_t *pred_dir,	/* perceptron predictor */
+		qword_t ghr,			/* history to shift into */
+		int taken)			/* direction shifted in */
+{
+  int history = pred_dir->config.perc.history;
+
+  ghr = (ghr << 1) | !!taken;
+  if (history < 64)
+    ghr &= (ULL(1) << history) - 1;
+  pred_dir->config.perc.ghr = ghr;
+}
+
+/* predicts the direction of branch BADDR with a perceptron, recording the
+   lookup in *DIR_UPDATE_PTR, the history was saved there */
+static char *					/* pointer to counter */
+bpred_perc_lookup(struct bpred_dir_t *pred_dir,	/* perceptron predictor */
+		  md_addr_t baddr,		/* branch address */
+		  struct bpred_update_t *dir_update_ptr) /* pred state pointer */
+{
+  int history = pred_dir->config.perc.history;
+  int theta = pred_dir->config.perc.theta;
+  qword_t ghr = pred_dir->config.perc.ghr;
+  unsigned int index;
+  signed char *w;
+  int i, y;
+
+  /* xor the PC with the history to reduce aliasing */
+  index = ((baddr >> MD_BR_SHIFT) ^ (unsigned int)ghr)
+	  & (pred_dir->config.perc.size - 1);
+  w = &pred_dir->config.perc.weights[index * (history + 1)];
+
+  /* y = w_0 + sum_i x_i * w_i, x_i is +1 if branch i back was taken */
+  y = w[0];
+  for (i = 0; i < history; i++)
+    y += ((ghr >> i) & 1) ? w[i+1] : -w[i+1];
+
+  dir_update_ptr->spec.perc.index = index;
+  dir_update_ptr->spec.perc.output = y;
+
+  /* outputs within the training threshold are weak */
+  if (y >= 0)
+    dir_update_ptr->ctr = y > theta ? 3 : 2;
+  else
+    dir_update_ptr->ctr = -y > theta ? 0 : 1;
+
+  dir_update_ptr->dir.spec = TRUE;
+
+  return &dir_update_ptr->ctr;
+}
+
+/* trains the perceptron of a lookup toward direction TAKEN */
+static void
+bpred_perc_train(struct bpred_dir_t *pred_dir,	/* perceptron predictor */
+		 int taken,			/* non-zero if branch was taken */
+		 struct bpred_update_t *dir_update_ptr) /* pred state pointer */
+{
+  int history = pred_dir->config.perc.history;
+  int y = dir_update_ptr->spec.perc.output;
+  qword_t ghr = dir_update_ptr->spec.perc.ghr;
+  signed char *w;
+  int i, t, x;
+
+  /* train on a misprediction or an output within the threshold */
+  if ((y >= 0) == !!taken && abs(y) > pred_dir->config.perc.theta)
+    return;
+
+  w = &pred_dir->config.perc.weights[dir_update_ptr->spec.perc.index
+				     * (history + 1)];
+  t = taken ? 1 : -1;
+  for (i = 0; i <= history; i++)
+    {
+      /* the bias has an input of 1 */
+      x = (i == 0 || ((ghr >> (i-1)) & 1)) ? 1 : -1;
+      if (t * x > 0 && w[i] < PERC_WEIGHT_MAX)
+	w[i]++;
+      else if (t * x < 0 && w[i] > -PERC_WEIGHT_MAX)
+	w[i]--;
+    }
+}
+
+/* shift the direction TAKEN into the TAGE history and its folded copies */
+static void
+bpred_tage_push(struct bpred_dir_t *pred_dir,	/* TAGE predictor */
+		int taken)			/* direction shifted in */
+{
+  unsigned char *ghist = pred_dir->config.tage.ghist;
+  int ptr, i, k;
+
+  ptr = (pred_dir->config.tage.ghist_ptr - 1) & (BPRED_TAGE_HIST_BUF - 1);
+  ghist[ptr] = !!taken;
+  pred_dir->config.tage.ghist_ptr = ptr;
+
+  for (i = 0; i < BPRED_TAGE_TABLES; i++)
+    {
+      int olength = pred_dir->config.tage.hist_len[i];
+      unsigned int old = ghist[(ptr + olength) & (BPRED_TAGE_HIST_BUF - 1)];
+
+      for (k = 0; k < 3; k++)
+	{
+	  /* fold widths: index, tag and tag - 1 bits */
+	  int clength = (k == 0
+			 ? pred_dir->config.tage.log_size
+			 : pred_dir->config.tage.tag_bits[i] - (k == 2));
+	  unsigned int comp = pred_dir->config.tage.fold[k][i];
+
+	  /* shift the newest bit in and the one OLENGTH back out */
+	  comp = (comp << 1) ^ ghist[ptr];
+	  comp ^= old << (olength % clength);
+	  comp ^= comp >> clength;
+	  pred_dir->config.tage.fold[k][i] = comp & ((1 << clength) - 1);
+	}
+    }
+}
+
+/* predicts the direction of branch BADDR with TAGE, recording the lookup
+   in *DIR_UPDATE_PTR, the history was saved there */
+static char *					/* pointer to counter */
+bpred_tage_lookup(struct bpred_dir_t *pred_dir,	/* TAGE predictor */
+		  md_addr_t baddr,		/* branch address */
+		  struct bpred_update_t *dir_update_ptr) /* pred state pointer */
+{
+  md_addr_t pc = baddr >> MD_BR_SHIFT;
+  int log_size = pred_dir->config.tage.log_size;
+  unsigned int (*fold)[BPRED_TAGE_TABLES] = pred_dir->config.tage.fold;
+  unsigned int *index = dir_update_ptr->spec.tage.index;
+  int provider = -1, alt = -1, i, pred_taken, weak;
+  unsigned char base;
+
+  for (i = 0; i < BPRED_TAGE_TABLES; i++)
+    {
+      index[i] = (pc ^ (pc >> (log_size - i)) ^ fold[0][i])
+		 & (pred_dir->config.tage.size - 1);
+      dir_update_ptr->spec.tage.tag[i] =
+	(pc ^ fold[1][i] ^ (fold[2][i] << 1))
+	& ((1 << pred_dir->config.tage.tag_bits[i]) - 1);
+    }
+  dir_update_ptr->spec.tage.base_index =
+    pc & (pred_dir->config.tage.base_size - 1);
+  base = pred_dir->config.tage.base[dir_update_ptr->spec.tage.base_index];
+
+  /* longest and next longest matching components */
+  for (i = BPRED_TAGE_TABLES - 1; i >= 0; i--)
+    {
+      if (pred_dir->config.tage.tables[i][index[i]].tag
+	  == dir_update_ptr->spec.tage.tag[i])
+	{
+	  if (provider < 0)
+	    provider = i;
+	  else
+	    {
+	      alt = i;
+	      break;
+	    }
+	}
+    }
+  dir_update_ptr->spec.tage.provider = provider;
+  dir_update_ptr->spec.tage.alt = alt;
+
+  if (alt >= 0)
+    {
+      signed char ctr = pred_dir->config.tage.tables[alt][index[alt]].ctr;
+
+      dir_update_ptr->spec.tage.alt_pred = ctr >= 0;
+      weak = TAGE_WEAK(ctr);
+    }
+  else
+    {
+      dir_update_ptr->spec.tage.alt_pred = base >= 2;
+      weak = base == 1 || base == 2;
+    }
+
+  if (provider < 0)
+    {
+      dir_update_ptr->spec.tage.provider_pred =
+	dir_update_ptr->spec.tage.alt_pred;
+      pred_taken = dir_update_ptr->spec.tage.alt_pred;
+    }
+  else
+    {
+      struct bpred_tage_ent_t *e =
+	&pred_dir->config.tage.tables[provider][index[provider]];
+
+      dir_update_ptr->spec.tage.provider_pred = e->ctr >= 0;
+
+      /* a weak entry is likely newly allocated, its alternate may know
+	 better */
+      if (TAGE_WEAK(e->ctr) && e->u == 0
+	  && pred_dir->config.tage.use_alt_on_na >= 0)
+	pred_taken = dir_update_ptr->spec.tage.alt_pred;
+      else
+	{
+	  pred_taken = dir_update_ptr->spec.tage.provider_pred;
+	  weak = TAGE_WEAK(e->ctr);
+	}
+    }
+
+  if (pred_taken)
+    dir_update_ptr->ctr = weak ? 2 : 3;
+  else
+    dir_update_ptr->ctr = weak ? 1 : 0;
+
+  dir_update_ptr->dir.spec = TRUE;
+
+  return &dir_update_ptr->ctr;
+}
+
+/* trains the TAGE components of a lookup toward direction TAKEN */
+static void
+bpred_tage_train(struct bpred_dir_t *pred_dir,	/* TAGE predictor */
+		 int taken,			/* non-zero if branch was taken */
+		 struct bpred_update_t *dir_update_ptr) /* pred state pointer */
+{
+  struct bpred_tage_ent_t **tables = pred_dir->config.tage.tables;
+  unsigned int *index = dir_update_ptr->spec.tage.index;
+  unsigned char *base =
+    &pred_dir->config.tage.base[dir_update_ptr->spec.tage.base_index];
+  int provider = dir_update_ptr->spec.tage.provider;
+  int alt = dir_update_ptr->spec.tage.alt;
+  int provider_pred = dir_update_ptr->spec.tage.provider_pred;
+  int alt_pred = dir_update_ptr->spec.tage.alt_pred;
+  int pred_taken = dir_update_ptr->ctr >= 2;
+  struct bpred_tage_ent_t *e = NULL;
+  int i, j;
+
+  taken = !!taken;
+
+  if (provider >= 0)
+    {
+      e = &tables[provider][index[provider]];
+
+      /* learn whether weak new entries or their alternates are right */
+      if (TAGE_WEAK(e->ctr) && e->u == 0 && provider_pred != alt_pred)
+	{
+	  if (alt_pred == taken && pred_dir->config.tage.use_alt_on_na < 7)
+	    pred_dir->config.tage.use_alt_on_na++;
+	  else if (alt_pred != taken && pred_dir->config.tage.use_alt_on_na > -8)
+	    pred_dir->config.tage.use_alt_on_na--;
+	}
+    }
+
+  /* on a misprediction allocate an entry in a longer component */
+  if (pred_taken != taken && provider < BPRED_TAGE_TABLES - 1)
+    {
+      i = provider + 1;
+
+      /* skip one component half the time so that allocations spread out */
+      pred_dir->config.tage.seed =
+	pred_dir->config.tage.seed * 1103515245 + 12345;
+      if (((pred_dir->config.tage.seed >> 16) & 1)
+	  && i < BPRED_TAGE_TABLES - 1)
+	i++;
+
+      while (i < BPRED_TAGE_TABLES && tables[i][index[i]].u != 0)
+	i++;
+      if (i < BPRED_TAGE_TABLES)
+	{
+	  tables[i][index[i]].tag = dir_update_ptr->spec.tage.tag[i];
+	  tables[i][index[i]].ctr = taken ? 0 : -1;
+	  tables[i][index[i]].u = 0;
+	}
+      else
+	{
+	  /* nothing free, age the candidates */
+	  for (j = provider + 1; j < BPRED_TAGE_TABLES; j++)
+	    if (tables[j][index[j]].u > 0)
+	      tables[j][index[j]].u--;
+	}
+    }
+
+  /* train the provider, and its alternate while the provider is not
+     useful yet */
+  if (e)
+    {
+      if (e->u == 0)
+	{
+	  if (alt >= 0)
+	    {
+	      struct bpred_tage_ent_t *a = &tables[alt][index[alt]];
+
+	      if (taken && a->ctr < TAGE_CTR_MAX)
+		a->ctr++;
+	      else if (!taken && a->ctr > TAGE_CTR_MIN)
+		a->ctr--;
+	    }
+	  else if (taken && *base < 3)
+	    ++*base;
+	  else if (!taken && *base > 0)
+	    --*base;
+	}
+
+      if (taken && e->ctr < TAGE_CTR_MAX)
+	e->ctr++;
+      else if (!taken && e->ctr > TAGE_CTR_MIN)
+	e->ctr--;
+
+      /* useful when it was right and the alternate was not */
+      if (provider_pred != alt_pred)
+	{
+	  if (provider_pred == taken && e->u < TAGE_U_MAX)
+	    e->u++;
+	  else if (provider_pred != taken && e->u > 0)
+	    e->u--;
+	}
+    }
+  else if (taken && *base < 3)
+    ++*base;
+  else if (!taken && *base > 0)
+    --*base;
+
+  /* periodically decay usefulness so stale entries can be replaced */
+  if (++pred_dir->config.tage.tick == TAGE_U_RESET_PERIOD)
+    {
+      pred_dir->config.tage.tick = 0;
+      for (i = 0; i < BPRED_TAGE_TABLES; i++)
+	for (j = 0; j < pred_dir->config.tage.size; j++)
+	  tables[i][j].u >>= 1;
+    }
+}
+
+/* saves the perceptron or TAGE global history before the lookup of a
+   control instruction, so its recovery can drop everything younger */
+static void
+bpred_spec_save(struct bpred_t *pred,		/* branch predictor instance */
+		struct bpred_update_t *dir_update_ptr) /* pred state pointer */
+{
+  struct bpred_dir_t *pred_dir;
+
+  switch (pred->class) {
+  case BPredPerc:
+    dir_update_ptr->spec.perc.ghr = pred->dirpred.perc->config.perc.ghr;
+    break;
+  case BPredTAGE:
+    pred_dir = pred->dirpred.tage;
+    dir_update_ptr->spec.tage.ghist_ptr = pred_dir->config.tage.ghist_ptr;
+    memcpy(dir_update_ptr->spec.tage.fold, pred_dir->config.tage.fold,
+	   sizeof(dir_update_ptr->spec.tage.fold));
+    break;
+  default:
+    panic("bogus speculative history predictor class");
+  }
+
+  dir_update_ptr->dir.hist = TRUE;
+}
+
+/* shifts the direction TAKEN into the perceptron or TAGE global history */
+static void
+bpred_spec_push(struct bpred_t *pred,		/* branch predictor instance */
+		int taken)			/* direction shifted in */
+{
+  switch (pred->class) {
+  case BPredPerc:
+    bpred_perc_push(pred->dirpred.perc, pred->dirpred.perc->config.perc.ghr,
+		    taken);
+    break;
+  case BPredTAGE:
+    bpred_tage_push(pred->dirpred.tage, taken);
+    break;
+  default:
+    panic("bogus speculative history predictor class");
+  }
+}
+
+/* restores the global history saved by the lookup of a control
+   instruction and, for a conditional branch, shifts in the resolved
+   direction TAKEN */
+static void
+bpred_spec_repair(struct bpred_t *pred,		/* branch predictor instance */
+		  int taken,			/* non-zero if branch was taken */
+		  struct bpred_update_t *dir_update_ptr) /* pred state pointer */
+{
+  struct bpred_dir_t *pred_dir;
+
+  switch (pred->class) {
+  case BPredPerc:
+    pred->dirpred.perc->config.perc.ghr = dir_update_ptr->spec.perc.ghr;
+    break;
+  case BPredTAGE:
+    pred_dir = pred->dirpred.tage;
+    pred_dir->config.tage.ghist_ptr = dir_update_ptr->spec.tage.ghist_ptr;
+    memcpy(pred_dir->config.tage.fold, dir_update_ptr->spec.tage.fold,
+	   sizeof(pred_dir->config.tage.fold));
+    break;
+  default:
+    panic("bogus speculative history predictor class");
+  }
+
+  if (dir_update_ptr->dir.spec)
+    {
+      bpred_spec_push(pred, taken);
+      dir_update_ptr->dir.hist_taken = !!taken;
+    }
+  dir_update_ptr->dir.recovered = TRUE;
+}
+
 /* probe a predictor for a next fetch address, the predictor is probed
    with branch address BADDR, the branch target is BTARGET (used for
    static predictors), and OP is the instruction opcode (used to simulate
@@ -561,8 +1132,7 @@ bpred_lookup(struct bpred_t *pred,	/* branch predictor instance */
 	     int *stack_recover_idx)	/* Non-speculative top-of-stack;
 					 * used on mispredict recovery */
 {
-  struct bpred_btb_ent_t *pbtb = NULL;
-  int index, i;
+  int index, btb_idx;
 
   if (!dir_update_ptr)
     panic("no bpred update record");
@@ -574,6 +1144,11 @@ bpred_lookup(struct bpred_t *pred,	/* branch predictor instance */
   pred->lookups++;
 
   dir_update_ptr->dir.ras = FALSE;
+  dir_update_ptr->dir.spec = FALSE;
+  dir_update_ptr->dir.hist = FALSE;
+  dir_update_ptr->dir.hist_taken = FALSE;
+  dir_update_ptr->dir.recovered = FALSE;
+  dir_update_ptr->seq = pred->lookups;
   dir_update_ptr->pdir1 = NULL;
   dir_update_ptr->pdir2 = NULL;
   dir_update_ptr->pmeta = NULL;
@@ -616,6 +1191,22 @@ bpred_lookup(struct bpred_t *pred,	/* branch predictor instance */
 	    bpred_dir_lookup (pred->dirpred.bimod, baddr);
 	}
       break;
+    case BPredPerc:
+      bpred_spec_save(pred, dir_update_ptr);
+      if ((MD_OP_FLAGS(op) & (F_CTRL|F_UNCOND)) != (F_CTRL|F_UNCOND))
+	{
+	  dir_update_ptr->pdir1 =
+	    bpred_perc_lookup (pred->dirpred.perc, baddr, dir_update_ptr);
+	}
+      break;
+    case BPredTAGE:
+      bpred_spec_save(pred, dir_update_ptr);
+      if ((MD_OP_FLAGS(op) & (F_CTRL|F_UNCOND)) != (F_CTRL|F_UNCOND))
+	{
+	  dir_update_ptr->pdir1 =
+	    bpred_tage_lookup (pred->dirpred.tage, baddr, dir_update_ptr);
+	}
+      break;
     case BPredTaken:
       return btarget;
     case BPredNotTaken:
@@ -666,41 +1257,31 @@ bpred_lookup(struct bpred_t *pred,	/* branch predictor instance */
     }
 #endif /* !RAS_BUG_COMPATIBLE */
   
-  /* not a return. Get a pointer into the BTB */
-  index = (baddr >> MD_BR_SHIFT) & (pred->btb.sets - 1);
-
-  if (pred->btb.assoc > 1)
-    {
-      index *= pred->btb.assoc;
-
-      /* Now we know the set; look for a PC match */
-      for (i = index; i < (index+pred->btb.assoc) ; i++)
-	if (pred->btb.btb_data[i].addr == baddr)
-	  {
-	    /* match */
-	    pbtb = &pred->btb.btb_data[i];
-	    break;
-	  }
-    }	
-  else
-    {
-      pbtb = &pred->btb.btb_data[index];
-      if (pbtb->addr != baddr)
-	pbtb = NULL;
-    }
+  /* not a return. Look the branch up in its BTB set */
+  index = ((baddr >> MD_BR_SHIFT) & (pred->btb.sets - 1)) * pred->btb.assoc;
+  btb_idx = bpred_btb_probe(pred, index, baddr);
 
   /*
-   * We now also have a pointer into the BTB for a hit, or NULL otherwise
+   * We now also have the index of the BTB entry for a hit, or -1 otherwise
    */
 
   /* if this is a jump, ignore predicted direction; we know it's taken. */
   if ((MD_OP_FLAGS(op) & (F_CTRL|F_UNCOND)) == (F_CTRL|F_UNCOND))
     {
-      return (pbtb ? pbtb->target : 1);
+      return (btb_idx >= 0 ? pred->btb.target[btb_idx] : 1);
     }
 
-  /* otherwise we have a conditional branch */
-  if (pbtb == NULL)
+  /* otherwise we have a conditional branch; the perceptron and TAGE
+     histories follow the fetched path, a predicted taken branch that
+     misses in the BTB has no target to fetch and goes in as not taken */
+  if (dir_update_ptr->dir.spec)
+    {
+      dir_update_ptr->dir.hist_taken =
+	*(dir_update_ptr->pdir1) >= 2 && btb_idx >= 0;
+      bpred_spec_push(pred, dir_update_ptr->dir.hist_taken);
+    }
+
+  if (btb_idx < 0)
     {
       /* BTB miss -- just return a predicted direction */
       return ((*(dir_update_ptr->pdir1) >= 2)
@@ -711,7 +1292,7 @@ bpred_lookup(struct bpred_t *pred,	/* branch predictor instance */
     {
       /* BTB hit, so return target if it's a predicted-taken branch */
       return ((*(dir_update_ptr->pdir1) >= 2)
-	      ? /* taken */ pbtb->target
+	      ? /* taken */ pred->btb.target[btb_idx]
 	      : /* not taken */ 0);
     }
 }
@@ -723,13 +1304,19 @@ bpred_lookup(struct bpred_t *pred,	/* branch predictor instance */
 void
 bpred_recover(struct bpred_t *pred,	/* branch predictor instance */
 	      md_addr_t baddr,		/* branch address */
-	      int stack_recover_idx)	/* Non-speculative top-of-stack;
+	      int stack_recover_idx,	/* Non-speculative top-of-stack;
 					 * used on mispredict recovery */
+	      int taken,		/* non-zero if branch was taken */
+	      struct bpred_update_t *dir_update_ptr) /* pred state pointer */
 {
   if (pred == NULL)
     return;
 
   pred->retstack.tos = stack_recover_idx;
+
+  /* the history of the younger, squashed, branches goes too */
+  if (dir_update_ptr->dir.hist)
+    bpred_spec_repair(pred, taken, dir_update_ptr);
 }
 
 /* update the branch predictor, only useful for stateful predictors; updates
@@ -750,8 +1337,7 @@ bpred_update(struct bpred_t *pred,	/* branch predictor instance */
 	     enum md_opcode op,		/* opcode of instruction */
 	     struct bpred_update_t *dir_update_ptr)/* pred state pointer */
 {
-  struct bpred_btb_ent_t *pbtb = NULL;
-  struct bpred_btb_ent_t *lruhead = NULL, *lruitem = NULL;
+  int btb_idx = -1;
   int index, i;
 
   /* don't change bpred state for non-branch instructions or if this
@@ -843,76 +1429,65 @@ bpred_update(struct bpred_t *pred,	/* branch predictor instance */
   /* find BTB entry if it's a taken branch (don't allocate for non-taken) */
   if (taken)
     {
-      index = (baddr >> MD_BR_SHIFT) & (pred->btb.sets - 1);
-      
+      index = ((baddr >> MD_BR_SHIFT) & (pred->btb.sets - 1))
+	      * pred->btb.assoc;
+
+      /* Now we know the set; look for a PC match */
+      btb_idx = bpred_btb_probe(pred, index, baddr);
+
       if (pred->btb.assoc > 1)
 	{
-	  index *= pred->btb.assoc;
-	  
-	  /* Now we know the set; look for a PC match; also identify
-	   * MRU and LRU items */
-	  for (i = index; i < (index+pred->btb.assoc) ; i++)
+	  unsigned char *age = pred->btb.age + index;
+	  int lru_age;
+
+	  if (btb_idx < 0)
 	    {
-	      if (pred->btb.btb_data[i].addr == baddr)
-		{
-		  /* match */
-		  assert(!pbtb);
-		  pbtb = &pred->btb.btb_data[i];
-		}
-	      
-	      dassert(pred->btb.btb_data[i].prev 
-		      != pred->btb.btb_data[i].next);
-	      if (pred->btb.btb_data[i].prev == NULL)
-		{
-		  /* this is the head of the lru list, ie current MRU item */
-		  dassert(lruhead == NULL);
-		  lruhead = &pred->btb.btb_data[i];
-		}
-	      if (pred->btb.btb_data[i].next == NULL)
-		{
-		  /* this is the tail of the lru list, ie the LRU item */
-		  dassert(lruitem == NULL);
-		  lruitem = &pred->btb.btb_data[i];
-		}
+	      /* missed in BTB; choose the LRU item in this set as the
+	       * victim */
+	      for (i = 0; age[i] != pred->btb.assoc - 1; i++)
+		dassert(i < pred->btb.assoc - 1);
+	      btb_idx = index + i;
 	    }
-	  dassert(lruhead && lruitem);
-	  
-	  if (!pbtb)
-	    /* missed in BTB; choose the LRU item in this set as the victim */
-	    pbtb = lruitem;	
-	  /* else hit, and pbtb points to matching BTB entry */
-	  
+	  /* else hit, and btb_idx is the matching BTB entry */
+
 	  /* Update LRU state: selected item, whether selected because it
-	   * matched or because it was LRU and selected as a victim, becomes 
-	   * MRU */
-	  if (pbtb != lruhead)
-	    {
-	      /* this splices out the matched entry... */
-	      if (pbtb->prev)
-		pbtb->prev->next = pbtb->next;
-	      if (pbtb->next)
-		pbtb->next->prev = pbtb->prev;
-	      /* ...and this puts the matched entry at the head of the list */
-	      pbtb->next = lruhead;
-	      pbtb->prev = NULL;
-	      lruhead->prev = pbtb;
-	      dassert(pbtb->prev || pbtb->next);
-	      dassert(pbtb->prev != pbtb->next);
-	    }
-	  /* else pbtb is already MRU item; do nothing */
+	   * matched or because it was LRU and selected as a victim, becomes
+	   * MRU, the items that were more recent than it age by one */
+	  lru_age = age[btb_idx - index];
+	  for (i = 0; i < pred->btb.assoc; i++)
+	    if (age[i] < lru_age)
+	      age[i]++;
+	  age[btb_idx - index] = 0;
 	}
       else
-	pbtb = &pred->btb.btb_data[index];
+	btb_idx = index;
     }
-      
-  /* 
-   * Now 'p' is a possibly null pointer into the direction prediction table, 
-   * and 'pbtb' is a possibly null pointer into the BTB (either to a 
-   * matched-on entry or a victim which was LRU in its set)
+
+  /*
+   * Now 'p' is a possibly null pointer into the direction prediction table,
+   * and 'btb_idx' is the BTB entry (either a matched-on entry or a victim
+   * which was LRU in its set), or -1 if the BTB is not updated
    */
 
+  /* perceptron and TAGE predictors train from the lookup record; a
+     history bit that went in wrong and was not recovered is repaired
+     here only if no younger branch has been looked up since (sim-bpred),
+     otherwise the younger bits are on the fetched path and it stays */
+  if (dir_update_ptr->dir.spec)
+    {
+      if (!dir_update_ptr->dir.recovered
+	  && dir_update_ptr->seq == pred->lookups
+	  && dir_update_ptr->dir.hist_taken != !!taken)
+	bpred_spec_repair(pred, taken, dir_update_ptr);
+
+      if (pred->class == BPredPerc)
+	bpred_perc_train(pred->dirpred.perc, taken, dir_update_ptr);
+      else
+	bpred_tage_train(pred->dirpred.tage, taken, dir_update_ptr);
+    }
+
   /* update state (but not for jumps) */
-  if (dir_update_ptr->pdir1)
+  else if (dir_update_ptr->pdir1)
     {
       if (taken)
 	{
@@ -964,22 +1539,22 @@ bpred_update(struct bpred_t *pred,	/* branch predictor instance */
     }
 
   /* update BTB (but only for taken branches) */
-  if (pbtb)
+  if (btb_idx >= 0)
     {
       /* update current information */
       dassert(taken);
 
-      if (pbtb->addr == baddr)
+      if (pred->btb.addr[btb_idx] == baddr)
 	{
 	  if (!correct)
-	    pbtb->target = btarget;
+	    pred->btb.target[btb_idx] = btarget;
 	}
       else
 	{
 	  /* enter a new branch in the table */
-	  pbtb->addr = baddr;
-	  pbtb->op = op;
-	  pbtb->target = btarget;
+	  pred->btb.addr[btb_idx] = baddr;
+	  pred->btb.op[btb_idx] = op;
+	  pred->btb.target[btb_idx] = btarget;
 	}
     }
 }
@@ -91,6 +91,28 @@
  *		are incremented on taken branches and decremented on
  *		no taken branches.  One BTB entry per counter.
  *
+ *	BPredPerc:  a perceptron predictor over the global history
+ *
+ *		The PC xored with the history selects one of N perceptrons,
+ *		which predicts the sign of its bias plus its history weights
+ *		(8 bit) summed with the sign of the history bit.  Parameters:
+ *		     N   # perceptrons
+ *		     H   global history length, at most 64 branches
+ *
+ *	BPredTAGE:  a TAGE predictor
+ *
+ *		A bimodal base table and BPRED_TAGE_TABLES partially tagged
+ *		components indexed with geometric global history lengths
+ *		from BPRED_TAGE_MIN_HIST to L; the longest matching component
+ *		predicts.  Parameters:
+ *		     B   # entries in the base table
+ *		     N   # entries in each tagged component
+ *		     L   longest history length
+ *
+ *		The perceptron and TAGE predictors update their global history
+ *		with the predicted direction at lookup, bpred_recover() and
+ *		bpred_update() repair it after a direction misprediction.
+ *
  *	BPredTaken:  static predict branch taken
  *
  *	BPredNotTaken:  static predict branch not taken
@@ -104,17 +126,34 @@ enum bpred_class {
   BPred2bit,			/* 2-bit saturating cntr pred (dir mapped) */
   BPredTaken,			/* static predict taken */
   BPredNotTaken,		/* static predict not taken */
+  BPredPerc,			/* perceptron predictor */
+  BPredTAGE,			/* TAGE predictor */
   BPred_NUM
 };
 
-/* an entry in a BTB */
+/* TAGE geometry */
+#define BPRED_TAGE_TABLES	8	/* number of tagged components */
+#define BPRED_TAGE_MIN_HIST	4	/* history of the shortest component */
+#define BPRED_TAGE_HIST_BUF	2048	/* global history buffer, in branches */
+
+/* an entry in a TAGE tagged component */
+struct bpred_tage_ent_t {
+  signed char ctr;		/* 3-bit prediction counter, taken if >= 0 */
+  unsigned char u;		/* 2-bit usefulness counter */
+  unsigned short tag;		/* partial tag */
+};
+
+/* an entry in the return-address stack */
 struct bpred_btb_ent_t {
   md_addr_t addr;		/* address of branch being tracked */
   enum md_opcode op;		/* opcode of branch corresp. to addr */
   md_addr_t target;		/* last destination of branch when taken */
-  struct bpred_btb_ent_t *prev, *next; /* lru chaining pointers */
 };
 
+/* BTB arrays are aligned to host cache lines, so the tags of a set of up to
+   BTB_LINE_SIZE bytes are in one line and its targets in one other */
+#define BTB_LINE_SIZE		64
+
 /* direction predictor def */
 struct bpred_dir_t {
   enum bpred_class class;	/* type of predictor */
@@ -131,6 +170,31 @@ struct bpred_dir_t {
       int *shiftregs;		/* level-1 history table */
       unsigned char *l2table;	/* level-2 prediction state table */
     } two;
+    struct {
+      unsigned int size;	/* number of perceptrons */
+      int history;		/* global history length */
+      int theta;		/* training threshold */
+      signed char *weights;	/* bias and history+1 weights per perceptron */
+      qword_t ghr;		/* speculative global history, newest in bit 0 */
+    } perc;
+    struct {
+      unsigned int base_size;	/* number of entries in the base table */
+      unsigned int size;	/* number of entries in each tagged component */
+      int log_size;		/* log2 of size */
+      int hist_len[BPRED_TAGE_TABLES]; /* history length of each component */
+      int tag_bits[BPRED_TAGE_TABLES]; /* tag width of each component */
+      unsigned char *base;	/* base table of 2-bit counters */
+      struct bpred_tage_ent_t *tables[BPRED_TAGE_TABLES]; /* components */
+      unsigned char ghist[BPRED_TAGE_HIST_BUF]; /* speculative global
+					   history, newest at ghist_ptr */
+      int ghist_ptr;		/* index of the newest history bit */
+      /* histories folded to the index width, the tag width and the tag
+	 width - 1 of each component, updated with each history bit */
+      unsigned int fold[3][BPRED_TAGE_TABLES];
+      int use_alt_on_na;	/* >= 0: trust the alternate over a new entry */
+      unsigned int tick;	/* updates since the last usefulness decay */
+      unsigned int seed;	/* allocation randomization */
+    } tage;
   } config;
 };
 
@@ -141,12 +205,19 @@ struct bpred_t {
     struct bpred_dir_t *bimod;	  /* first direction predictor */
     struct bpred_dir_t *twolev;	  /* second direction predictor */
     struct bpred_dir_t *meta;	  /* meta predictor */
+    struct bpred_dir_t *perc;	  /* perceptron predictor */
+    struct bpred_dir_t *tage;	  /* TAGE predictor */
   } dirpred;
 
+  /* BTB addr-prediction table, one array per field, entry I of set S
+     at index S*assoc+I */
   struct {
     int sets;			/* num BTB sets */
     int assoc;			/* BTB associativity */
-    struct bpred_btb_ent_t *btb_data; /* BTB addr-prediction table */
+    md_addr_t *addr;		/* address of branch being tracked */
+    md_addr_t *target;		/* last destination of branch when taken */
+    enum md_opcode *op;		/* opcode of branch corresp. to addr */
+    unsigned char *age;		/* LRU age in its set, 0 is the MRU entry */
   } btb;
 
   struct {
@@ -183,7 +254,41 @@ struct bpred_update_t {
     unsigned int bimod  : 1;    /* bimodal predictor */
     unsigned int twolev : 1;    /* 2-level predictor */
     unsigned int meta   : 1;    /* meta predictor (0..bimod / 1..2lev) */
+    unsigned int spec   : 1;	/* perceptron or TAGE direction lookup */
+    unsigned int hist   : 1;	/* global history saved before the lookup */
+    unsigned int hist_taken : 1; /* direction shifted into the history */
+    unsigned int recovered : 1;	/* speculative history repaired */
   } dir;
+
+  /* the lookup count after this lookup, no younger branch has been looked
+     up while it is still the predictor's count */
+  counter_t seq;
+
+  /* perceptron and TAGE predictions as a 2-bit counter (0 & 3 strong,
+     1 & 2 weak), pdir1 points here until the record is copied */
+  char ctr;
+
+  /* perceptron and TAGE lookup state, to train the predictor and repair
+     its speculative history; the history is saved for every control
+     instruction, the rest only for conditional branches */
+  union {
+    struct {
+      unsigned int index;	/* perceptron used */
+      int output;		/* perceptron output */
+      qword_t ghr;		/* global history before the lookup */
+    } perc;
+    struct {
+      unsigned int index[BPRED_TAGE_TABLES]; /* entry in each component */
+      unsigned short tag[BPRED_TAGE_TABLES]; /* tag in each component */
+      unsigned int base_index;	/* entry in the base table */
+      int provider;		/* longest matching component, -1 for base */
+      int alt;			/* next longest matching, -1 for base */
+      int provider_pred;	/* direction of the provider */
+      int alt_pred;		/* direction of the alternate */
+      int ghist_ptr;		/* global history before the lookup */
+      unsigned int fold[3][BPRED_TAGE_TABLES];
+    } tage;
+  } spec;
 };
 
 /* create a branch predictor */
@@ -199,7 +304,10 @@ bpred_create(enum bpred_class class,	/* type of predictor to create */
 	     unsigned int btb_assoc,	/* BTB associativity */
 	     unsigned int retstack_size);/* num entries in ret-addr stack */
 
-/* create a branch direction predictor */
+/* create a branch direction predictor; the perceptron predictor has L1SIZE
+   perceptrons over SHIFT_WIDTH history bits, the TAGE predictor L1SIZE
+   entries per tagged component, a base table of L2SIZE entries and a
+   longest history of SHIFT_WIDTH branches */
 struct bpred_dir_t *		/* branch direction predictor instance */
 bpred_dir_create (
   enum bpred_class class,	/* type of predictor to create */
@@ -247,12 +355,17 @@ bpred_lookup(struct bpred_t *pred,	/* branch predictor instance */
 /* Speculative execution can corrupt the ret-addr stack.  So for each
  * lookup we return the top-of-stack (TOS) at that point; a mispredicted
  * branch, as part of its recovery, restores the TOS using this value --
- * hopefully this uncorrupts the stack. */
+ * hopefully this uncorrupts the stack.  The global history of the
+ * perceptron and TAGE predictors is restored from *DIR_UPDATE_PTR, for
+ * any control instruction, and extended with the resolved direction TAKEN
+ * of a conditional branch. */
 void
 bpred_recover(struct bpred_t *pred,	/* branch predictor instance */
 	      md_addr_t baddr,		/* branch address */
-	      int stack_recover_idx);	/* Non-speculative top-of-stack;
+	      int stack_recover_idx,	/* Non-speculative top-of-stack;
 					 * used on mispredict recovery */
+	      int taken,		/* non-zero if branch was taken */
+	      struct bpred_update_t *dir_update_ptr); /* pred state pointer */
 
 /* update the branch predictor, only useful for stateful predictors; updates
    entry for instruction type OP at address BADDR.  BTB only gets updated
@@ -0,0 +1,383 @@
+/* btrace.c - branch trace file routines */
+
+/* SimpleScalar(TM) Tool Suite
+ * Copyright (C) 1994-2003 by Todd M. Austin, Ph.D. and SimpleScalar, LLC.
+ * All Rights Reserved. 
+ * 
+ * THIS IS A LEGAL DOCUMENT, BY USING SIMPLESCALAR,
+ * YOU ARE AGREEING TO THESE TERMS AND CONDITIONS.
+ * 
+ * No portion of this work may be used by any commercial entity, or for any
+ * commercial purpose, without the prior, written permission of SimpleScalar,
+ * LLC (info@simplescalar.com). Nonprofit and noncommercial use is permitted
+ * as described below.
+ * 
+ * 1. SimpleScalar is provided AS IS, with no warranty of any kind, express
+ * or implied. The user of the program accepts full responsibility for the
+ * application of the program and the use of any results.
+ * 
+ * 2. Nonprofit and noncommercial use is encouraged. SimpleScalar may be
+ * downloaded, compiled, executed, copied, and modified solely for nonprofit,
+ * educational, noncommercial research, and noncommercial scholarship
+ * purposes provided that this notice in its entirety accompanies all copies.
+ * Copies of the modified software can be delivered to persons who use it
+ * solely for nonprofit, educational, noncommercial research, and
+ * noncommercial scholarship purposes provided that this notice in its
+ * entirety accompanies all copies.
+ * 
+ * 3. ALL COMMERCIAL USE, AND ALL USE BY FOR PROFIT ENTITIES, IS EXPRESSLY
+ * PROHIBITED WITHOUT A LICENSE FROM SIMPLESCALAR, LLC (info@simplescalar.com).
+ * 
+ * 4. No nonprofit user may place any restrictions on the use of this software,
+ * including as modified by the user, by any other authorized user.
+ * 
+ * 5. Noncommercial and nonprofit users may distribute copies of SimpleScalar
+ * in compiled or executable form as set forth in Section 2, provided that
+ * either: (A) it is accompanied by the corresponding machine-readable source
+ * code, or (B) it is accompanied by a written offer, with no time limit, to
+ * give anyone a machine-readable copy of the corresponding source code in
+ * return for reimbursement of the cost of distribution. This written offer
+ * must permit verbatim duplication by anyone, or (C) it is distributed by
+ * someone who received only the executable form, and is accompanied by a
+ * copy of the written offer of source code.
+ * 
+ * 6. SimpleScalar was developed by Todd M. Austin, Ph.D. The tool suite is
+ * currently maintained by SimpleScalar LLC (info@simplescalar.com). US Mail:
+ * 2395 Timbercrest Court, Ann Arbor, MI 48105.
+ * 
+ * Copyright (C) 1994-2003 by Todd M. Austin, Ph.D. and SimpleScalar, LLC.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+#include "misc.h"
+#include "machine.h"
+#include "regs.h"
+#include "memory.h"
+#include "eio.h"
+#include "btrace.h"
+
+/* "SBTR" in host byte order */
+#define BTRACE_MAGIC		0x53425452
+
+/* block payload size, small enough to stay cache resident while decoded */
+#define BTRACE_BLOCK_SIZE	65536
+
+/* longest variable length encoding of an address */
+#define BTRACE_MAX_VARINT	((sizeof(md_addr_t) * 8 + 6) / 7)
+
+/* longest record: opcode byte and up to four variable length integers */
+#define BTRACE_MAX_REC		(1 + 4 * BTRACE_MAX_VARINT)
+
+/* record flags, the low bits of the instruction count delta */
+#define BTRACE_TAKEN		0x01
+#define BTRACE_CALL		0x02
+#define BTRACE_RETURN		0x04
+#define BTRACE_NPC		0x08
+#define BTRACE_FLAG_BITS	4
+
+/* signed address deltas as unsigned integers of small magnitude */
+#define ZIGZAG(D)							\
+  (((D) << 1) ^ (md_addr_t)(0 - ((D) >> (sizeof(md_addr_t) * 8 - 1))))
+#define UNZIGZAG(Z)		(((Z) >> 1) ^ (md_addr_t)(0 - ((Z) & 1)))
+
+static void
+btrace_fwrite(struct btrace_t *bt, void *data, size_t bytes)
+{
+  if (fwrite(data, 1, bytes, bt->fd) != bytes)
+    fatal("could not write branch trace");
+}
+
+static void
+btrace_fread(struct btrace_t *bt, void *data, size_t bytes)
+{
+  if (fread(data, 1, bytes, bt->fd) != bytes)
+    fatal("truncated branch trace");
+}
+
+/* append V to the block payload of BT */
+static void
+btrace_put(struct btrace_t *bt, md_addr_t v)
+{
+  while (v >= 0x80)
+    {
+      bt->buf[bt->pos++] = (unsigned char)(v | 0x80);
+      v >>= 7;
+    }
+  bt->buf[bt->pos++] = (unsigned char)v;
+}
+
+/* next variable length integer of the block payload of BT */
+static md_addr_t
+btrace_get(struct btrace_t *bt)
+{
+  md_addr_t v = 0;
+  int shift = 0;
+  unsigned char byte;
+
+  do
+    {
+      if (bt->pos >= bt->nbytes || shift >= sizeof(md_addr_t) * 8)
+	fatal("corrupt branch trace");
+      byte = bt->buf[bt->pos++];
+      v |= (md_addr_t)(byte & 0x7f) << shift;
+      shift += 7;
+    }
+  while (byte & 0x80);
+
+  return v;
+}
+
+/* write out the current block of BT and start the next one */
+static void
+btrace_flush(struct btrace_t *bt)
+{
+  word_t nrecs = bt->nrecs, nbytes = bt->pos;
+
+  btrace_fwrite(bt, &nrecs, sizeof(nrecs));
+  btrace_fwrite(bt, &nbytes, sizeof(nbytes));
+  btrace_fwrite(bt, &bt->block_icnt, sizeof(bt->block_icnt));
+  btrace_fwrite(bt, &bt->block_NPC, sizeof(bt->block_NPC));
+  btrace_fwrite(bt, bt->buf, bt->pos);
+
+  bt->nrecs = 0;
+  bt->pos = 0;
+  bt->block_icnt = bt->icnt;
+  bt->block_NPC = bt->NPC;
+}
+
+static struct btrace_t *
+btrace_new(FILE *fd, int writing)
+{
+  struct btrace_t *bt;
+
+  bt = (struct btrace_t *)calloc(1, sizeof(struct btrace_t));
+  if (!bt)
+    fatal("out of virtual memory");
+  bt->buf = (unsigned char *)malloc(BTRACE_BLOCK_SIZE);
+  if (!bt->buf)
+    fatal("out of virtual memory");
+  bt->fd = fd;
+  bt->writing = writing;
+
+  return bt;
+}
+
+/* create branch trace FNAME of program PROG_FNAME */
+struct btrace_t *
+btrace_create(char *fname,		/* trace file name */
+	      char *prog_fname)		/* traced program */
+{
+  struct btrace_t *bt;
+  FILE *fd;
+  word_t magic = BTRACE_MAGIC, version = BTRACE_VERSION;
+  word_t format = MD_EIO_FILE_FORMAT, len = strlen(prog_fname);
+
+  if (OP_MAX > 256)
+    panic("opcodes do not fit the branch trace opcode byte");
+
+  fd = gzopen(fname, "w");
+  if (!fd)
+    fatal("unable to create branch trace file `%s'", fname);
+
+  bt = btrace_new(fd, /* writing */TRUE);
+  bt->prog_fname = mystrdup(prog_fname);
+
+  btrace_fwrite(bt, &magic, sizeof(magic));
+  btrace_fwrite(bt, &version, sizeof(version));
+  btrace_fwrite(bt, &format, sizeof(format));
+  btrace_fwrite(bt, &len, sizeof(len));
+  btrace_fwrite(bt, prog_fname, len);
+
+  return bt;
+}
+
+/* append branch REC to trace BT */
+void
+btrace_write(struct btrace_t *bt,	/* trace to write */
+	     struct btrace_rec_t *rec)	/* branch to append */
+{
+  counter_t delta;
+  md_addr_t flags = 0;
+
+  if (rec->icnt < bt->icnt)
+    fatal("branch trace records out of order, instruction %.0f after %.0f",
+	  (double)rec->icnt, (double)bt->icnt);
+  delta = rec->icnt - bt->icnt;
+  if (delta > (counter_t)((md_addr_t)~0 >> BTRACE_FLAG_BITS))
+    fatal("branch trace cannot encode %.0f instructions between branches",
+	  (double)delta);
+
+  if (rec->NPC != rec->PC + sizeof(md_inst_t))
+    {
+      flags |= BTRACE_TAKEN;
+      if (rec->NPC != rec->target)
+	flags |= BTRACE_NPC;
+    }
+  if (rec->is_call)
+    flags |= BTRACE_CALL;
+  if (rec->is_return)
+    flags |= BTRACE_RETURN;
+
+  if (bt->pos + BTRACE_MAX_REC > BTRACE_BLOCK_SIZE)
+    btrace_flush(bt);
+
+  bt->buf[bt->pos++] = (unsigned char)rec->op;
+  btrace_put(bt, ((md_addr_t)delta << BTRACE_FLAG_BITS) | flags);
+  btrace_put(bt, rec->PC - bt->NPC);
+  btrace_put(bt, ZIGZAG((md_addr_t)(rec->target - rec->PC)));
+  if (flags & BTRACE_NPC)
+    btrace_put(bt, ZIGZAG((md_addr_t)(rec->NPC - rec->PC)));
+
+  bt->nrecs++;
+  bt->icnt = rec->icnt;
+  bt->NPC = rec->NPC;
+}
+
+/* open branch trace FNAME for reading */
+struct btrace_t *
+btrace_open(char *fname)		/* trace file name */
+{
+  struct btrace_t *bt;
+  FILE *fd;
+  word_t magic, version, format, len;
+
+  fd = gzopen(fname, "r");
+  if (!fd)
+    fatal("unable to open branch trace file `%s'", fname);
+
+  bt = btrace_new(fd, /* !writing */FALSE);
+
+  btrace_fread(bt, &magic, sizeof(magic));
+  if (magic != BTRACE_MAGIC)
+    fatal("`%s' is not a branch trace of this host byte order", fname);
+  btrace_fread(bt, &version, sizeof(version));
+  if (version != BTRACE_VERSION)
+    fatal("branch trace `%s' is version %d, expected version %d",
+	  fname, version, BTRACE_VERSION);
+  btrace_fread(bt, &format, sizeof(format));
+  if (format != MD_EIO_FILE_FORMAT)
+    fatal("branch trace `%s' is of another target", fname);
+
+  btrace_fread(bt, &len, sizeof(len));
+  bt->prog_fname = (char *)calloc(len + 1, sizeof(char));
+  if (!bt->prog_fname)
+    fatal("out of virtual memory");
+  btrace_fread(bt, bt->prog_fname, len);
+
+  return bt;
+}
+
+/* read the next branch of trace BT into REC, returns zero at the end of
+   the trace, BT->NUM_INSN is then the total instruction count */
+int
+btrace_read(struct btrace_t *bt,	/* trace to read */
+	    struct btrace_rec_t *rec)	/* branch read */
+{
+  word_t nrecs, nbytes;
+  md_addr_t v, flags;
+
+  if (bt->at_end)
+    return FALSE;
+
+  /* start the next block */
+  while (!bt->nrecs)
+    {
+      btrace_fread(bt, &nrecs, sizeof(nrecs));
+      btrace_fread(bt, &nbytes, sizeof(nbytes));
+      btrace_fread(bt, &bt->icnt, sizeof(bt->icnt));
+      btrace_fread(bt, &bt->NPC, sizeof(bt->NPC));
+
+      if (!nrecs)
+	{
+	  /* end block, its payload is the instruction count */
+	  if (nbytes != sizeof(bt->num_insn))
+	    fatal("corrupt branch trace");
+	  btrace_fread(bt, &bt->num_insn, sizeof(bt->num_insn));
+	  bt->at_end = TRUE;
+	  return FALSE;
+	}
+
+      if (nbytes > BTRACE_BLOCK_SIZE)
+	fatal("corrupt branch trace");
+      btrace_fread(bt, bt->buf, nbytes);
+      bt->nrecs = nrecs;
+      bt->nbytes = nbytes;
+      bt->pos = 0;
+    }
+
+  if (bt->pos >= bt->nbytes)
+    fatal("corrupt branch trace");
+  rec->op = (enum md_opcode)bt->buf[bt->pos++];
+
+  v = btrace_get(bt);
+  flags = v & ((1 << BTRACE_FLAG_BITS) - 1);
+  rec->icnt = bt->icnt + (counter_t)(v >> BTRACE_FLAG_BITS);
+  rec->PC = bt->NPC + btrace_get(bt);
+  v = btrace_get(bt);
+  rec->target = rec->PC + UNZIGZAG(v);
+
+  if (flags & BTRACE_NPC)
+    {
+      v = btrace_get(bt);
+      rec->NPC = rec->PC + UNZIGZAG(v);
+    }
+  else if (flags & BTRACE_TAKEN)
+    rec->NPC = rec->target;
+  else
+    rec->NPC = rec->PC + sizeof(md_inst_t);
+
+  rec->is_call = (flags & BTRACE_CALL) != 0;
+  rec->is_return = (flags & BTRACE_RETURN) != 0;
+
+  bt->nrecs--;
+  bt->icnt = rec->icnt;
+  bt->NPC = rec->NPC;
+
+  return TRUE;
+}
+
+/* returns non-zero if file FNAME has a valid branch trace header */
+int
+btrace_valid(char *fname)		/* file name */
+{
+  FILE *fd;
+  word_t magic;
+  int valid;
+
+  fd = gzopen(fname, "r");
+  if (!fd)
+    return FALSE;
+
+  valid = (fread(&magic, sizeof(magic), 1, fd) == 1
+	   && magic == BTRACE_MAGIC);
+  gzclose(fd);
+
+  return valid;
+}
+
+/* close branch trace BT, a written trace ends after NUM_INSN instructions */
+void
+btrace_close(struct btrace_t *bt,	/* trace to close */
+	     counter_t num_insn)	/* total instructions executed */
+{
+  if (bt->writing)
+    {
+      if (bt->nrecs)
+	btrace_flush(bt);
+
+      /* end block */
+      bt->pos = sizeof(num_insn);
+      memcpy(bt->buf, &num_insn, sizeof(num_insn));
+      btrace_flush(bt);
+    }
+
+  gzclose(bt->fd);
+  free(bt->prog_fname);
+  free(bt->buf);
+  free(bt);
+}
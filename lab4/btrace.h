@@ -0,0 +1,144 @@
+/* btrace.h - branch trace file interfaces */
+
+/* SimpleScalar(TM) Tool Suite
+ * Copyright (C) 1994-2003 by Todd M. Austin, Ph.D. and SimpleScalar, LLC.
+ * All Rights Reserved. 
+ * 
+ * THIS IS A LEGAL DOCUMENT, BY USING SIMPLESCALAR,
+ * YOU ARE AGREEING TO THESE TERMS AND CONDITIONS.
+ * 
+ * No portion of this work may be used by any commercial entity, or for any
+ * commercial purpose, without the prior, written permission of SimpleScalar,
+ * LLC (info@simplescalar.com). Nonprofit and noncommercial use is permitted
+ * as described below.
+ * 
+ * 1. SimpleScalar is provided AS IS, with no warranty of any kind, express
+ * or implied. The user of the program accepts full responsibility for the
+ * application of the program and the use of any results.
+ * 
+ * 2. Nonprofit and noncommercial use is encouraged. SimpleScalar may be
+ * downloaded, compiled, executed, copied, and modified solely for nonprofit,
+ * educational, noncommercial research, and noncommercial scholarship
+ * purposes provided that this notice in its entirety accompanies all copies.
+ * Copies of the modified software can be delivered to persons who use it
+ * solely for nonprofit, educational, noncommercial research, and
+ * noncommercial scholarship purposes provided that this notice in its
+ * entirety accompanies all copies.
+ * 
+ * 3. ALL COMMERCIAL USE, AND ALL USE BY FOR PROFIT ENTITIES, IS EXPRESSLY
+ * PROHIBITED WITHOUT A LICENSE FROM SIMPLESCALAR, LLC (info@simplescalar.com).
+ * 
+ * 4. No nonprofit user may place any restrictions on the use of this software,
+ * including as modified by the user, by any other authorized user.
+ * 
+ * 5. Noncommercial and nonprofit users may distribute copies of SimpleScalar
+ * in compiled or executable form as set forth in Section 2, provided that
+ * either: (A) it is accompanied by the corresponding machine-readable source
+ * code, or (B) it is accompanied by a written offer, with no time limit, to
+ * give anyone a machine-readable copy of the corresponding source code in
+ * return for reimbursement of the cost of distribution. This written offer
+ * must permit verbatim duplication by anyone, or (C) it is distributed by
+ * someone who received only the executable form, and is accompanied by a
+ * copy of the written offer of source code.
+ * 
+ * 6. SimpleScalar was developed by Todd M. Austin, Ph.D. The tool suite is
+ * currently maintained by SimpleScalar LLC (info@simplescalar.com). US Mail:
+ * 2395 Timbercrest Court, Ann Arbor, MI 48105.
+ * 
+ * Copyright (C) 1994-2003 by Todd M. Austin, Ph.D. and SimpleScalar, LLC.
+ */
+
+#ifndef BTRACE_H
+#define BTRACE_H
+
+#include <stdio.h>
+
+#include "host.h"
+#include "misc.h"
+#include "machine.h"
+
+/*
+ * A branch trace holds every control instruction a program executed,
+ * so branch predictors can be evaluated without re-executing it:
+ *
+ *   header:  magic, version, target format, program name
+ *   blocks:  record count, payload bytes, instruction count and next PC
+ *            before the block, then the records of the block
+ *   end:     a block of no records, its payload the total instruction
+ *            count
+ *
+ * Records are delta encoded against the previous record of the block, as
+ * variable length integers of 7 bits per byte:
+ *
+ *   opcode byte
+ *   (instructions since the previous branch << 4) | flags
+ *   PC - previous next PC
+ *   target - PC, zig-zag encoded
+ *   [next PC - PC, zig-zag encoded, when taken and not to the target]
+ *
+ * Every block decodes on its own.  Fields are in host byte order, a trace
+ * written on a host of the other byte order is rejected by its magic.  A
+ * trace file name ending in ".gz" is compressed with gzip, if available.
+ */
+
+/* branch trace file version */
+#define BTRACE_VERSION		1
+
+/* one traced control instruction */
+struct btrace_rec_t {
+  counter_t icnt;		/* instructions executed, including the branch */
+  md_addr_t PC;			/* branch address */
+  md_addr_t NPC;		/* resolved next PC */
+  md_addr_t target;		/* decoded branch target */
+  enum md_opcode op;		/* branch opcode */
+  int is_call;			/* non-zero if a function call */
+  int is_return;		/* non-zero if a function return */
+};
+
+/* an open branch trace, either written or read */
+struct btrace_t {
+  FILE *fd;			/* trace stream */
+  int writing;			/* non-zero if the trace is being written */
+  char *prog_fname;		/* traced program */
+  unsigned char *buf;		/* current block payload */
+  int nbytes;			/* payload bytes in the block */
+  int pos;			/* next payload byte */
+  int nrecs;			/* records written to, or left in, the block */
+  counter_t icnt;		/* delta base, instruction count */
+  md_addr_t NPC;		/* delta base, next PC */
+  counter_t block_icnt;		/* instruction count before the block */
+  md_addr_t block_NPC;		/* next PC before the block */
+  int at_end;			/* non-zero once the end block is read */
+  counter_t num_insn;		/* total instructions, once read to the end */
+};
+
+/* create branch trace FNAME of program PROG_FNAME */
+struct btrace_t *
+btrace_create(char *fname,		/* trace file name */
+	      char *prog_fname);	/* traced program */
+
+/* append branch REC to trace BT */
+void
+btrace_write(struct btrace_t *bt,	/* trace to write */
+	     struct btrace_rec_t *rec);	/* branch to append */
+
+/* open branch trace FNAME for reading */
+struct btrace_t *
+btrace_open(char *fname);		/* trace file name */
+
+/* read the next branch of trace BT into REC, returns zero at the end of
+   the trace, BT->NUM_INSN is then the total instruction count */
+int
+btrace_read(struct btrace_t *bt,	/* trace to read */
+	    struct btrace_rec_t *rec);	/* branch read */
+
+/* returns non-zero if file FNAME has a valid branch trace header */
+int
+btrace_valid(char *fname);		/* file name */
+
+/* close branch trace BT, a written trace ends after NUM_INSN instructions */
+void
+btrace_close(struct btrace_t *bt,	/* trace to close */
+	     counter_t num_insn);	/* total instructions executed */
+
+#endif /* BTRACE_H */
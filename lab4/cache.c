@@ -51,6 +51,7 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <limits.h>
 #include <assert.h>
 
 #include "host.h"
@@ -58,6 +59,12 @@
 #include "machine.h"
 #include "cache.h"
 
+/* PISA tags are 32 bits, four to an SSE2 compare */
+#if defined(__SSE2__) && defined(TARGET_PISA)
+#define CACHE_SIMD_TAGS
+#include <emmintrin.h>
+#endif
+
 /* cache access macros */
 #define CACHE_TAG(cp, addr)	((addr) >> (cp)->tag_shift)
 #define CACHE_SET(cp, addr)	(((addr) >> (cp)->set_shift) & (cp)->set_mask)
@@ -256,6 +263,364 @@ update_way_list(struct cache_set_t *set,	/* set contained way chain */
     panic("bogus WHERE designator");
 }
 
+/* way of SET holding TAG in the array layout, -1 if none */
+static int
+array_find_way(struct cache_t *cp,		/* cache to search */
+	       struct cache_set_t *set,		/* set to search */
+	       md_addr_t tag)			/* tag to find */
+{
+  md_addr_t *tags = set->tags;
+  int way;
+
+#ifdef CACHE_SIMD_TAGS
+  if ((cp->assoc & 3) == 0)
+    {
+      __m128i key = _mm_set1_epi32((int)tag);
+
+      for (way=0; way < cp->assoc; way += 4)
+	{
+	  __m128i eq = _mm_cmpeq_epi32(_mm_loadu_si128((__m128i *)&tags[way]),
+				       key);
+	  int mask = _mm_movemask_ps(_mm_castsi128_ps(eq));
+
+	  if (mask)
+	    return way + __builtin_ctz(mask);
+	}
+      return -1;
+    }
+#endif /* CACHE_SIMD_TAGS */
+
+  for (way=0; way < cp->assoc; way++)
+    {
+      if (tags[way] == tag)
+	return way;
+    }
+  return -1;
+}
+
+/* make WAY the most recently used block of SET in the array layout */
+static void
+array_touch(struct cache_t *cp,			/* cache to update */
+	    struct cache_set_t *set,		/* set containing the way */
+	    int way)				/* way accessed */
+{
+  byte_t *ages = set->ages;
+  int i, age = ages[way];
+
+  /* blocks more recent than WAY age by one */
+  for (i=0; i < cp->assoc; i++)
+    ages[i] += (ages[i] < age);
+  ages[way] = 0;
+}
+
+/* make WAY the least recently used block of SET in the array layout */
+static void
+array_demote(struct cache_t *cp,		/* cache to update */
+	     struct cache_set_t *set,		/* set containing the way */
+	     int way)				/* way to demote */
+{
+  byte_t *ages = set->ages;
+  int i, age = ages[way];
+
+  /* blocks less recent than WAY get younger by one */
+  for (i=0; i < cp->assoc; i++)
+    ages[i] -= (ages[i] > age);
+  ages[way] = cp->assoc - 1;
+}
+
+/* least recently used way of SET in the array layout */
+static int
+array_lru_way(struct cache_t *cp,		/* cache to search */
+	      struct cache_set_t *set)		/* set to search */
+{
+  byte_t *ages = set->ages;
+  int way;
+
+  for (way=0; ages[way] != cp->assoc - 1; way++)
+    /* nada */;
+  return way;
+}
+
+/* way of block BLK in the set whose blocks start at BLKS */
+#define CACHE_BWAY(cp, blks, blk)					\
+  ((int)(((char *)(blk) - (char *)(blks)) /				\
+	 (sizeof(struct cache_blk_t) +					\
+	  ((cp)->balloc ? (cp)->bsize*sizeof(byte_t) : 0))))
+
+/* policy state of WAY of SET */
+#define CACHE_REPL_STATE(cp, set, way)					\
+  ((cp)->repl_state[(set)*(cp)->assoc + (way)])
+
+/*
+ * replacement policies, each a set of cache_repl_t hooks
+ */
+
+/* no policy state to set up or update */
+static void
+repl_no_init(struct cache_t *cp)
+{
+  /* nada */
+}
+
+static void
+repl_no_update(struct cache_t *cp, md_addr_t set, int way, int prefetch)
+{
+  /* nada */
+}
+
+/* an invalid way of SET, -1 if all ways are valid */
+static int
+repl_invalid_way(struct cache_t *cp,		/* cache to search */
+		 md_addr_t set)			/* set to search */
+{
+  int way;
+
+  for (way=0; way < cp->assoc; way++)
+    {
+      if (cp->tags
+	  ? cp->sets[set].tags[way] == CACHE_TAG_INVALID
+	  : !(CACHE_BINDEX(cp, cp->sets[set].blks, way)->status
+	      & CACHE_BLK_VALID))
+	return way;
+    }
+  return -1;
+}
+
+/* LRU, FIFO and Random keep the blocks of a set in order, in the way list
+   or in the array layout ages, the least recently used (or oldest) last */
+
+/* last way in the order of SET */
+static int
+order_victim(struct cache_t *cp, md_addr_t set)
+{
+  if (cp->tags)
+    return array_lru_way(cp, &cp->sets[set]);
+  else
+    return CACHE_BWAY(cp, cp->sets[set].blks, cp->sets[set].way_tail);
+}
+
+/* move WAY of SET to the front of the order */
+static void
+order_touch(struct cache_t *cp, md_addr_t set, int way, int prefetch)
+{
+  if (cp->tags)
+    array_touch(cp, &cp->sets[set], way);
+  else
+    update_way_list(&cp->sets[set],
+		    CACHE_BINDEX(cp, cp->sets[set].blks, way), Head);
+}
+
+/* move WAY of SET to the back of the order */
+static void
+order_demote(struct cache_t *cp, md_addr_t set, int way)
+{
+  if (cp->tags)
+    array_demote(cp, &cp->sets[set], way);
+  else
+    update_way_list(&cp->sets[set],
+		    CACHE_BINDEX(cp, cp->sets[set].blks, way), Tail);
+}
+
+/* any way of SET */
+static int
+random_victim(struct cache_t *cp, md_addr_t set)
+{
+  return myrand() & (cp->assoc - 1);
+}
+
+/* prefetch-aware LRU: a prefetched block goes in least recently used, so it
+   is the next replaced unless a demand access uses it first */
+static void
+pref_lru_hit(struct cache_t *cp, md_addr_t set, int way, int prefetch)
+{
+  if (!prefetch)
+    order_touch(cp, set, way, prefetch);
+}
+
+static void
+pref_lru_fill(struct cache_t *cp, md_addr_t set, int way, int prefetch)
+{
+  if (prefetch)
+    order_demote(cp, set, way);
+  else
+    order_touch(cp, set, way, prefetch);
+}
+
+/* RRIP keeps a re-reference prediction value (RRPV) per block, replaces a
+   block predicted to be re-referenced in the distant future (the largest
+   RRPV), aging the set until there is one, and predicts a near re-reference
+   (RRPV 0) on a hit; NRU is the same with one bit RRPVs */
+
+static void
+rrip_init(struct cache_t *cp)
+{
+  int i, nleaders;
+
+  cp->rrpv_max = (cp->policy == NRU) ? 1 : CACHE_RRPV_MAX;
+  for (i=0; i < cp->nsets * cp->assoc; i++)
+    cp->repl_state[i] = cp->rrpv_max;
+
+  /* DRRIP leader sets of each policy, up to CACHE_DUEL_LEADERS but at
+     most a quarter of the sets, none with fewer than four sets */
+  nleaders = MIN(CACHE_DUEL_LEADERS, cp->nsets / 4);
+  cp->duel_stride = nleaders ? cp->nsets / nleaders : 0;
+  cp->psel = CACHE_PSEL_MAX / 2;
+  cp->bip_fills = 0;
+}
+
+static int
+rrip_victim(struct cache_t *cp, md_addr_t set)
+{
+  byte_t *rrpv = &CACHE_REPL_STATE(cp, set, 0);
+  int way, victim, age;
+
+  /* fill invalid blocks first */
+  victim = repl_invalid_way(cp, set);
+  if (victim >= 0)
+    return victim;
+
+  /* the first block with the largest RRPV, aged to the distant RRPV */
+  for (victim=0, way=1; way < cp->assoc; way++)
+    {
+      if (rrpv[way] > rrpv[victim])
+	victim = way;
+    }
+  age = cp->rrpv_max - rrpv[victim];
+  if (age)
+    {
+      for (way=0; way < cp->assoc; way++)
+	rrpv[way] += age;
+    }
+  return victim;
+}
+
+static void
+rrip_hit(struct cache_t *cp, md_addr_t set, int way, int prefetch)
+{
+  CACHE_REPL_STATE(cp, set, way) = 0;
+}
+
+static void
+rrip_demote(struct cache_t *cp, md_addr_t set, int way)
+{
+  CACHE_REPL_STATE(cp, set, way) = cp->rrpv_max;
+}
+
+/* SRRIP inserts with a long re-reference interval */
+static void
+srrip_fill(struct cache_t *cp, md_addr_t set, int way, int prefetch)
+{
+  CACHE_REPL_STATE(cp, set, way) = cp->rrpv_max - 1;
+}
+
+/* BRRIP inserts distant, except every 32nd fill long, so it keeps part of
+   a working set larger than the cache */
+static void
+brrip_fill(struct cache_t *cp, md_addr_t set, int way, int prefetch)
+{
+  CACHE_REPL_STATE(cp, set, way) =
+    ((cp->bip_fills++ & 31) == 0) ? cp->rrpv_max - 1 : cp->rrpv_max;
+}
+
+/* DRRIP leader sets always use SRRIP or BRRIP, their demand misses steer
+   PSEL, the other sets follow the leaders with fewer misses */
+static void
+drrip_fill(struct cache_t *cp, md_addr_t set, int way, int prefetch)
+{
+  int bimodal;
+
+  if (cp->duel_stride && (set % cp->duel_stride) == 0)
+    {
+      /* SRRIP leader */
+      if (!prefetch && cp->psel < CACHE_PSEL_MAX)
+	cp->psel++;
+      bimodal = FALSE;
+    }
+  else if (cp->duel_stride && (set % cp->duel_stride) == cp->duel_stride/2)
+    {
+      /* BRRIP leader */
+      if (!prefetch && cp->psel > 0)
+	cp->psel--;
+      bimodal = TRUE;
+    }
+  else
+    bimodal = (cp->psel > CACHE_PSEL_MAX / 2);
+
+  if (bimodal)
+    brrip_fill(cp, set, way, prefetch);
+  else
+    srrip_fill(cp, set, way, prefetch);
+}
+
+/* tree-PLRU keeps ASSOC-1 bits per set in a binary tree over the ways,
+   each bit points at the half of its subtree to replace next */
+
+static void
+plru_init(struct cache_t *cp)
+{
+  int i;
+
+  for (i=0; i < cp->nsets * cp->assoc; i++)
+    cp->repl_state[i] = 0;
+}
+
+static int
+plru_victim(struct cache_t *cp, md_addr_t set)
+{
+  byte_t *tree = &CACHE_REPL_STATE(cp, set, 0);
+  int node, victim;
+
+  /* fill invalid blocks first */
+  victim = repl_invalid_way(cp, set);
+  if (victim >= 0)
+    return victim;
+
+  /* follow the bits from the root to a leaf */
+  for (node=1; node < cp->assoc; node = 2*node + tree[node])
+    /* nada */;
+  return node - cp->assoc;
+}
+
+/* point the bits on the path to WAY away from it */
+static void
+plru_touch(struct cache_t *cp, md_addr_t set, int way, int prefetch)
+{
+  byte_t *tree = &CACHE_REPL_STATE(cp, set, 0);
+  int node;
+
+  for (node = way + cp->assoc; node > 1; node >>= 1)
+    tree[node >> 1] = !(node & 1);
+}
+
+/* point the bits on the path to WAY at it */
+static void
+plru_demote(struct cache_t *cp, md_addr_t set, int way)
+{
+  byte_t *tree = &CACHE_REPL_STATE(cp, set, 0);
+  int node;
+
+  for (node = way + cp->assoc; node > 1; node >>= 1)
+    tree[node >> 1] = (node & 1);
+}
+
+/* replacement policy hooks, in enum cache_policy order */
+static const struct cache_repl_t cache_repls[] = {
+  { "LRU", repl_no_init, order_victim, order_touch, order_touch,
+    order_demote },
+  { "Random", repl_no_init, random_victim, repl_no_update, repl_no_update,
+    order_demote },
+  { "FIFO", repl_no_init, order_victim, repl_no_update, order_touch,
+    order_demote },
+  { "NRU", rrip_init, rrip_victim, rrip_hit, rrip_hit, rrip_demote },
+  { "tree-PLRU", plru_init, plru_victim, plru_touch, plru_touch,
+    plru_demote },
+  { "SRRIP", rrip_init, rrip_victim, rrip_hit, srrip_fill, rrip_demote },
+  { "BRRIP", rrip_init, rrip_victim, rrip_hit, brrip_fill, rrip_demote },
+  { "DRRIP", rrip_init, rrip_victim, rrip_hit, drrip_fill, rrip_demote },
+  { "prefetch-aware LRU", repl_no_init, order_victim, pref_lru_hit,
+    pref_lru_fill, order_demote }
+};
+
 /* create and initialize a general cache structure */
 struct cache_t *			/* pointer to cache created */
 cache_create(char *name,		/* name of the cache */
@@ -271,10 +636,13 @@ cache_create(char *name,		/* name of the cache */
 					   struct cache_blk_t *blk,
 					   tick_t now, int prefetch),
 	     unsigned int hit_latency,	/* latency in cycles for a hit */
-	     int prefetch_type)		/* prefetcher type */
+	     char *prefetch,		/* prefetcher types, see cache.h */
+	     enum cache_layout layout)	/* tag store layout */
 {
   struct cache_t *cp;
   struct cache_blk_t *blk;
+  struct cache_prefetcher_t *pf, **pf_tail;
+  char *p;
   int i, j, bindex;
 
   /* check all cache parameters */
@@ -295,8 +663,9 @@ cache_create(char *name,		/* name of the cache */
     fatal("cache associativity `%d' must be a power of two", assoc);
   if (!blk_access_fn)
     fatal("must specify miss/replacement functions");
-  if (prefetch_type < 0)
-    fatal("prefetcher type `%d'must be a positive number", prefetch_type);
+  if (layout == Arrays && assoc > CACHE_MAX_ARRAY_ASSOC)
+    fatal("cache associativity `%d' must be %d or less in the array layout",
+	  assoc, CACHE_MAX_ARRAY_ASSOC);
 
   /* allocate the cache structure */
   cp = (struct cache_t *)
@@ -312,14 +681,39 @@ cache_create(char *name,		/* name of the cache */
   cp->usize = usize;
   cp->assoc = assoc;
   cp->policy = policy;
+  cp->repl = &cache_repls[policy];
+  cp->layout = layout;
   cp->hit_latency = hit_latency;
-  cp->prefetch_type = prefetch_type;
+
+  /* create the prefetchers, in the order they observe accesses */
+  cp->prefetchers = NULL;
+  for (p = prefetch, pf_tail = &cp->prefetchers; p; )
+    {
+      char *end;
+      long type = strtol(p, &end, 10);
+
+      if (end == p || type < 0 || type > INT_MAX
+	  || (*end != '\0' && *end != '+'))
+	fatal("bogus prefetcher list `%s', e.g., `0', `1' or `2+16'",
+	      prefetch);
+      if (type)
+	{
+	  for (pf=cp->prefetchers; pf; pf=pf->next)
+	    {
+	      if (pf->type == type)
+		fatal("prefetcher type `%ld' given twice", type);
+	    }
+	  *pf_tail = cache_prefetcher_create(type);
+	  pf_tail = &(*pf_tail)->next;
+	}
+      p = (*end == '+') ? end + 1 : NULL;
+    }
 
   /* miss/replacement functions */
   cp->blk_access_fn = blk_access_fn;
 
   /* compute derived parameters */
-  cp->hsize = CACHE_HIGHLY_ASSOC(cp) ? (assoc >> 2) : 0;
+  cp->hsize = (layout == Linked && CACHE_HIGHLY_ASSOC(cp)) ? (assoc >> 2) : 0;
   cp->blk_mask = bsize-1;
   cp->set_shift = log_base2(bsize);
   cp->set_mask = nsets-1;
@@ -347,6 +741,10 @@ cache_create(char *name,		/* name of the cache */
   cp->read_misses = 0;
   cp->prefetch_hits = 0;
   cp->prefetch_misses = 0;
+  cp->prefetch_useful = 0;
+  cp->prefetch_late = 0;
+  cp->prefetch_unused = 0;
+  cp->prefetch_pollution = 0;
 
   /* blow away the last block accessed */
   cp->last_tagset = 0;
@@ -359,6 +757,30 @@ cache_create(char *name,		/* name of the cache */
   if (!cp->data)
     fatal("out of virtual memory");
 
+  /* allocate the array layout tags and ages */
+  if (layout == Arrays)
+    {
+      cp->tags = (md_addr_t *)calloc(nsets * assoc, sizeof(md_addr_t));
+      cp->ages = (byte_t *)calloc(nsets * assoc, sizeof(byte_t));
+      if (!cp->tags || !cp->ages)
+	fatal("out of virtual memory");
+    }
+
+  /* allocate the prefetch victim tags, ASSOC per set */
+  if (cp->prefetchers)
+    {
+      cp->pf_victims = (md_addr_t *)malloc(nsets * assoc * sizeof(md_addr_t));
+      if (!cp->pf_victims)
+	fatal("out of virtual memory");
+      for (i=0; i < nsets * assoc; i++)
+	cp->pf_victims[i] = CACHE_TAG_INVALID;
+    }
+
+  /* allocate the replacement policy state */
+  cp->repl_state = (byte_t *)calloc(nsets * assoc, sizeof(byte_t));
+  if (!cp->repl_state)
+    fatal("out of virtual memory");
+
   /* slice up the data blocks */
   for (bindex=0,i=0; i<nsets; i++)
     {
@@ -378,6 +800,11 @@ cache_create(char *name,		/* name of the cache */
 	 otherwise, block accesses through SET->BLKS will fail (used
 	 during random replacement selection) */
       cp->sets[i].blks = CACHE_BINDEX(cp, cp->data, bindex);
+      if (cp->tags)
+	{
+	  cp->sets[i].tags = &cp->tags[i * assoc];
+	  cp->sets[i].ages = &cp->ages[i * assoc];
+	}
       
       /* link the data blocks into ordered way chain and hash table bucket
          chains, if hash table exists */
@@ -406,8 +833,19 @@ cache_create(char *name,		/* name of the cache */
 	  cp->sets[i].way_head = blk;
 	  if (!cp->sets[i].way_tail)
 	    cp->sets[i].way_tail = blk;
+
+	  /* same order in the array layout, the last block is the MRU */
+	  if (cp->tags)
+	    {
+	      cp->sets[i].tags[j] = CACHE_TAG_INVALID;
+	      cp->sets[i].ages[j] = assoc - 1 - j;
+	    }
 	}
     }
+
+  /* set up the replacement policy state */
+  cp->repl->init(cp);
+
   return cp;
 }
 
@@ -419,26 +857,47 @@ cache_char2policy(char c)		/* replacement policy as a char */
   case 'l': return LRU;
   case 'r': return Random;
   case 'f': return FIFO;
+  case 'n': return NRU;
+  case 'p': return PLRU;
+  case 's': return SRRIP;
+  case 'b': return BRRIP;
+  case 'd': return DRRIP;
+  case 'a': return PrefLRU;
   default: fatal("bogus replacement policy, `%c'", c);
   }
 }
 
+/* parse tag store layout */
+enum cache_layout			/* tag store layout enum */
+cache_str2layout(char *s)		/* layout name, `linked' or `arrays' */
+{
+  if (!mystricmp(s, "linked"))
+    return Linked;
+  else if (!mystricmp(s, "arrays"))
+    return Arrays;
+  else
+    fatal("bogus cache tag store layout, `%s'", s);
+}
+
 /* print cache configuration */
 void
 cache_config(struct cache_t *cp,	/* cache instance */
 	     FILE *stream)		/* output stream */
 {
+  struct cache_prefetcher_t *pf;
+
   fprintf(stream,
 	  "cache: %s: %d sets, %d byte blocks, %d bytes user data/block\n",
 	  cp->name, cp->nsets, cp->bsize, cp->usize);
   fprintf(stream,
-	  "cache: %s: %d-way, `%s' replacement policy, write-back, %d prefetcher type\n",
-	  cp->name, cp->assoc,
-	  cp->policy == LRU ? "LRU"
-	  : cp->policy == Random ? "Random"
-	  : cp->policy == FIFO ? "FIFO"
-	  : (abort(), ""),
-	  cp->prefetch_type);
+	  "cache: %s: %d-way, `%s' replacement policy, write-back\n",
+	  cp->name, cp->assoc, cp->repl->name);
+  fprintf(stream, "cache: %s: prefetchers:", cp->name);
+  for (pf=cp->prefetchers; pf; pf=pf->next)
+    fprintf(stream, " %s", pf->name);
+  fprintf(stream, "%s\n", cp->prefetchers ? "" : " none");
+  fprintf(stream, "cache: %s: %s tag store\n",
+	  cp->name, cp->layout == Arrays ? "array" : "linked");
 }
 
 /* register cache stats */
@@ -447,6 +906,7 @@ cache_reg_stats(struct cache_t *cp,	/* cache instance */
 		struct stat_sdb_t *sdb)	/* stats database */
 {
   char buf[512], buf1[512], *name;
+  struct cache_prefetcher_t *pf;
 
   /* get a name for this cache */
   if (!cp->name || !cp->name[0])
@@ -501,24 +961,64 @@ cache_reg_stats(struct cache_t *cp,	/* cache instance */
   stat_reg_counter(sdb, buf, "total number of prefetch hits", &cp->prefetch_hits, 0, NULL);
   sprintf(buf, "%s.prefetch_misses", name);
   stat_reg_counter(sdb, buf, "total number of prefetch misses", &cp->prefetch_misses, 0, NULL);
-
+  sprintf(buf, "%s.prefetch_useful", name);
+  stat_reg_counter(sdb, buf, "prefetched blocks hit by a demand access",
+		   &cp->prefetch_useful, 0, NULL);
+  sprintf(buf, "%s.prefetch_late", name);
+  stat_reg_counter(sdb, buf, "useful prefetches hit before their fill",
+		   &cp->prefetch_late, 0, NULL);
+  sprintf(buf, "%s.prefetch_unused", name);
+  stat_reg_counter(sdb, buf, "prefetched blocks replaced unused",
+		   &cp->prefetch_unused, 0, NULL);
+  sprintf(buf, "%s.prefetch_pollution", name);
+  stat_reg_counter(sdb, buf,
+		   "demand misses to the last ASSOC blocks per set replaced by prefetches",
+		   &cp->prefetch_pollution, 0, NULL);
+  sprintf(buf, "%s.prefetch_accuracy", name);
+  sprintf(buf1, "%s.prefetch_useful / %s.prefetch_misses", name, name);
+  stat_reg_formula(sdb, buf, "useful prefetches per prefetch fill", buf1, NULL);
+  sprintf(buf, "%s.prefetch_coverage", name);
+  sprintf(buf1, "%s.prefetch_useful / (%s.prefetch_useful + %s.misses)",
+	  name, name, name);
+  stat_reg_formula(sdb, buf, "demand misses removed by prefetching",
+		   buf1, NULL);
+  sprintf(buf, "%s.prefetch_late_rate", name);
+  sprintf(buf1, "%s.prefetch_late / %s.prefetch_useful", name, name);
+  stat_reg_formula(sdb, buf, "late prefetches per useful prefetch",
+		   buf1, NULL);
+
+  /* per prefetcher stats */
+  for (pf=cp->prefetchers; pf; pf=pf->next)
+    {
+      sprintf(buf, "%s.%s.issued", name, pf->name);
+      stat_reg_counter(sdb, buf, "prefetches issued by this prefetcher",
+		       &pf->issued, 0, NULL);
+      pf->reg_stats(pf, cp, sdb);
+    }
 
 }
 
 /* ECE552 Assignment 4 - BEGIN CODE*/
 md_addr_t get_PC();
 
-/* Next Line Prefetcher */
-void next_line_prefetcher(struct cache_t *cp, md_addr_t addr) {
-  // prefetch request to memory address ADDR + cache_line_size
-  md_addr_t next_addr = addr + cp->bsize;
-  next_addr = CACHE_BADDR(cp, next_addr); // start at line addr
+/* prefetch the block at ADDR into CP at NOW for prefetcher PF, unless the
+   block is already in the cache */
+static void issue_prefetch(struct cache_prefetcher_t *pf, struct cache_t *cp,
+                           md_addr_t addr, tick_t now) {
+  addr = CACHE_BADDR(cp, addr); // start at line addr
 
   // skip if already in cache
-  if(cache_probe(cp, next_addr)) return;
-  
-  // prefetch
-  cache_access(cp, Read, next_addr, NULL, cp->bsize, 0, NULL, NULL, 1);
+  if (cache_probe(cp, addr)) return;
+
+  pf->issued++;
+  cache_access(cp, Read, addr, NULL, cp->bsize, now, NULL, NULL, 1);
+}
+
+/* Next Line Prefetcher */
+static void next_line_prefetcher(struct cache_prefetcher_t *pf, struct cache_t *cp,
+                                 md_addr_t addr, tick_t now) {
+  // prefetch request to memory address ADDR + cache_line_size
+  issue_prefetch(pf, cp, addr + cp->bsize, now);
 }
 
 /* Stride Prefetcher Variables: */
@@ -538,32 +1038,26 @@ typedef struct {
   enum RPTState state;  // 2-bit encoding (4 states) of the past history
 } RPTEntry;
 
-RPTEntry* RPT;
-int rpt_size;
+typedef struct {
+  RPTEntry* RPT;              // Reference Prediction Table
+  int rpt_size;               // RPT entries, the prefetcher type
+  counter_t rpt_hits;         // accesses whose PC was in the RPT
+} StridePrefetcher;
 
 /* Stride Prefetcher */
-void stride_prefetcher(struct cache_t *cp, md_addr_t addr) {
-  /* Initialize RPT if does not exist yet: */
-  if (RPT == NULL) {
-    rpt_size = cp->prefetch_type;
-    RPT = (RPTEntry*)malloc(rpt_size*sizeof(RPTEntry));
-
-    for (int i = 0; i < rpt_size; i++) {
-      RPT[i].prev_addr = 0;
-      RPT[i].state = INIT;
-      RPT[i].tag = 0;
-      RPT[i].stride = 0;
-    }
-  }
-
+static void stride_prefetcher(struct cache_prefetcher_t *pf, struct cache_t *cp,
+                              md_addr_t addr, tick_t now) {
+  StridePrefetcher* sp = (StridePrefetcher*)pf->state;
   md_addr_t PC = get_PC();
-  unsigned int index = (PC >> 3) % rpt_size; // The last 3 bits of PC are always 0
-  RPTEntry* entry = &RPT[index];
+  unsigned int index = (PC >> 3) % sp->rpt_size; // The last 3 bits of PC are always 0
+  RPTEntry* entry = &sp->RPT[index];
 
   if (PC == entry->tag) {
     long long stride = (long long)addr - (long long)entry->prev_addr;
     int state = entry->state;
 
+    sp->rpt_hits++;
+
     switch (state) {
       case INIT:
         if (stride == entry->stride) {
@@ -601,13 +1095,7 @@ void stride_prefetcher(struct cache_t *cp, md_addr_t addr) {
 
     /* Prefetch if state is in INIT, TRANSIENT, or STEADY: */
     if (entry->state == INIT ||entry->state == TRANSIENT || entry->state == STEADY ) {
-      md_addr_t fetch_address = addr + entry->stride;
-      fetch_address = CACHE_BADDR(cp, fetch_address);
-
-      /* Prefetch cache if the fetch_address is not in cache: */
-      if (cache_probe(cp, fetch_address) == 0) {
-        cache_access(cp, Read, fetch_address, NULL, cp->bsize, 0, NULL, NULL, 1);
-      }
+      issue_prefetch(pf, cp, addr + entry->stride, now);
     }
   } else {
     /* RPT entry doesn't exist yet, update tag and prev_addr: */
@@ -632,12 +1120,14 @@ typedef struct {
   md_addr_t addr_history[HISTORY_BITS]; 
   int history_idx;                    
 } PerceptronEntry;
-/* Perceptron Learning Table (PLT): */
-PerceptronEntry PLT[TABLE_SIZE];
-int open_ended_init = 0;
+
+typedef struct {
+  PerceptronEntry PLT[TABLE_SIZE];  // Perceptron Learning Table (PLT)
+  counter_t confident;              // accesses with a confident stride
+} OpenEndedPrefetcher;
 
 /* Helper function that detects if there is a stride pattern */
-int detect_stride(PerceptronEntry *entry, md_addr_t addr) {
+static int detect_stride(PerceptronEntry *entry, md_addr_t addr) {
   /* If there is not enough history: */
   if (entry->history_idx < 2) {
     return 0; 
@@ -658,7 +1148,7 @@ int detect_stride(PerceptronEntry *entry, md_addr_t addr) {
 } 
 
 /* Helper function to calculate prefetch aggressiveness */
-int calculate_degree(PerceptronEntry *entry) {
+static int calculate_degree(PerceptronEntry *entry) {
   if (entry->confidence < THETA) {
     return 1;
   }
@@ -675,27 +1165,12 @@ int calculate_degree(PerceptronEntry *entry) {
 }
 
 /* Open Ended Prefetcher */
-void open_ended_prefetcher(struct cache_t *cp, md_addr_t addr) {
-  /* Initialize if we have not done this before: */
-  if (!open_ended_init) {
-    for (int i = 0; i < TABLE_SIZE; i++) {
-      PLT[i].pc = 0;
-      PLT[i].last_addr = 0;
-      PLT[i].stride = 0;
-      PLT[i].confidence = 0;
-      PLT[i].history_idx = 0;
-
-      for (int j = 0; j < HISTORY_BITS; j++) {
-        PLT[i].addr_history[j] = 0;
-      }
-    }
-
-    open_ended_init = 1;
-  }
-  
+static void open_ended_prefetcher(struct cache_prefetcher_t *pf, struct cache_t *cp,
+                                  md_addr_t addr, tick_t now) {
+  OpenEndedPrefetcher* op = (OpenEndedPrefetcher*)pf->state;
   md_addr_t PC = get_PC();
   unsigned int index = (PC >> 3) & (TABLE_SIZE - 1);
-  PerceptronEntry *entry = &PLT[index];
+  PerceptronEntry *entry = &op->PLT[index];
   
   /* If the PC is different from the previous PC, reset the entry: */
   if (entry->pc != PC) {
@@ -733,6 +1208,8 @@ void open_ended_prefetcher(struct cache_t *cp, md_addr_t addr) {
   if (entry->confidence >= THETA && entry->stride != 0) {
     int degree = calculate_degree(entry);
     degree = (degree > MAX_PREFETCH_DEGREE) ? MAX_PREFETCH_DEGREE : degree;
+
+    op->confident++;
     
     /* Adjust the stride by the block size: */
     int stride = entry->stride;
@@ -742,13 +1219,7 @@ void open_ended_prefetcher(struct cache_t *cp, md_addr_t addr) {
     
     /* Issue prefetches: */
     for (int i = 1; i <= degree; i++) {
-      md_addr_t fetch_address = addr + i * stride;
-      fetch_address = CACHE_BADDR(cp, fetch_address);
-      
-      /* If the address is not in cache, issue prefetch: */
-      if (cache_probe(cp, fetch_address) == 0) {
-        cache_access(cp, Read, fetch_address, NULL, cp->bsize, 0, NULL, NULL, 1);
-      }
+      issue_prefetch(pf, cp, addr + i * stride, now);
     }
   }
   
@@ -756,28 +1227,103 @@ void open_ended_prefetcher(struct cache_t *cp, md_addr_t addr) {
 }
 /* ECE552 Assignment 4 - END CODE*/
 
+/* prefetcher-specific stats */
+static void
+no_pf_stats(struct cache_prefetcher_t *pf,	/* prefetcher instance */
+	    struct cache_t *cp,			/* cache prefetched into */
+	    struct stat_sdb_t *sdb)		/* stats database */
+{
+  /* nada */
+}
 
-/* cache x might generate a prefetch after a regular cache access to address addr */
-void generate_prefetch(struct cache_t *cp, md_addr_t addr) {
-
-	switch(cp->prefetch_type) {
-		case 0:
-		   // prefetching is not enabled;
-		   // do nothing
-		   break;
-		case 1:
-		   // Next Line Prefetcher
-		   next_line_prefetcher(cp, addr);
-		   break;
-		case 2:
-		   // Open Ended Prefetcher
-		   open_ended_prefetcher(cp, addr);
-		   break;
-		default:
-		   // Stride Prefetcher with cp->prefetch_type number of entries in the Reference Prediction Table (RPT)
-		   stride_prefetcher(cp, addr);
-	}
+static void
+stride_pf_stats(struct cache_prefetcher_t *pf,	/* prefetcher instance */
+		struct cache_t *cp,		/* cache prefetched into */
+		struct stat_sdb_t *sdb)		/* stats database */
+{
+  char buf[512];
+  StridePrefetcher *sp = (StridePrefetcher *)pf->state;
+
+  sprintf(buf, "%s.%s.rpt_hits", cp->name, pf->name);
+  stat_reg_counter(sdb, buf, "accesses whose PC was in the RPT",
+		   &sp->rpt_hits, 0, NULL);
+}
 
+static void
+open_ended_pf_stats(struct cache_prefetcher_t *pf,/* prefetcher instance */
+		    struct cache_t *cp,		/* cache prefetched into */
+		    struct stat_sdb_t *sdb)	/* stats database */
+{
+  char buf[512];
+  OpenEndedPrefetcher *op = (OpenEndedPrefetcher *)pf->state;
+
+  sprintf(buf, "%s.%s.confident", cp->name, pf->name);
+  stat_reg_counter(sdb, buf, "accesses with a confident stride",
+		   &op->confident, 0, NULL);
+}
+
+/* create a prefetcher of type TYPE, 1 is next line, 2 is open-ended, any
+   larger type is a stride prefetcher with that many RPT entries */
+struct cache_prefetcher_t *		/* pointer to prefetcher created */
+cache_prefetcher_create(int type)	/* prefetcher type */
+{
+  struct cache_prefetcher_t *pf;
+  char name[128];
+
+  if (type <= 0)
+    fatal("prefetcher type `%d' must be a positive number", type);
+
+  pf = (struct cache_prefetcher_t *)calloc(1, sizeof(struct cache_prefetcher_t));
+  if (!pf)
+    fatal("out of virtual memory");
+  pf->type = type;
+
+  switch (type)
+    {
+    case 1:
+      pf->name = mystrdup("next_line");
+      pf->access = next_line_prefetcher;
+      pf->reg_stats = no_pf_stats;
+      break;
+    case 2:
+      pf->name = mystrdup("open_ended");
+      pf->state = calloc(1, sizeof(OpenEndedPrefetcher));
+      if (!pf->state)
+	fatal("out of virtual memory");
+      pf->access = open_ended_prefetcher;
+      pf->reg_stats = open_ended_pf_stats;
+      break;
+    default:
+      {
+	StridePrefetcher *sp;
+
+	sprintf(name, "stride%d", type);
+	pf->name = mystrdup(name);
+	sp = (StridePrefetcher *)calloc(1, sizeof(StridePrefetcher));
+	if (!sp)
+	  fatal("out of virtual memory");
+
+	/* RPT entries start out INIT with no tag, prev_addr or stride */
+	sp->rpt_size = type;
+	sp->RPT = (RPTEntry *)calloc(type, sizeof(RPTEntry));
+	if (!sp->RPT)
+	  fatal("out of virtual memory");
+	pf->state = sp;
+	pf->access = stride_prefetcher;
+	pf->reg_stats = stride_pf_stats;
+      }
+    }
+
+  return pf;
+}
+
+/* cache x might generate a prefetch after a regular cache access to address addr,
+   each prefetcher of the cache observes the access in turn */
+void generate_prefetch(struct cache_t *cp, md_addr_t addr, tick_t now) {
+	struct cache_prefetcher_t *pf;
+
+	for (pf = cp->prefetchers; pf; pf = pf->next)
+		pf->access(pf, cp, addr, now);
 }
 
 /* print cache stats */
@@ -819,7 +1365,7 @@ cache_access(struct cache_t *cp,	/* cache to access */
   md_addr_t set = CACHE_SET(cp, addr);
   md_addr_t bofs = CACHE_BLK(cp, addr);
   struct cache_blk_t *blk, *repl;
-  int lat = 0;
+  int i, way = -1, lat = 0;
 
   /* default replacement address */
   if (repl_addr)
@@ -845,7 +1391,17 @@ cache_access(struct cache_t *cp,	/* cache to access */
       goto cache_fast_hit;
     }
     
-  if (cp->hsize)
+  if (cp->tags)
+    {
+      /* array layout, compare the tags of the set at once */
+      way = array_find_way(cp, &cp->sets[set], tag);
+      if (way >= 0)
+	{
+	  blk = CACHE_BINDEX(cp, cp->sets[set].blks, way);
+	  goto cache_hit;
+	}
+    }
+  else if (cp->hsize)
     {
       /* higly-associativity cache, access through the per-set hash tables */
       int hindex = CACHE_HASH(cp, tag);
@@ -885,24 +1441,30 @@ cache_access(struct cache_t *cp,	/* cache to access */
      cp->prefetch_misses++;
   }
 
-
-  /* select the appropriate block to replace, and re-link this entry to
-     the appropriate place in the way list */
-  switch (cp->policy) {
-  case LRU:
-  case FIFO:
-    repl = cp->sets[set].way_tail;
-    update_way_list(&cp->sets[set], repl, Head);
-    break;
-  case Random:
+  /* a demand miss to a block a prefetch fill replaced is pollution, any
+     fill of the block takes it out of the prefetch victims */
+  if (cp->pf_victims)
     {
-      int bindex = myrand() & (cp->assoc - 1);
-      repl = CACHE_BINDEX(cp, cp->sets[set].blks, bindex);
+      md_addr_t *victims = &cp->pf_victims[set * cp->assoc];
+
+      for (i=0; i < cp->assoc; i++)
+	{
+	  if (victims[i] == tag)
+	    {
+	      if (prefetch == 0)
+		cp->prefetch_pollution++;
+	      victims[i] = CACHE_TAG_INVALID;
+	      break;
+	    }
+	}
     }
-    break;
-  default:
-    panic("bogus replacement policy");
-  }
+
+
+  /* select the appropriate block to replace, and update the replacement
+     state for the block filled in its place */
+  way = cp->repl->victim(cp, set);
+  repl = CACHE_BINDEX(cp, cp->sets[set].blks, way);
+  cp->repl->fill(cp, set, way, prefetch);
 
   /* remove this block from the hash bucket chain, if hash exists */
   if (cp->hsize)
@@ -919,6 +1481,19 @@ cache_access(struct cache_t *cp,	/* cache to access */
 
       if (repl_addr)
 	*repl_addr = CACHE_MK_BADDR(cp, repl->tag, set);
+
+      /* prefetched block never used, and blocks replaced by prefetches */
+      if (repl->status & CACHE_BLK_PREFETCHED)
+	cp->prefetch_unused++;
+      if (prefetch && cp->pf_victims)
+	{
+	  md_addr_t *victims = &cp->pf_victims[set * cp->assoc];
+
+	  /* most recent victim first, the oldest falls off the end */
+	  for (i=cp->assoc-1; i > 0; i--)
+	    victims[i] = victims[i-1];
+	  victims[0] = repl->tag;
+	}
  
       /* don't replace the block until outstanding misses are satisfied */
       lat += BOUND_POS(repl->ready - now);
@@ -942,6 +1517,10 @@ cache_access(struct cache_t *cp,	/* cache to access */
   /* update block tags */
   repl->tag = tag;
   repl->status = CACHE_BLK_VALID;	/* dirty bit set on update */
+  if (prefetch)
+    repl->status |= CACHE_BLK_PREFETCHED;
+  if (cp->tags)
+    cp->sets[set].tags[way] = tag;
 
   /* read data block */
   lat += cp->blk_access_fn(Read, CACHE_BADDR(cp, addr), cp->bsize,
@@ -969,7 +1548,7 @@ cache_access(struct cache_t *cp,	/* cache to access */
     link_htab_ent(cp, &cp->sets[set], repl);
 
   if (prefetch == 0) {	/* only regular cache accesses can generate a prefetch */
-  	generate_prefetch(cp, addr);
+  	generate_prefetch(cp, addr, now);
   }
 
   /* return latency of the operation */
@@ -986,6 +1565,17 @@ cache_access(struct cache_t *cp,	/* cache to access */
      if (cmd == Read) {	
 	   cp->read_hits++;
      }
+
+     /* first demand hit on a prefetched block, late if the prefetch fill
+	has not completed, fast hits never see prefetched blocks as only
+	slow demand hits record the last block */
+     if (blk->status & CACHE_BLK_PREFETCHED)
+       {
+	 cp->prefetch_useful++;
+	 if (blk->ready > now)
+	   cp->prefetch_late++;
+	 blk->status &= ~CACHE_BLK_PREFETCHED;
+       }
   }
   else {
      cp->prefetch_hits++;
@@ -1002,25 +1592,28 @@ cache_access(struct cache_t *cp,	/* cache to access */
   if (cmd == Write)
     blk->status |= CACHE_BLK_DIRTY;
 
-  /* if LRU replacement and this is not the first element of list, reorder */
-  if (blk->way_prev && cp->policy == LRU)
-    {
-      /* move this block to head of the way (MRU) list */
-      update_way_list(&cp->sets[set], blk, Head);
-    }
+  /* update the replacement state, e.g., move the block to the head of
+     the way (MRU) list under LRU */
+  if (way < 0)
+    way = CACHE_BWAY(cp, cp->sets[set].blks, blk);
+  cp->repl->hit(cp, set, way, prefetch);
 
   /* tag is unchanged, so hash links (if they exist) are still valid */
 
-  /* record the last block to hit */
-  cp->last_tagset = CACHE_TAGSET(cp, addr);
-  cp->last_blk = blk;
+  /* record the last block to hit, a fast hit makes no replacement update,
+     which a demand hit after a prefetch hit may need */
+  if (prefetch == 0)
+    {
+      cp->last_tagset = CACHE_TAGSET(cp, addr);
+      cp->last_blk = blk;
+    }
 
   /* get user block data, if requested and it exists */
   if (udata)
     *udata = blk->user_data;
 
   if (prefetch == 0) {	/* only regular cache accesses can generate a prefetch */
-	generate_prefetch(cp, addr);
+	generate_prefetch(cp, addr, now);
   }
 
 
@@ -1066,7 +1659,7 @@ cache_access(struct cache_t *cp,	/* cache to access */
   cp->last_blk = blk;
 
   if (prefetch == 0) {	/* only regular cache accesses can generate a prefetch */
-     generate_prefetch(cp, addr);
+     generate_prefetch(cp, addr, now);
   }
 
   /* return first cycle data is available to access */
@@ -1086,7 +1679,9 @@ cache_probe(struct cache_t *cp,		/* cache instance to probe */
 
   /* permissions are checked on cache misses */
 
-  if (cp->hsize)
+  if (cp->tags)
+    return array_find_way(cp, &cp->sets[set], tag) >= 0;
+  else if (cp->hsize)
   {
     /* higly-associativity cache, access through the per-set hash tables */
     int hindex = CACHE_HASH(cp, tag);
@@ -1130,6 +1725,13 @@ cache_flush(struct cache_t *cp,		/* cache instance to flush */
   /* no way list updates required because all blocks are being invalidated */
   for (i=0; i<cp->nsets; i++)
     {
+      if (cp->tags)
+	{
+	  int way;
+
+	  for (way=0; way < cp->assoc; way++)
+	    cp->sets[i].tags[way] = CACHE_TAG_INVALID;
+	}
 
       for (blk=cp->sets[i].way_head; blk; blk=blk->way_next)
 	{
@@ -1164,9 +1766,15 @@ cache_flush_addr(struct cache_t *cp,	/* cache instance to flush */
   md_addr_t tag = CACHE_TAG(cp, addr);
   md_addr_t set = CACHE_SET(cp, addr);
   struct cache_blk_t *blk;
-  int lat = cp->hit_latency; /* min latency to probe cache */
+  int way = -1, lat = cp->hit_latency; /* min latency to probe cache */
 
-  if (cp->hsize)
+  if (cp->tags)
+    {
+      /* array layout, compare the tags of the set at once */
+      way = array_find_way(cp, &cp->sets[set], tag);
+      blk = way >= 0 ? CACHE_BINDEX(cp, cp->sets[set].blks, way) : NULL;
+    }
+  else if (cp->hsize)
     {
       /* higly-associativity cache, access through the per-set hash tables */
       int hindex = CACHE_HASH(cp, tag);
@@ -1195,6 +1803,8 @@ cache_flush_addr(struct cache_t *cp,	/* cache instance to flush */
     {
       cp->invalidations++;
       blk->status &= ~CACHE_BLK_VALID;
+      if (cp->tags)
+	cp->sets[set].tags[way] = CACHE_TAG_INVALID;
 
       /* blow away the last block to hit */
       cp->last_tagset = 0;
@@ -1208,8 +1818,11 @@ cache_flush_addr(struct cache_t *cp,	/* cache instance to flush */
 				   CACHE_MK_BADDR(cp, blk->tag, set),
 				   cp->bsize, blk, now+lat, 0);
 	}
-      /* move this block to tail of the way (LRU) list */
-      update_way_list(&cp->sets[set], blk, Tail);
+      /* make this block the next replaced, e.g., move it to the tail of
+	 the way (LRU) list */
+      if (way < 0)
+	way = CACHE_BWAY(cp, cp->sets[set].blks, blk);
+      cp->repl->demote(cp, set, way);
     }
 
   /* return latency of the operation */
@@ -78,9 +78,14 @@
  * physical page address information, etc...
  *
  * The caches implemented by this module provide efficient storage management
- * and fast access for all cache geometries.  When sets become highly
- * associative, a hash table (indexed by address) is allocated for each set
- * in the cache.
+ * and fast access for all cache geometries.  The tag store has one of two
+ * layouts, chosen when the cache is created.  In the linked layout, blocks
+ * are found and ordered for replacement through a per-set list, and when
+ * sets become highly associative, a hash table (indexed by address) is
+ * allocated for each set in the cache.  In the array layout, each set keeps
+ * its tags and LRU ages in contiguous arrays, searched with SIMD compares
+ * where the host supports them, which is faster for large and associative
+ * caches.  Both layouts simulate exactly the same cache.
  *
  * This module also tracks latency of accessing the data cache, each cache has
  * a hit latency defined when instantiated, miss latency is returned by the
@@ -98,17 +103,68 @@
    speed block access, this macro decides if a cache is "highly associative" */
 #define CACHE_HIGHLY_ASSOC(cp)	((cp)->assoc > 4)
 
+/* cache tag store layout */
+enum cache_layout {
+  Linked,	/* way lists, and hash tables for highly associative sets */
+  Arrays	/* per-set tag and LRU age arrays */
+};
+
+/* largest associativity of the array layout, ages are one byte */
+#define CACHE_MAX_ARRAY_ASSOC	256
+
+/* array layout tag of an invalid block, no address has this tag */
+#define CACHE_TAG_INVALID	(~(md_addr_t)0)
+
 /* cache replacement policy */
 enum cache_policy {
   LRU,		/* replace least recently used block (perfect LRU) */
   Random,	/* replace a random block */
-  FIFO		/* replace the oldest block in the set */
+  FIFO,		/* replace the oldest block in the set */
+  NRU,		/* replace a block not recently used (one reference bit) */
+  PLRU,		/* replace the block a binary tree of bits points at */
+  SRRIP,	/* static re-reference interval prediction, insert long */
+  BRRIP,	/* bimodal RRIP, insert distant, long once in 32 fills */
+  DRRIP,	/* SRRIP or BRRIP, chosen by set dueling */
+  PrefLRU	/* LRU, prefetched blocks inserted least recently used */
+};
+
+/* RRIP re-reference prediction values are two bits, the largest is a
+   distant re-reference */
+#define CACHE_RRPV_MAX		3
+
+/* DRRIP dueling: leader sets per policy, and policy selector maximum */
+#define CACHE_DUEL_LEADERS	32
+#define CACHE_PSEL_MAX		1023
+
+struct cache_t;
+
+/* replacement policy hooks, one set for each cache_policy, blocks are
+   named by their set index and way in the set */
+struct cache_repl_t
+{
+  char *name;			/* policy name */
+
+  /* set up the policy state of a new cache */
+  void (*init)(struct cache_t *cp);
+
+  /* way of SET to replace on a miss */
+  int (*victim)(struct cache_t *cp, md_addr_t set);
+
+  /* update the policy state on a hit to WAY of SET, and on the fill of
+     WAY of SET after a miss, PREFETCH is non-zero for prefetch accesses */
+  void (*hit)(struct cache_t *cp, md_addr_t set, int way, int prefetch);
+  void (*fill)(struct cache_t *cp, md_addr_t set, int way, int prefetch);
+
+  /* make WAY of SET, just invalidated, the next to replace */
+  void (*demote)(struct cache_t *cp, md_addr_t set, int way);
 };
 
 
 /* block status values */
 #define CACHE_BLK_VALID		0x00000001	/* block in valid, in use */
 #define CACHE_BLK_DIRTY		0x00000002	/* dirty block */
+#define CACHE_BLK_PREFETCHED	0x00000004	/* filled by a prefetch, no
+						   demand access to it yet */
 
 /* cache block (or line) definition */
 struct cache_blk_t
@@ -123,7 +179,8 @@ struct cache_blk_t
   md_addr_t tag;		/* data block tag value */
   unsigned int status;		/* block status, see CACHE_BLK_* defs above */
   tick_t ready;		/* time when block will be accessible, field
-				   is set when a miss fetch is initiated */
+				   is set when a miss fetch is initiated, the
+				   fill time of a prefetched block */
   byte_t *user_data;		/* pointer to user defined data, e.g.,
 				   pre-decode data or physical page address */
   /* DATA should be pointer-aligned due to preceeding field */
@@ -144,6 +201,31 @@ struct cache_set_t
   struct cache_blk_t *blks;	/* cache blocks, allocated sequentially, so
 				   this pointer can also be used for random
 				   access to cache blocks */
+  md_addr_t *tags;		/* array layout: tag of each way, or
+				   CACHE_TAG_INVALID, NULL if linked */
+  byte_t *ages;			/* array layout: LRU age of each way, 0 is
+				   the most recently used */
+};
+
+/* a prefetcher of a cache, it observes the demand accesses of the cache
+   and prefetches into it, several prefetchers of a cache form a list and
+   observe each access in turn, each with its own tables */
+struct cache_prefetcher_t
+{
+  char *name;			/* prefetcher name, e.g., `stride16' */
+  int type;			/* prefetcher type, as in <pref> */
+  void *state;			/* prefetcher tables */
+
+  /* observe a demand access to ADDR of cache CP at NOW, and prefetch */
+  void (*access)(struct cache_prefetcher_t *pf, struct cache_t *cp,
+		 md_addr_t addr, tick_t now);
+
+  /* register prefetcher-specific stats, named after cache CP */
+  void (*reg_stats)(struct cache_prefetcher_t *pf, struct cache_t *cp,
+		    struct stat_sdb_t *sdb);
+
+  counter_t issued;		/* prefetches issued */
+  struct cache_prefetcher_t *next;/* next prefetcher of the same cache */
 };
 
 /* cache definition */
@@ -157,8 +239,10 @@ struct cache_t
   int usize;			/* user allocated data size */
   int assoc;			/* cache associativity */
   enum cache_policy policy;	/* cache replacement policy */
+  const struct cache_repl_t *repl;/* replacement policy hooks */
+  enum cache_layout layout;	/* tag store layout */
   unsigned int hit_latency;	/* cache hit latency */
-  int prefetch_type;		/* prefetcher type */
+  struct cache_prefetcher_t *prefetchers;/* prefetchers, NULL if none */
 
   /* miss/replacement handler, read/write BSIZE bytes starting at BADDR
      from/into cache block BLK, returns the latency of the operation
@@ -209,6 +293,14 @@ struct cache_t
 
   counter_t prefetch_hits;	/* total number of prefetch accesses that are hits */ 
   counter_t prefetch_misses;	/* total number of prefetch accesses that miss in this cache */
+  counter_t prefetch_useful;	/* prefetched blocks hit by a demand access */
+  counter_t prefetch_late;	/* useful prefetches hit before their fill */
+  counter_t prefetch_unused;	/* prefetched blocks replaced before any
+				   demand access */
+  counter_t prefetch_pollution;	/* demand misses to one of the last ASSOC
+				   blocks of their set replaced by a prefetch
+				   fill, a lower bound when prefetches
+				   replace more blocks than that */
 
 
 
@@ -219,6 +311,24 @@ struct cache_t
   /* data blocks */
   byte_t *data;			/* pointer to data blocks allocation */
 
+  /* tags of the last ASSOC blocks of each set replaced by prefetch fills,
+     most recent first, NULL without a prefetcher; a demand miss to one of
+     them is pollution */
+  md_addr_t *pf_victims;
+
+  /* array layout tags and ages, ASSOC per set */
+  md_addr_t *tags;
+  byte_t *ages;
+
+  /* replacement policy state, ASSOC bytes per set: the reference bits of
+     NRU, the re-reference prediction values of RRIP, or the tree bits of
+     PLRU (node N of the tree at byte N, the root is node 1) */
+  byte_t *repl_state;
+  int rrpv_max;			/* largest RRPV, 1 for NRU */
+  int duel_stride;		/* DRRIP leader set spacing, 0 if no leaders */
+  int psel;			/* DRRIP policy selector, BRRIP above half */
+  unsigned int bip_fills;	/* BRRIP fills, every 32nd inserted long */
+
   /* NOTE: this is a variable-size tail array, this must be the LAST field
      defined in this structure! */
   struct cache_set_t sets[1];	/* each entry is a set */
@@ -239,12 +349,18 @@ cache_create(char *name,		/* name of the cache */
 					   struct cache_blk_t *blk,
 					   tick_t now, int prefetch),
 	     unsigned int hit_latency,/* latency in cycles for a hit */
-	     int prefetch_type);      /* the type of the prefetcher for this cache */	
+	     char *prefetch,		/* prefetcher types joined by `+', e.g.,
+					   `1' or `2+16', NULL or `0' if none */
+	     enum cache_layout layout);	/* tag store layout */
 
 /* parse policy */
 enum cache_policy			/* replacement policy enum */
 cache_char2policy(char c);		/* replacement policy as a char */
 
+/* parse tag store layout */
+enum cache_layout			/* tag store layout enum */
+cache_str2layout(char *s);		/* layout name, `linked' or `arrays' */
+
 /* print cache configuration */
 void
 cache_config(struct cache_t *cp,	/* cache instance */
@@ -264,18 +380,15 @@ cache_stats(struct cache_t *cp,		/* cache instance */
 void cache_stats(struct cache_t *cp, FILE *stream);
 
 /* figure out what type of prefetcher is used by this cache and
-   call the appropriate function to generate the prefetch (e.g., next_line_prefetcher) */
-
-void generate_prefetch(struct cache_t *cp, md_addr_t addr);
-
-/* Next Line Prefetcher */
-void next_line_prefetcher(struct cache_t *cp, md_addr_t addr);
+   call the appropriate function to generate the prefetch (e.g., next_line_prefetcher),
+   prefetches are issued at NOW, the time of the access that triggered them */
 
-/* Stride Prefetcher */
-void stride_prefetcher(struct cache_t *cp, md_addr_t addr);
+void generate_prefetch(struct cache_t *cp, md_addr_t addr, tick_t now);
 
-/* Opend Ended Prefetcher */
-void open_ended_prefetcher(struct cache_t *cp, md_addr_t addr);
+/* create a prefetcher of type TYPE, 1 is next line, 2 is open-ended, any
+   larger type is a stride prefetcher with that many RPT entries */
+struct cache_prefetcher_t *		/* pointer to prefetcher created */
+cache_prefetcher_create(int type);	/* prefetcher type */
 
 /* access a cache, perform a CMD operation on cache CP at address ADDR,
    places NBYTES of data at *P, returns latency of operation if initiated
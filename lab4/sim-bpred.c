@@ -64,6 +64,8 @@
 #include "options.h"
 #include "stats.h"
 #include "bpred.h"
+#include "btrace.h"
+#include "symbol.h"
 #include "sim.h"
 
 /*
@@ -79,7 +81,7 @@ static struct mem_t *mem = NULL;
 /* maximum number of inst's to execute */
 static unsigned int max_insts;
 
-/* branch predictor type {nottaken|taken|perfect|bimod|2lev} */
+/* branch predictor type {nottaken|taken|bimod|2lev|comb|perc|tage} */
 static char *pred_type;
 
 /* bimodal predictor config (<table_size>) */
@@ -97,6 +99,16 @@ static int comb_nelt = 1;
 static int comb_config[1] =
   { /* meta_table_size */1024 };
 
+/* perceptron predictor config (<perceptrons> <hist_size>) */
+static int perc_nelt = 2;
+static int perc_config[2] =
+  { /* perceptrons */256, /* hist */32 };
+
+/* TAGE predictor config (<base_size> <tagged_size> <max_hist>) */
+static int tage_nelt = 3;
+static int tage_config[3] =
+  { /* base_size */4096, /* tagged_size */1024, /* max_hist */160 };
+
 /* return address stack (RAS) size */
 static int ras_size = 8;
 
@@ -114,6 +126,40 @@ static counter_t sim_num_refs = 0;
 /* total number of branches executed */
 static counter_t sim_num_branches = 0;
 
+/* per-branch profile, number of branches reported (0 = no profile) */
+static int bprof_top;
+
+/* symbolize the profile with compiler-internal symbols too */
+static int bprof_locals;
+
+/* profile of one static control instruction */
+struct bprof_ent_t {
+  struct bprof_ent_t *next;	/* next entry in the hash bucket */
+  md_addr_t PC;			/* branch address */
+  counter_t execs;		/* times executed */
+  counter_t taken;		/* times taken */
+  counter_t misses;		/* next PC mispredictions */
+  counter_t dir_misses;		/* direction mispredictions */
+  counter_t weak;		/* predictions from a weak direction counter */
+};
+
+/* profile hash table, indexed by branch address */
+#define BPROF_HASH_SIZE		16384
+#define BPROF_HASH(PC)		(((PC) >> MD_BR_SHIFT) & (BPROF_HASH_SIZE - 1))
+static struct bprof_ent_t *bprof_table[BPROF_HASH_SIZE];
+
+/* number of static control instructions profiled */
+static int bprof_nents = 0;
+
+/* branch trace file to write (NULL for none) */
+static char *btrace_fname;
+
+/* branch trace being written */
+static struct btrace_t *btrace_out = NULL;
+
+/* branch trace replayed instead of executing a program */
+static struct btrace_t *btrace_in = NULL;
+
 
 /* register simulator-specific options */
 void
@@ -138,6 +184,10 @@ sim_reg_options(struct opt_odb_t *odb)
 "      PAp     : N, W, M (M == 2^(N+W)), 0\n"
 "      gshare  : 1, W, 2^W, 1\n"
 "  Predictor `comb' combines a bimodal and a 2-level predictor.\n"
+"  Predictor `perc' is a perceptron predictor over the global history,\n"
+"  `tage' a TAGE predictor with 8 tagged components whose histories grow\n"
+"  geometrically from 4 to <max_hist> branches.  Both update their global\n"
+"  history speculatively at lookup.\n"
                );
 
   /* instruction limit */
@@ -146,7 +196,7 @@ sim_reg_options(struct opt_odb_t *odb)
 	       /* print */TRUE, /* format */NULL);
 
   opt_reg_string(odb, "-bpred",
-		 "branch predictor type {nottaken|taken|bimod|2lev|comb}",
+		 "branch predictor type {nottaken|taken|bimod|2lev|comb|perc|tage}",
                  &pred_type, /* default */"bimod",
                  /* print */TRUE, /* format */NULL);
 
@@ -169,6 +219,19 @@ sim_reg_options(struct opt_odb_t *odb)
 		   /* default */comb_config,
 		   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
 
+  opt_reg_int_list(odb, "-bpred:perc",
+		   "perceptron predictor config (<perceptrons> <hist_size>)",
+		   perc_config, perc_nelt, &perc_nelt,
+		   /* default */perc_config,
+		   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
+
+  opt_reg_int_list(odb, "-bpred:tage",
+		   "TAGE predictor config "
+		   "(<base_size> <tagged_size> <max_hist>)",
+		   tage_config, tage_nelt, &tage_nelt,
+		   /* default */tage_config,
+		   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
+
   opt_reg_int(odb, "-bpred:ras",
               "return address stack size (0 for no return stack)",
               &ras_size, /* default */ras_size,
@@ -179,6 +242,40 @@ sim_reg_options(struct opt_odb_t *odb)
 		   btb_config, btb_nelt, &btb_nelt,
 		   /* default */btb_config,
 		   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
+
+  opt_reg_int(odb, "-bpred:prof",
+	      "report the N branches with the most mispredictions "
+	      "(0 for no profile)",
+	      &bprof_top, /* default */0,
+	      /* print */TRUE, /* format */NULL);
+
+  opt_reg_flag(odb, "-bpred:prof:internal",
+	       "include compiler-internal symbols in the branch profile",
+	       &bprof_locals, /* default */FALSE,
+	       /* print */TRUE, /* format */NULL);
+
+  opt_reg_note(odb,
+"  The branch profile lists, per static branch, its executions, taken rate,\n"
+"  next PC and direction mispredictions, the share of its predictions made\n"
+"  from a weak (low confidence) direction counter, and its contribution to\n"
+"  the mispredictions per 1000 instructions.  Branches are named by the\n"
+"  text symbol they belong to.\n"
+	       );
+
+  opt_reg_string(odb, "-bpred:trace",
+		 "write a branch trace of the program to <fname>",
+		 &btrace_fname, /* default */NULL,
+		 /* print */TRUE, /* format */NULL);
+
+  opt_reg_note(odb,
+"  A branch trace given in place of the program is replayed: the predictor\n"
+"  sees the branches of the traced run without executing the program, so\n"
+"  one trace serves any number of predictor configurations.  Traces named\n"
+"  *.gz are compressed with gzip, if available.  For example:\n"
+"\n"
+"    sim-bpred -bpred:trace go.btrace go.pisa-big 50 9 2stone9.in\n"
+"    sim-bpred -bpred tage go.btrace\n"
+	       );
 }
 
 /* check simulator-specific option values */
@@ -256,8 +353,49 @@ sim_check_options(struct opt_odb_t *odb, int argc, char **argv)
 			  /* btb assoc */btb_config[1],
 			  /* ret-addr stack size */ras_size);
     }
+  else if (!mystricmp(pred_type, "perc"))
+    {
+      /* perceptron predictor, bpred_create() checks args */
+      if (perc_nelt != 2)
+	fatal("bad perceptron pred config (<perceptrons> <hist_size>)");
+      if (btb_nelt != 2)
+	fatal("bad btb config (<num_sets> <associativity>)");
+
+      pred = bpred_create(BPredPerc,
+			  /* bimod table size */0,
+			  /* perceptrons */perc_config[0],
+			  /* l2 size */0,
+			  /* meta table size */0,
+			  /* history length */perc_config[1],
+			  /* history xor address */0,
+			  /* btb sets */btb_config[0],
+			  /* btb assoc */btb_config[1],
+			  /* ret-addr stack size */ras_size);
+    }
+  else if (!mystricmp(pred_type, "tage"))
+    {
+      /* TAGE predictor, bpred_create() checks args */
+      if (tage_nelt != 3)
+	fatal("bad TAGE pred config (<base_size> <tagged_size> <max_hist>)");
+      if (btb_nelt != 2)
+	fatal("bad btb config (<num_sets> <associativity>)");
+
+      pred = bpred_create(BPredTAGE,
+			  /* base table size */tage_config[0],
+			  /* tagged component size */tage_config[1],
+			  /* l2 size */0,
+			  /* meta table size */0,
+			  /* longest history */tage_config[2],
+			  /* history xor address */0,
+			  /* btb sets */btb_config[0],
+			  /* btb assoc */btb_config[1],
+			  /* ret-addr stack size */ras_size);
+    }
   else
     fatal("cannot parse predictor type `%s'", pred_type);
+
+  if (bprof_top < 0)
+    fatal("branch profile size must be non-negative");
 }
 
 /* register simulator-specific statistics */
@@ -323,8 +461,32 @@ sim_load_prog(char *fname,		/* program to load */
 	      int argc, char **argv,	/* program arguments */
 	      char **envp)		/* program environment */
 {
-  /* load program text and data, set up environment, memory, and regs */
-  ld_load_prog(fname, argc, argv, envp, &regs, mem, TRUE);
+  if (btrace_valid(fname))
+    {
+      FILE *fd;
+
+      if (argc != 1)
+	fatal("branch trace file has arguments");
+
+      fprintf(stderr, "sim: replaying branch trace: %s\n", fname);
+      btrace_in = btrace_open(fname);
+
+      /* symbols come from the traced program, if it is still around */
+      if ((fd = fopen(btrace_in->prog_fname, "r")) != NULL)
+	{
+	  fclose(fd);
+	  ld_prog_fname = btrace_in->prog_fname;
+	}
+    }
+  else
+    {
+      /* load program text and data, set up environment, memory, and regs */
+      ld_load_prog(fname, argc, argv, envp, &regs, mem, TRUE);
+    }
+
+  if (btrace_fname)
+    btrace_out = btrace_create(btrace_fname,
+			       btrace_in ? btrace_in->prog_fname : fname);
 
   /* initialize the DLite debugger */
   dlite_init(md_reg_obj, dlite_mem_obj, bpred_mstate_obj);
@@ -337,18 +499,207 @@ sim_aux_config(FILE *stream)		/* output stream */
   /* nothing currently */
 }
 
+/* profile entry of branch PC, allocated on first use */
+static struct bprof_ent_t *
+bprof_lookup(md_addr_t PC)		/* branch address */
+{
+  int index = BPROF_HASH(PC);
+  struct bprof_ent_t *ent;
+
+  for (ent = bprof_table[index]; ent; ent = ent->next)
+    {
+      if (ent->PC == PC)
+	return ent;
+    }
+
+  ent = (struct bprof_ent_t *)calloc(1, sizeof(struct bprof_ent_t));
+  if (!ent)
+    fatal("out of virtual memory");
+  ent->PC = PC;
+  ent->next = bprof_table[index];
+  bprof_table[index] = ent;
+  bprof_nents++;
+
+  return ent;
+}
+
+/* order profile entries by decreasing mispredictions, then address */
+static int
+bprof_cmp(const void *a, const void *b)
+{
+  const struct bprof_ent_t *e1 = *(const struct bprof_ent_t **)a;
+  const struct bprof_ent_t *e2 = *(const struct bprof_ent_t **)b;
+
+  if (e1->misses != e2->misses)
+    return e1->misses < e2->misses ? 1 : -1;
+  return e1->PC < e2->PC ? -1 : e1->PC > e2->PC;
+}
+
+/* print the BPROF_TOP branches with the most mispredictions */
+static void
+bprof_print(FILE *stream)		/* output stream */
+{
+  struct bprof_ent_t **ents, *ent;
+  struct sym_sym_t *sym;
+  counter_t total_misses = 0, cum_misses = 0;
+  char name[64];
+  int i, n;
+
+  ents = (struct bprof_ent_t **)calloc(bprof_nents + 1,
+				       sizeof(struct bprof_ent_t *));
+  if (!ents)
+    fatal("out of virtual memory");
+  for (i = 0, n = 0; i < BPROF_HASH_SIZE; i++)
+    {
+      for (ent = bprof_table[i]; ent; ent = ent->next)
+	{
+	  ents[n++] = ent;
+	  total_misses += ent->misses;
+	}
+    }
+  qsort(ents, n, sizeof(struct bprof_ent_t *), bprof_cmp);
+
+  /* name the branches after their text symbols */
+  if (ld_prog_fname)
+    sym_loadsyms(ld_prog_fname, bprof_locals);
+
+  fprintf(stream, "\nsim: ** top %d of %d static branches by mispredictions **\n",
+	  MIN(bprof_top, n), n);
+  fprintf(stream, "%10s %-28s %12s %7s %12s %12s %7s %8s %7s\n",
+	  "address", "symbol", "execs", "taken%", "mispred", "dir_mispred",
+	  "weak%", "MPKI", "cum%");
+  for (i = 0; i < bprof_top && i < n; i++)
+    {
+      ent = ents[i];
+      cum_misses += ent->misses;
+
+      sym = NULL;
+      if (ld_prog_fname)
+	sym = sym_bind_addr(ent->PC, NULL, /* !exact */FALSE, sdb_text);
+      if (sym)
+	sprintf(name, "%.40s+0x%x", sym->name, (int)(ent->PC - sym->addr));
+      else
+	strcpy(name, "<unknown>");
+
+      /* myfprintf() has no left adjustment, print the name separately */
+      myfprintf(stream, "0x%08p ", ent->PC);
+      fprintf(stream, "%-28s ", name);
+      myfprintf(stream, "%12n %6.2f%% %12n %12n %6.2f%% %8.3f %6.2f%%\n",
+		ent->execs,
+		100.0 * (double)ent->taken / (double)ent->execs,
+		ent->misses, ent->dir_misses,
+		100.0 * (double)ent->weak / (double)ent->execs,
+		1000.0 * (double)ent->misses / (double)MAX(sim_num_insn, 1),
+		100.0 * (double)cum_misses / (double)MAX(total_misses, 1));
+    }
+
+  free(ents);
+}
+
 /* dump simulator-specific auxiliary simulator statistics */
 void
 sim_aux_stats(FILE *stream)		/* output stream */
 {
-  /* nada */
+  if (bprof_top)
+    bprof_print(stream);
 }
 
 /* un-initialize simulator-specific state */
 void
 sim_uninit(void)
 {
-  /* nada */
+  if (btrace_out)
+    btrace_close(btrace_out, sim_num_insn);
+  if (btrace_in)
+    btrace_close(btrace_in, 0);
+}
+
+/* predict and update control instruction REC, executed or replayed */
+static void
+sim_branch(struct btrace_rec_t *rec)	/* control instruction */
+{
+  md_addr_t pred_PC;
+  struct bpred_update_t update_rec;
+  int stack_idx;
+
+  sim_num_branches++;
+
+  if (btrace_out)
+    btrace_write(btrace_out, rec);
+
+  if (pred)
+    {
+      /* get the next predicted fetch address */
+      pred_PC = bpred_lookup(pred,
+			     /* branch addr */rec->PC,
+			     /* target */rec->target,
+			     /* inst opcode */rec->op,
+			     /* call? */rec->is_call,
+			     /* return? */rec->is_return,
+			     /* stash an update ptr */&update_rec,
+			     /* stash return stack ptr */&stack_idx);
+
+      /* valid address returned from branch predictor? */
+      if (!pred_PC)
+	{
+	  /* no predicted taken target, attempt not taken target */
+	  pred_PC = rec->PC + sizeof(md_inst_t);
+	}
+
+      if (bprof_top)
+	{
+	  struct bprof_ent_t *ent = bprof_lookup(rec->PC);
+	  int taken = rec->NPC != (rec->PC + sizeof(md_inst_t));
+
+	  ent->execs++;
+	  if (taken)
+	    ent->taken++;
+	  if (pred_PC != rec->NPC)
+	    ent->misses++;
+	  if (taken != (pred_PC != (rec->PC + sizeof(md_inst_t))))
+	    ent->dir_misses++;
+	  /* counters 1 and 2 are one step from the other direction */
+	  if (update_rec.pdir1
+	      && (*update_rec.pdir1 == 1 || *update_rec.pdir1 == 2))
+	    ent->weak++;
+	}
+
+      bpred_update(pred,
+		   /* branch addr */rec->PC,
+		   /* resolved branch target */rec->NPC,
+		   /* taken? */rec->NPC != (rec->PC + sizeof(md_inst_t)),
+		   /* pred taken? */pred_PC != (rec->PC + sizeof(md_inst_t)),
+		   /* correct pred? */pred_PC == rec->NPC,
+		   /* opcode */rec->op,
+		   /* predictor update pointer */&update_rec);
+    }
+}
+
+/* drive the predictor from the replayed branch trace */
+static void
+sim_replay(void)
+{
+  struct btrace_rec_t rec;
+
+  fprintf(stderr, "sim: ** starting branch trace replay w/ predictors **\n");
+
+  while (btrace_read(btrace_in, &rec))
+    {
+      /* finish early? */
+      if (max_insts && rec.icnt > max_insts)
+	{
+	  sim_num_insn = max_insts;
+	  return;
+	}
+
+      sim_num_insn = rec.icnt;
+      sim_branch(&rec);
+    }
+
+  /* the instructions after the last branch */
+  sim_num_insn = btrace_in->num_insn;
+  if (max_insts && sim_num_insn > max_insts)
+    sim_num_insn = max_insts;
 }
 
 
@@ -444,9 +795,14 @@ sim_main(void)
   register md_addr_t addr, target_PC = 0;
   enum md_opcode op;
   register int is_write;
-  int stack_idx;
   enum md_fault_type fault;
 
+  if (btrace_in)
+    {
+      sim_replay();
+      return;
+    }
+
   fprintf(stderr, "sim: ** starting functional simulation w/ predictors **\n");
 
   /* set up initial default next PC */
@@ -510,41 +866,16 @@ sim_main(void)
 
       if (MD_OP_FLAGS(op) & F_CTRL)
 	{
-	  md_addr_t pred_PC;
-	  struct bpred_update_t update_rec;
-
-	  sim_num_branches++;
-
-	  if (pred)
-	    {
-	      /* get the next predicted fetch address */
-	      pred_PC = bpred_lookup(pred,
-				     /* branch addr */regs.regs_PC,
-				     /* target */target_PC,
-				     /* inst opcode */op,
-				     /* call? */MD_IS_CALL(op),
-				     /* return? */MD_IS_RETURN(op),
-				     /* stash an update ptr */&update_rec,
-				     /* stash return stack ptr */&stack_idx);
-
-	      /* valid address returned from branch predictor? */
-	      if (!pred_PC)
-		{
-		  /* no predicted taken target, attempt not taken target */
-		  pred_PC = regs.regs_PC + sizeof(md_inst_t);
-		}
-
-	      bpred_update(pred,
-			   /* branch addr */regs.regs_PC,
-			   /* resolved branch target */regs.regs_NPC,
-			   /* taken? */regs.regs_NPC != (regs.regs_PC +
-							 sizeof(md_inst_t)),
-			   /* pred taken? */pred_PC != (regs.regs_PC +
-							sizeof(md_inst_t)),
-			   /* correct pred? */pred_PC == regs.regs_NPC,
-			   /* opcode */op,
-			   /* predictor update pointer */&update_rec);
-	    }
+	  struct btrace_rec_t rec;
+
+	  rec.icnt = sim_num_insn;
+	  rec.PC = regs.regs_PC;
+	  rec.NPC = regs.regs_NPC;
+	  rec.target = target_PC;
+	  rec.op = op;
+	  rec.is_call = MD_IS_CALL(op);
+	  rec.is_return = MD_IS_RETURN(op);
+	  sim_branch(&rec);
 	}
 
       /* check for DLite debugger entry condition */
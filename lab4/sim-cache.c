@@ -61,6 +61,7 @@
 #include "regs.h"
 #include "memory.h"
 #include "cache.h"
+#include "stackdist.h"
 #include "loader.h"
 #include "syscall.h"
 #include "dlite.h"
@@ -104,6 +105,12 @@ static struct cache_t *itlb = NULL;
 /* data TLB */
 static struct cache_t *dtlb = NULL;
 
+/* LRU stack distance sweep of a level one reference stream */
+static struct stackdist_t *sweep = NULL;
+
+/* the sweep sees data references, instruction references */
+static int sweep_data = FALSE, sweep_inst = FALSE;
+
 /* text-based stat profiles */
 #define MAX_PCSTAT_VARS 8
 static struct stat_stat_t *pcstat_stats[MAX_PCSTAT_VARS];
@@ -245,6 +252,8 @@ static char *cache_il1_opt /* = "none" */;
 static char *cache_il2_opt /* = "none" */;
 static char *itlb_opt /* = "none" */;
 static char *dtlb_opt /* = "none" */;
+static char *cache_layout_opt /* = "arrays" */;
+static char *sweep_opt /* = "none" */;
 static int flush_on_syscalls /* = FALSE */;
 static int compress_icache_addrs /* = FALSE */;
 
@@ -292,12 +301,16 @@ sim_reg_options(struct opt_odb_t *odb)	/* options database */
 "    <nsets>  - number of sets in the cache\n"
 "    <bsize>  - block size of the cache\n"
 "    <assoc>  - associativity of the cache\n"
-"    <repl>   - block replacement strategy, 'l'-LRU, 'f'-FIFO, 'r'-random, 'n'-NRU\n"
+"    <repl>   - block replacement strategy, 'l'-LRU, 'f'-FIFO, 'r'-random,\n"
+"               'n'-NRU, 'p'-tree-PLRU, 's'-SRRIP, 'b'-BRRIP, 'd'-DRRIP,\n"
+"               'a'-prefetch-aware LRU (prefetched blocks inserted LRU)\n"
 "    <pref>   - prefetcher type, 0 - no prefetcher, 1 - next line prefetcher,\n"
 "	       2 - open-ended prefetcher, \n"
-"	       any other number num - stride prefetcher with num entries in the Reference Prediction Table (RPT)\n"
+"	       any other number num - stride prefetcher with num entries in the Reference Prediction Table (RPT),\n"
+"	       several types joined by `+' each prefetch into the cache with their own tables\n"
 "\n"
 "    Examples:   -cache:dl1 dl1:4096:32:1:l:1\n"
+"                -cache:dl1 dl1:64:64:4:l:1+16\n"
 "                -dtlb dtlb:128:4096:32:r:0\n"
 	       );
   opt_reg_string(odb, "-cache:dl2",
@@ -328,6 +341,39 @@ sim_reg_options(struct opt_odb_t *odb)	/* options database */
   opt_reg_string(odb, "-tlb:dtlb",
 		 "data TLB config, i.e., {<config>|none}",
 		 &dtlb_opt, "dtlb:32:4096:4:l:0", /* print */TRUE, NULL);
+  opt_reg_string(odb, "-cache:layout",
+		 "cache and TLB tag store layout, i.e., {linked|arrays}",
+		 &cache_layout_opt, "arrays", /* print */TRUE, NULL);
+  opt_reg_note(odb,
+"  The tag store layout only changes how fast the caches are simulated:\n"
+"  `arrays' keeps the tags and LRU ages of a set in contiguous arrays,\n"
+"  compared with SIMD instructions where supported, `linked' walks per-set\n"
+"  way lists (and hash chains in highly associative sets).\n"
+	       );
+  opt_reg_string(odb, "-cache:sweep",
+		 "LRU sweep of a reference stream, i.e., {<config>|none}",
+		 &sweep_opt, "none", /* print */TRUE, NULL);
+  opt_reg_note(odb,
+"  The sweep simulates a whole grid of LRU caches in one pass over a level\n"
+"  one reference stream, the sweep config has the following format:\n"
+"\n"
+"    <stream>:<bsize>:<min sets>:<max sets>:<max assoc>\n"
+"\n"
+"    <stream>    - references swept, {dl1|il1|ul1}, ul1 sees both streams\n"
+"    <bsize>     - block size of all swept caches (in bytes)\n"
+"    <min sets>  - fewest sets swept (a power of two)\n"
+"    <max sets>  - most sets swept (a power of two)\n"
+"    <max assoc> - highest associativity swept (a power of two)\n"
+"\n"
+"    Examples:   -cache:sweep dl1:32:16:4096:16\n"
+"                -cache:sweep ul1:64:1:1024:8\n"
+"\n"
+"  The miss rate of every power of two number of sets and associativity in\n"
+"  the grid is printed after the stats, each the miss rate of a write\n"
+"  allocate LRU cache of that geometry with no prefetcher.  The caches\n"
+"  above can be set to `none' to run the sweep alone.  Like the caches,\n"
+"  -flush flushes a dl1 or ul1 sweep on system calls but not an il1 sweep.\n"
+	       );
   opt_reg_flag(odb, "-flush", "flush caches on system calls",
 	       &flush_on_syscalls, /* default */FALSE, /* print */TRUE, NULL);
   opt_reg_flag(odb, "-cache:icompress",
@@ -349,7 +395,8 @@ sim_check_options(struct opt_odb_t *odb,	/* options database */
 {
   char name[128], c;
   int nsets, bsize, assoc;
-  int prefetch_type;			/* this specifies the type of the prefetcher */
+  char prefetch[128];			/* prefetcher types of a cache */
+  enum cache_layout layout = cache_str2layout(cache_layout_opt);
 
   /* use a level 1 D-cache? */
   if (!mystricmp(cache_dl1_opt, "none"))
@@ -363,25 +410,25 @@ sim_check_options(struct opt_odb_t *odb,	/* options database */
     }
   else /* dl1 is defined */
     {
-      if (sscanf(cache_dl1_opt, "%[^:]:%d:%d:%d:%c:%d", 
-		 name, &nsets, &bsize, &assoc, &c, &prefetch_type) != 6)
+      if (sscanf(cache_dl1_opt, "%[^:]:%d:%d:%d:%c:%[^:]", 
+		 name, &nsets, &bsize, &assoc, &c, prefetch) != 6)
 	fatal("bad l1 D-cache parms: <name>:<nsets>:<bsize>:<assoc>:<repl>:<pref>");
       cache_dl1 = cache_create(name, nsets, bsize, /* balloc */FALSE,
 			       /* usize */0, assoc, cache_char2policy(c),
-			       dl1_access_fn, /* hit latency */1, prefetch_type);
+			       dl1_access_fn, /* hit latency */1, prefetch, layout);
 
       /* is the level 2 D-cache defined? */
       if (!mystricmp(cache_dl2_opt, "none"))
 	cache_dl2 = NULL;
       else
 	{
-	  if (sscanf(cache_dl2_opt, "%[^:]:%d:%d:%d:%c:%d",
-		     name, &nsets, &bsize, &assoc, &c, &prefetch_type) != 6)
+	  if (sscanf(cache_dl2_opt, "%[^:]:%d:%d:%d:%c:%[^:]",
+		     name, &nsets, &bsize, &assoc, &c, prefetch) != 6)
 	    fatal("bad l2 D-cache parms: "
 		  "<name>:<nsets>:<bsize>:<assoc>:<repl>:<pref>");
 	  cache_dl2 = cache_create(name, nsets, bsize, /* balloc */FALSE,
 				   /* usize */0, assoc, cache_char2policy(c), 
-				   dl2_access_fn, /* hit latency */1, prefetch_type);
+				   dl2_access_fn, /* hit latency */1, prefetch, layout);
 	}
     }
 
@@ -419,12 +466,12 @@ sim_check_options(struct opt_odb_t *odb,	/* options database */
     }
   else /* il1 is defined */
     {
-      if (sscanf(cache_il1_opt, "%[^:]:%d:%d:%d:%c:%d",
-		 name, &nsets, &bsize, &assoc, &c,&prefetch_type) != 6)
+      if (sscanf(cache_il1_opt, "%[^:]:%d:%d:%d:%c:%[^:]",
+		 name, &nsets, &bsize, &assoc, &c, prefetch) != 6)
 	fatal("bad l1 I-cache parms: <name>:<nsets>:<bsize>:<assoc>:<repl>:<pref>");
       cache_il1 = cache_create(name, nsets, bsize, /* balloc */FALSE,
 			       /* usize */0, assoc, cache_char2policy(c), 
-			       il1_access_fn, /* hit latency */1, prefetch_type);
+			       il1_access_fn, /* hit latency */1, prefetch, layout);
 
       /* is the level 2 D-cache defined? */
       if (!mystricmp(cache_il2_opt, "none"))
@@ -437,13 +484,13 @@ sim_check_options(struct opt_odb_t *odb,	/* options database */
 	}
       else
 	{
-	  if (sscanf(cache_il2_opt, "%[^:]:%d:%d:%d:%c:%d",
-		     name, &nsets, &bsize, &assoc, &c, &prefetch_type) != 6)
+	  if (sscanf(cache_il2_opt, "%[^:]:%d:%d:%d:%c:%[^:]",
+		     name, &nsets, &bsize, &assoc, &c, prefetch) != 6)
 	    fatal("bad l2 I-cache parms: "
 		  "<name>:<nsets>:<bsize>:<assoc>:<repl>:<pref>");
 	  cache_il2 = cache_create(name, nsets, bsize, /* balloc */FALSE,
 				   /* usize */0, assoc, cache_char2policy(c), 
-				   il2_access_fn, /* hit latency */1, prefetch_type);
+				   il2_access_fn, /* hit latency */1, prefetch, layout);
 	}
     }
 
@@ -452,13 +499,13 @@ sim_check_options(struct opt_odb_t *odb,	/* options database */
     itlb = NULL;
   else
     {
-      if (sscanf(itlb_opt, "%[^:]:%d:%d:%d:%c:%d",
-		 name, &nsets, &bsize, &assoc, &c, &prefetch_type) != 6)
+      if (sscanf(itlb_opt, "%[^:]:%d:%d:%d:%c:%[^:]",
+		 name, &nsets, &bsize, &assoc, &c, prefetch) != 6)
 	fatal("bad TLB parms: <name>:<nsets>:<page_size>:<assoc>:<repl>:<pref>");
       itlb = cache_create(name, nsets, bsize, /* balloc */FALSE,
 			  /* usize */sizeof(md_addr_t), assoc,
 			  cache_char2policy(c), itlb_access_fn,
-			  /* hit latency */1, prefetch_type);
+			  /* hit latency */1, prefetch, layout);
     }
 
   /* use a D-TLB? */
@@ -466,13 +513,37 @@ sim_check_options(struct opt_odb_t *odb,	/* options database */
     dtlb = NULL;
   else
     {
-      if (sscanf(dtlb_opt, "%[^:]:%d:%d:%d:%c:%d",
-		 name, &nsets, &bsize, &assoc, &c, &prefetch_type) != 6)
+      if (sscanf(dtlb_opt, "%[^:]:%d:%d:%d:%c:%[^:]",
+		 name, &nsets, &bsize, &assoc, &c, prefetch) != 6)
 	fatal("bad TLB parms: <name>:<nsets>:<page_size>:<assoc>:<repl>:<pref>");
       dtlb = cache_create(name, nsets, bsize, /* balloc */FALSE,
 			  /* usize */sizeof(md_addr_t), assoc,
 			  cache_char2policy(c),  dtlb_access_fn,
-			  /* hit latency */1, prefetch_type);
+			  /* hit latency */1, prefetch, layout);
+    }
+
+  /* sweep a reference stream? */
+  if (!mystricmp(sweep_opt, "none"))
+    sweep = NULL;
+  else
+    {
+      char stream[64];
+      int min_sets, max_sets, max_assoc;
+
+      if (sscanf(sweep_opt, "%63[^:]:%d:%d:%d:%d",
+		 stream, &bsize, &min_sets, &max_sets, &max_assoc) != 5)
+	fatal("bad sweep parms: "
+	      "<stream>:<bsize>:<min sets>:<max sets>:<max assoc>");
+      if (!mystricmp(stream, "dl1"))
+	sweep_data = TRUE;
+      else if (!mystricmp(stream, "il1"))
+	sweep_inst = TRUE;
+      else if (!mystricmp(stream, "ul1"))
+	sweep_data = sweep_inst = TRUE;
+      else
+	fatal("sweep stream must be one of {dl1|il1|ul1}");
+      sprintf(name, "sweep_%s", stream);
+      sweep = stackdist_create(name, bsize, min_sets, max_sets, max_assoc);
     }
 }
 
@@ -559,6 +630,8 @@ sim_reg_stats(struct stat_sdb_t *sdb)	/* stats database */
     cache_reg_stats(itlb, sdb);
   if (dtlb)
     cache_reg_stats(dtlb, sdb);
+  if (sweep)
+    stackdist_reg_stats(sweep, sdb);
 
   for (i=0; i<pcstat_nelt; i++)
     {
@@ -598,7 +671,9 @@ sim_reg_stats(struct stat_sdb_t *sdb)	/* stats database */
 void
 sim_aux_stats(FILE *stream)		/* output stream */
 {
-  /* nada */
+  /* print the miss rates of the sweep grid */
+  if (sweep)
+    stackdist_print(sweep, stream);
 }
 
 /* un-initialize the simulator */
@@ -662,16 +737,19 @@ sim_uninit(void)
 #error No ISA target defined...
 #endif
 
-/* precise architected memory state accessor macros */
+/* precise architected memory state accessor macros, the caches are accessed
+   at the instruction count, a one instruction per cycle clock that only
+   serves to time prefetches (see the prefetch_late stats) */
 #define __READ_CACHE(addr, SRC_T)					\
   ((dtlb								\
     ? cache_access(dtlb, Read, (addr), NULL,				\
-		   sizeof(SRC_T), 0, NULL, NULL, 0)			\
+		   sizeof(SRC_T), sim_num_insn, NULL, NULL, 0)	\
     : 0),								\
    (cache_dl1								\
     ? cache_access(cache_dl1, Read, (addr), NULL,			\
-		   sizeof(SRC_T), 0, NULL, NULL, 0)			\
-    : 0))
+		   sizeof(SRC_T), sim_num_insn, NULL, NULL, 0)	\
+    : 0),								\
+   (sweep_data ? (stackdist_access(sweep, (addr)), 0) : 0))
 
 #define READ_BYTE(SRC, FAULT)						\
   ((FAULT) = md_fault_none, addr = (SRC),				\
@@ -691,12 +769,13 @@ sim_uninit(void)
 #define __WRITE_CACHE(addr, DST_T)					\
   ((dtlb								\
     ? cache_access(dtlb, Write, (addr), NULL,				\
-		   sizeof(DST_T), 0, NULL, NULL, 0)			\
+		   sizeof(DST_T), sim_num_insn, NULL, NULL, 0)	\
     : 0),								\
    (cache_dl1								\
     ? cache_access(cache_dl1, Write, (addr), NULL,			\
-		   sizeof(DST_T), 0,  NULL, NULL, 0)			\
-    : 0))
+		   sizeof(DST_T), sim_num_insn, NULL, NULL, 0)	\
+    : 0),								\
+   (sweep_data ? (stackdist_access(sweep, (addr)), 0) : 0))
 
 #define WRITE_BYTE(SRC, DST, FAULT)					\
   ((FAULT) = md_fault_none, addr = (DST),				\
@@ -722,9 +801,13 @@ dcache_access_fn(struct mem_t *mem,	/* memory space to access */
 		 int nbytes)		/* number of bytes to access */
 {
   if (dtlb)
-    cache_access(dtlb, cmd, addr, NULL, nbytes, 0, NULL, NULL, 0);
+    cache_access(dtlb, cmd, addr, NULL, nbytes, sim_num_insn,
+		 NULL, NULL, 0);
   if (cache_dl1)
-    cache_access(cache_dl1, cmd, addr, NULL, nbytes, 0, NULL, NULL, 0);
+    cache_access(cache_dl1, cmd, addr, NULL, nbytes, sim_num_insn,
+		 NULL, NULL, 0);
+  if (sweep_data)
+    stackdist_access(sweep, addr);
   return mem_access(mem, cmd, addr, p, nbytes);
 }
 
@@ -734,6 +817,7 @@ dcache_access_fn(struct mem_t *mem,	/* memory space to access */
    ? ((dtlb ? cache_flush(dtlb, 0) : 0),				\
       (cache_dl1 ? cache_flush(cache_dl1, 0) : 0),			\
       (cache_dl2 ? cache_flush(cache_dl2, 0) : 0),			\
+      (sweep_data ? (stackdist_flush(sweep), 0) : 0),			\
       sys_syscall(&regs, mem_access, mem, INST, TRUE))			\
    : sys_syscall(&regs, dcache_access_fn, mem, INST, TRUE))
 
@@ -769,10 +853,14 @@ sim_main(void)
       /* get the next instruction to execute */
       if (itlb)
 	cache_access(itlb, Read, IACOMPRESS(regs.regs_PC),
-		     NULL, ISCOMPRESS(sizeof(md_inst_t)), 0, NULL, NULL, 0);
+		     NULL, ISCOMPRESS(sizeof(md_inst_t)), sim_num_insn,
+		     NULL, NULL, 0);
       if (cache_il1)
 	cache_access(cache_il1, Read, IACOMPRESS(regs.regs_PC),
-		     NULL, ISCOMPRESS(sizeof(md_inst_t)), 0, NULL, NULL, 0);
+		     NULL, ISCOMPRESS(sizeof(md_inst_t)), sim_num_insn,
+		     NULL, NULL, 0);
+      if (sweep_inst)
+	stackdist_access(sweep, IACOMPRESS(regs.regs_PC));
       MD_FETCH_INST(inst, mem, regs.regs_PC);
 
       /* keep an instruction count */
@@ -110,7 +110,7 @@ static int ruu_branch_penalty;
 /* speed of front-end of machine relative to execution core */
 static int fetch_speed;
 
-/* branch predictor type {nottaken|taken|perfect|bimod|2lev} */
+/* branch predictor type {nottaken|taken|perfect|bimod|2lev|comb|perc|tage} */
 static char *pred_type;
 
 /* bimodal predictor config (<table_size>) */
@@ -128,6 +128,16 @@ static int comb_nelt = 1;
 static int comb_config[1] =
   { /* meta_table_size */1024 };
 
+/* perceptron predictor config (<perceptrons> <hist_size>) */
+static int perc_nelt = 2;
+static int perc_config[2] =
+  { /* perceptrons */256, /* hist */32 };
+
+/* TAGE predictor config (<base_size> <tagged_size> <max_hist>) */
+static int tage_nelt = 3;
+static int tage_config[3] =
+  { /* base_size */4096, /* tagged_size */1024, /* max_hist */160 };
+
 /* return address stack (RAS) size */
 static int ras_size = 8;
 
@@ -201,6 +211,12 @@ static char *itlb_opt;
 /* data TLB config, i.e., {<config>|none} */
 static char *dtlb_opt;
 
+/* cache and TLB tag store layout */
+static char *cache_layout_opt;
+
+/* PC of the instruction accessing the data cache */
+static md_addr_t dl1_access_PC;
+
 /* inst/data TLB miss latency (in cycles) */
 static int tlb_miss_lat;
 
@@ -424,13 +440,22 @@ mem_access_latency(int blk_sz)		/* block size accessed */
  * cache miss handlers
  */
 
+/* PC of the memory instruction accessing the data cache, for the cache.c
+   prefetchers */
+md_addr_t
+get_PC(void)
+{
+  return dl1_access_PC;
+}
+
 /* l1 data cache l1 block miss handler function */
 static unsigned int			/* latency of block access */
 dl1_access_fn(enum mem_cmd cmd,		/* access cmd, Read or Write */
 	      md_addr_t baddr,		/* block address to access */
 	      int bsize,		/* size of block to access */
 	      struct cache_blk_t *blk,	/* ptr to block in upper level */
-	      tick_t now)		/* time of access */
+	      tick_t now,		/* time of access */
+	      int prefetch)		/* non-zero if the access is a prefetch */
 {
   unsigned int lat;
 
@@ -438,7 +463,7 @@ dl1_access_fn(enum mem_cmd cmd,		/* access cmd, Read or Write */
     {
       /* access next level of data cache hierarchy */
       lat = cache_access(cache_dl2, cmd, baddr, NULL, bsize,
-			 /* now */now, /* pudata */NULL, /* repl addr */NULL);
+			 /* now */now, /* pudata */NULL, /* repl addr */NULL, prefetch);
       if (cmd == Read)
 	return lat;
       else
@@ -466,7 +491,8 @@ dl2_access_fn(enum mem_cmd cmd,		/* access cmd, Read or Write */
 	      md_addr_t baddr,		/* block address to access */
 	      int bsize,		/* size of block to access */
 	      struct cache_blk_t *blk,	/* ptr to block in upper level */
-	      tick_t now)		/* time of access */
+	      tick_t now,		/* time of access */
+	      int prefetch)		/* non-zero if the access is a prefetch */
 {
   /* this is a miss to the lowest level, so access main memory */
   if (cmd == Read)
@@ -484,7 +510,8 @@ il1_access_fn(enum mem_cmd cmd,		/* access cmd, Read or Write */
 	      md_addr_t baddr,		/* block address to access */
 	      int bsize,		/* size of block to access */
 	      struct cache_blk_t *blk,	/* ptr to block in upper level */
-	      tick_t now)		/* time of access */
+	      tick_t now,		/* time of access */
+	      int prefetch)		/* non-zero if the access is a prefetch */
 {
   unsigned int lat;
 
@@ -492,7 +519,7 @@ if (cache_il2)
     {
       /* access next level of inst cache hierarchy */
       lat = cache_access(cache_il2, cmd, baddr, NULL, bsize,
-			 /* now */now, /* pudata */NULL, /* repl addr */NULL);
+			 /* now */now, /* pudata */NULL, /* repl addr */NULL, prefetch);
       if (cmd == Read)
 	return lat;
       else
@@ -514,7 +541,8 @@ il2_access_fn(enum mem_cmd cmd,		/* access cmd, Read or Write */
 	      md_addr_t baddr,		/* block address to access */
 	      int bsize,		/* size of block to access */
 	      struct cache_blk_t *blk,	/* ptr to block in upper level */
-	      tick_t now)		/* time of access */
+	      tick_t now,		/* time of access */
+	      int prefetch)		/* non-zero if the access is a prefetch */
 {
   /* this is a miss to the lowest level, so access main memory */
   if (cmd == Read)
@@ -534,7 +562,8 @@ itlb_access_fn(enum mem_cmd cmd,	/* access cmd, Read or Write */
 	       md_addr_t baddr,		/* block address to access */
 	       int bsize,		/* size of block to access */
 	       struct cache_blk_t *blk,	/* ptr to block in upper level */
-	       tick_t now)		/* time of access */
+	       tick_t now,		/* time of access */
+	       int prefetch)		/* non-zero if the access is a prefetch */
 {
   md_addr_t *phy_page_ptr = (md_addr_t *)blk->user_data;
 
@@ -554,7 +583,8 @@ dtlb_access_fn(enum mem_cmd cmd,	/* access cmd, Read or Write */
 	       md_addr_t baddr,	/* block address to access */
 	       int bsize,		/* size of block to access */
 	       struct cache_blk_t *blk,	/* ptr to block in upper level */
-	       tick_t now)		/* time of access */
+	       tick_t now,		/* time of access */
+	       int prefetch)		/* non-zero if the access is a prefetch */
 {
   md_addr_t *phy_page_ptr = (md_addr_t *)blk->user_data;
 
@@ -647,10 +677,14 @@ sim_reg_options(struct opt_odb_t *odb)
 "      PAp     : N, W, M (M == 2^(N+W)), 0\n"
 "      gshare  : 1, W, 2^W, 1\n"
 "  Predictor `comb' combines a bimodal and a 2-level predictor.\n"
+"  Predictor `perc' is a perceptron predictor over the global history,\n"
+"  `tage' a TAGE predictor with 8 tagged components whose histories grow\n"
+"  geometrically from 4 to <max_hist> branches.  Both update their global\n"
+"  history speculatively at lookup.\n"
                );
 
   opt_reg_string(odb, "-bpred",
-		 "branch predictor type {nottaken|taken|perfect|bimod|2lev|comb}",
+		 "branch predictor type {nottaken|taken|perfect|bimod|2lev|comb|perc|tage}",
                  &pred_type, /* default */"bimod",
                  /* print */TRUE, /* format */NULL);
 
@@ -673,6 +707,19 @@ sim_reg_options(struct opt_odb_t *odb)
 		   /* default */comb_config,
 		   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
 
+  opt_reg_int_list(odb, "-bpred:perc",
+		   "perceptron predictor config (<perceptrons> <hist_size>)",
+		   perc_config, perc_nelt, &perc_nelt,
+		   /* default */perc_config,
+		   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
+
+  opt_reg_int_list(odb, "-bpred:tage",
+		   "TAGE predictor config "
+		   "(<base_size> <tagged_size> <max_hist>)",
+		   tage_config, tage_nelt, &tage_nelt,
+		   /* default */tage_config,
+		   /* print */TRUE, /* format */NULL, /* !accrue */FALSE);
+
   opt_reg_int(odb, "-bpred:ras",
               "return address stack size (0 for no return stack)",
               &ras_size, /* default */ras_size,
@@ -749,9 +796,21 @@ sim_reg_options(struct opt_odb_t *odb)
 "    <nsets>  - number of sets in the cache\n"
 "    <bsize>  - block size of the cache\n"
 "    <assoc>  - associativity of the cache\n"
-"    <repl>   - block replacement strategy, 'l'-LRU, 'f'-FIFO, 'r'-random\n"
+"    <repl>   - block replacement strategy, 'l'-LRU, 'f'-FIFO, 'r'-random,\n"
+"               'n'-NRU, 'p'-tree-PLRU, 's'-SRRIP, 'b'-BRRIP, 'd'-DRRIP,\n"
+"               'a'-prefetch-aware LRU (prefetched blocks inserted LRU)\n"
+"\n"
+"  The data caches take an optional prefetcher type, as in sim-cache:\n"
+"\n"
+"    <name>:<nsets>:<bsize>:<assoc>:<repl>:<pref>\n"
+"\n"
+"    <pref>   - prefetcher type, 0 - no prefetcher, 1 - next line prefetcher,\n"
+"               2 - open-ended prefetcher, any other number num - stride\n"
+"               prefetcher with num entries in the Reference Prediction Table\n"
+"               several types joined by `+' each prefetch into the cache\n"
 "\n"
 "    Examples:   -cache:dl1 dl1:4096:32:1:l\n"
+"                -cache:dl1 dl1:128:32:4:l:1+16\n"
 "                -dtlb dtlb:128:4096:32:r\n"
 	       );
 
@@ -832,6 +891,10 @@ sim_reg_options(struct opt_odb_t *odb)
 		 "data TLB config, i.e., {<config>|none}",
 		 &dtlb_opt, "dtlb:32:4096:4:l", /* print */TRUE, NULL);
 
+  opt_reg_string(odb, "-cache:layout",
+		 "cache and TLB tag store layout, i.e., {linked|arrays}",
+		 &cache_layout_opt, "arrays", /* print */TRUE, NULL);
+
   opt_reg_int(odb, "-tlb:lat",
 	      "inst/data TLB miss latency (in cycles)",
 	      &tlb_miss_lat, /* default */30,
@@ -880,7 +943,9 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
 		  int argc, char **argv)        /* command line arguments */
 {
   char name[128], c;
-  int nsets, bsize, assoc;
+  int nsets, bsize, assoc, n;
+  char prefetch[128];			/* prefetcher types of the data caches */
+  enum cache_layout layout;
 
   if (fastfwd_count < 0 || fastfwd_count >= 2147483647)
     fatal("bad fast forward count: %d", fastfwd_count);
@@ -972,6 +1037,44 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
 			  /* btb assoc */btb_config[1],
 			  /* ret-addr stack size */ras_size);
     }
+  else if (!mystricmp(pred_type, "perc"))
+    {
+      /* perceptron predictor, bpred_create() checks args */
+      if (perc_nelt != 2)
+	fatal("bad perceptron pred config (<perceptrons> <hist_size>)");
+      if (btb_nelt != 2)
+	fatal("bad btb config (<num_sets> <associativity>)");
+
+      pred = bpred_create(BPredPerc,
+			  /* bimod table size */0,
+			  /* perceptrons */perc_config[0],
+			  /* l2 size */0,
+			  /* meta table size */0,
+			  /* history length */perc_config[1],
+			  /* history xor address */0,
+			  /* btb sets */btb_config[0],
+			  /* btb assoc */btb_config[1],
+			  /* ret-addr stack size */ras_size);
+    }
+  else if (!mystricmp(pred_type, "tage"))
+    {
+      /* TAGE predictor, bpred_create() checks args */
+      if (tage_nelt != 3)
+	fatal("bad TAGE pred config (<base_size> <tagged_size> <max_hist>)");
+      if (btb_nelt != 2)
+	fatal("bad btb config (<num_sets> <associativity>)");
+
+      pred = bpred_create(BPredTAGE,
+			  /* base table size */tage_config[0],
+			  /* tagged component size */tage_config[1],
+			  /* l2 size */0,
+			  /* meta table size */0,
+			  /* longest history */tage_config[2],
+			  /* history xor address */0,
+			  /* btb sets */btb_config[0],
+			  /* btb assoc */btb_config[1],
+			  /* ret-addr stack size */ras_size);
+    }
   else
     fatal("cannot parse predictor type `%s'", pred_type);
 
@@ -999,6 +1102,8 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
   if (LSQ_size < 2 || (LSQ_size & (LSQ_size-1)) != 0)
     fatal("LSQ size must be a positive number > 1 and a power of two");
 
+  layout = cache_str2layout(cache_layout_opt);
+
   /* use a level 1 D-cache? */
   if (!mystricmp(cache_dl1_opt, "none"))
     {
@@ -1011,25 +1116,32 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
     }
   else /* dl1 is defined */
     {
-      if (sscanf(cache_dl1_opt, "%[^:]:%d:%d:%d:%c",
-		 name, &nsets, &bsize, &assoc, &c) != 5)
-	fatal("bad l1 D-cache parms: <name>:<nsets>:<bsize>:<assoc>:<repl>");
+      strcpy(prefetch, "0");
+      n = sscanf(cache_dl1_opt, "%[^:]:%d:%d:%d:%c:%[^:]",
+		 name, &nsets, &bsize, &assoc, &c, prefetch);
+      if (n != 5 && n != 6)
+	fatal("bad l1 D-cache parms: "
+	      "<name>:<nsets>:<bsize>:<assoc>:<repl>[:<pref>]");
       cache_dl1 = cache_create(name, nsets, bsize, /* balloc */FALSE,
 			       /* usize */0, assoc, cache_char2policy(c),
-			       dl1_access_fn, /* hit lat */cache_dl1_lat);
+			       dl1_access_fn, /* hit lat */cache_dl1_lat,
+			       prefetch, layout);
 
       /* is the level 2 D-cache defined? */
       if (!mystricmp(cache_dl2_opt, "none"))
 	cache_dl2 = NULL;
       else
 	{
-	  if (sscanf(cache_dl2_opt, "%[^:]:%d:%d:%d:%c",
-		     name, &nsets, &bsize, &assoc, &c) != 5)
+	  strcpy(prefetch, "0");
+	  n = sscanf(cache_dl2_opt, "%[^:]:%d:%d:%d:%c:%[^:]",
+		     name, &nsets, &bsize, &assoc, &c, prefetch);
+	  if (n != 5 && n != 6)
 	    fatal("bad l2 D-cache parms: "
-		  "<name>:<nsets>:<bsize>:<assoc>:<repl>");
+		  "<name>:<nsets>:<bsize>:<assoc>:<repl>[:<pref>]");
 	  cache_dl2 = cache_create(name, nsets, bsize, /* balloc */FALSE,
 				   /* usize */0, assoc, cache_char2policy(c),
-				   dl2_access_fn, /* hit lat */cache_dl2_lat);
+				   dl2_access_fn, /* hit lat */cache_dl2_lat,
+				   prefetch, layout);
 	}
     }
 
@@ -1072,7 +1184,8 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
 	fatal("bad l1 I-cache parms: <name>:<nsets>:<bsize>:<assoc>:<repl>");
       cache_il1 = cache_create(name, nsets, bsize, /* balloc */FALSE,
 			       /* usize */0, assoc, cache_char2policy(c),
-			       il1_access_fn, /* hit lat */cache_il1_lat);
+			       il1_access_fn, /* hit lat */cache_il1_lat,
+			       /* no prefetcher */NULL, layout);
 
       /* is the level 2 D-cache defined? */
       if (!mystricmp(cache_il2_opt, "none"))
@@ -1091,7 +1204,8 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
 		  "<name>:<nsets>:<bsize>:<assoc>:<repl>");
 	  cache_il2 = cache_create(name, nsets, bsize, /* balloc */FALSE,
 				   /* usize */0, assoc, cache_char2policy(c),
-				   il2_access_fn, /* hit lat */cache_il2_lat);
+				   il2_access_fn, /* hit lat */cache_il2_lat,
+				   /* no prefetcher */NULL, layout);
 	}
     }
 
@@ -1106,7 +1220,7 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
       itlb = cache_create(name, nsets, bsize, /* balloc */FALSE,
 			  /* usize */sizeof(md_addr_t), assoc,
 			  cache_char2policy(c), itlb_access_fn,
-			  /* hit latency */1);
+			  /* hit latency */1, /* no prefetcher */NULL, layout);
     }
 
   /* use a D-TLB? */
@@ -1120,7 +1234,7 @@ sim_check_options(struct opt_odb_t *odb,        /* options database */
       dtlb = cache_create(name, nsets, bsize, /* balloc */FALSE,
 			  /* usize */sizeof(md_addr_t), assoc,
 			  cache_char2policy(c), dtlb_access_fn,
-			  /* hit latency */1);
+			  /* hit latency */1, /* no prefetcher */NULL, layout);
     }
 
   if (cache_dl1_lat < 1)
@@ -2185,9 +2299,10 @@ ruu_commit(void)
 		  if (cache_dl1)
 		    {
 		      /* commit store value to D-cache */
+		      dl1_access_PC = LSQ[LSQ_head].PC;
 		      lat =
 			cache_access(cache_dl1, Write, (LSQ[LSQ_head].addr&~3),
-				     NULL, 4, sim_cycle, NULL, NULL);
+				     NULL, 4, sim_cycle, NULL, NULL, /* !prefetch */0);
 		      if (lat > cache_dl1_lat)
 			events |= PEV_CACHEMISS;
 		    }
@@ -2198,7 +2313,7 @@ ruu_commit(void)
 		      /* access the D-TLB */
 		      lat =
 			cache_access(dtlb, Read, (LSQ[LSQ_head].addr & ~3),
-				     NULL, 4, sim_cycle, NULL, NULL);
+				     NULL, 4, sim_cycle, NULL, NULL, /* !prefetch */0);
 		      if (lat > 1)
 			events |= PEV_TLBMISS;
 		    }
@@ -2402,7 +2517,9 @@ ruu_writeback(void)
 	  /* recover processor state and reinit fetch to correct path */
 	  ruu_recover(rs - RUU);
 	  tracer_recover();
-	  bpred_recover(pred, rs->PC, rs->stack_recover_idx);
+	  bpred_recover(pred, rs->PC, rs->stack_recover_idx,
+			/* taken? */rs->next_PC != (rs->PC + sizeof(md_inst_t)),
+			&rs->dir_update);
 
 	  /* stall fetch until I-fetch and I-decode recover */
 	  ruu_fetch_issue_delay = ruu_branch_penalty;
@@ -2730,10 +2847,11 @@ ruu_issue(void)
 			      if (cache_dl1 && valid_addr)
 				{
 				  /* access the cache if non-faulting */
+				  dl1_access_PC = rs->PC;
 				  load_lat =
 				    cache_access(cache_dl1, Read,
 						 (rs->addr & ~3), NULL, 4,
-						 sim_cycle, NULL, NULL);
+						 sim_cycle, NULL, NULL, /* !prefetch */0);
 				  if (load_lat > cache_dl1_lat)
 				    events |= PEV_CACHEMISS;
 				}
@@ -2751,7 +2869,7 @@ ruu_issue(void)
 				 initiate speculative TLB misses */
 			      tlb_lat =
 				cache_access(dtlb, Read, (rs->addr & ~3),
-					     NULL, 4, sim_cycle, NULL, NULL);
+					     NULL, 4, sim_cycle, NULL, NULL, /* !prefetch */0);
 			      if (tlb_lat > 1)
 				events |= PEV_TLBMISS;
 
@@ -4233,7 +4351,7 @@ ruu_fetch(void)
 	      lat =
 		cache_access(cache_il1, Read, IACOMPRESS(fetch_regs_PC),
 			     NULL, ISCOMPRESS(sizeof(md_inst_t)), sim_cycle,
-			     NULL, NULL);
+			     NULL, NULL, /* !prefetch */0);
 	      if (lat > cache_il1_lat)
 		last_inst_missed = TRUE;
 	    }
@@ -4245,7 +4363,7 @@ ruu_fetch(void)
 	      tlb_lat =
 		cache_access(itlb, Read, IACOMPRESS(fetch_regs_PC),
 			     NULL, ISCOMPRESS(sizeof(md_inst_t)), sim_cycle,
-			     NULL, NULL);
+			     NULL, NULL, /* !prefetch */0);
 	      if (tlb_lat > 1)
 		last_inst_tmissed = TRUE;
 
@@ -0,0 +1,233 @@
+/* stackdist.c - LRU stack distance cache sweep routines */
+
+/* SimpleScalar(TM) Tool Suite
+ * Copyright (C) 1994-2003 by Todd M. Austin, Ph.D. and SimpleScalar, LLC.
+ * All Rights Reserved. 
+ * 
+ * THIS IS A LEGAL DOCUMENT, BY USING SIMPLESCALAR,
+ * YOU ARE AGREEING TO THESE TERMS AND CONDITIONS.
+ * 
+ * No portion of this work may be used by any commercial entity, or for any
+ * commercial purpose, without the prior, written permission of SimpleScalar,
+ * LLC (info@simplescalar.com). Nonprofit and noncommercial use is permitted
+ * as described below.
+ * 
+ * 1. SimpleScalar is provided AS IS, with no warranty of any kind, express
+ * or implied. The user of the program accepts full responsibility for the
+ * application of the program and the use of any results.
+ * 
+ * 2. Nonprofit and noncommercial use is encouraged. SimpleScalar may be
+ * downloaded, compiled, executed, copied, and modified solely for nonprofit,
+ * educational, noncommercial research, and noncommercial scholarship
+ * purposes provided that this notice in its entirety accompanies all copies.
+ * Copies of the modified software can be delivered to persons who use it
+ * solely for nonprofit, educational, noncommercial research, and
+ * noncommercial scholarship purposes provided that this notice in its
+ * entirety accompanies all copies.
+ * 
+ * 3. ALL COMMERCIAL USE, AND ALL USE BY FOR PROFIT ENTITIES, IS EXPRESSLY
+ * PROHIBITED WITHOUT A LICENSE FROM SIMPLESCALAR, LLC (info@simplescalar.com).
+ * 
+ * 4. No nonprofit user may place any restrictions on the use of this software,
+ * including as modified by the user, by any other authorized user.
+ * 
+ * 5. Noncommercial and nonprofit users may distribute copies of SimpleScalar
+ * in compiled or executable form as set forth in Section 2, provided that
+ * either: (A) it is accompanied by the corresponding machine-readable source
+ * code, or (B) it is accompanied by a written offer, with no time limit, to
+ * give anyone a machine-readable copy of the corresponding source code in
+ * return for reimbursement of the cost of distribution. This written offer
+ * must permit verbatim duplication by anyone, or (C) it is distributed by
+ * someone who received only the executable form, and is accompanied by a
+ * copy of the written offer of source code.
+ * 
+ * 6. SimpleScalar was developed by Todd M. Austin, Ph.D. The tool suite is
+ * currently maintained by SimpleScalar LLC (info@simplescalar.com). US Mail:
+ * 2395 Timbercrest Court, Ann Arbor, MI 48105.
+ * 
+ * Copyright (C) 1994-2003 by Todd M. Austin, Ph.D. and SimpleScalar, LLC.
+ */
+
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "host.h"
+#include "misc.h"
+#include "machine.h"
+#include "stats.h"
+#include "stackdist.h"
+
+/* block number held by an empty stack entry, never a real block number as
+   the block shift is at least one */
+#define STACKDIST_EMPTY		(~(md_addr_t)0)
+
+/* create a sweep of caches of BSIZE byte blocks, MIN_SETS to MAX_SETS
+   sets, and 1 to MAX_ASSOC ways */
+struct stackdist_t *			/* pointer to sweep created */
+stackdist_create(char *name,		/* name of the sweep */
+		 int bsize,		/* block size of all caches */
+		 int min_sets,		/* fewest sets */
+		 int max_sets,		/* most sets */
+		 int max_assoc)		/* highest associativity */
+{
+  struct stackdist_t *sd;
+  int level, i, nentries;
+
+  /* check all sweep parameters */
+  if (bsize <= 1 || (bsize & (bsize-1)) != 0)
+    fatal("sweep block size must be a power of two greater than one");
+  if (min_sets <= 0 || (min_sets & (min_sets-1)) != 0)
+    fatal("sweep minimum number of sets must be a positive power of two");
+  if (max_sets < min_sets || (max_sets & (max_sets-1)) != 0)
+    fatal("sweep maximum number of sets must be a power of two "
+	  "no smaller than the minimum");
+  if (max_assoc <= 0 || (max_assoc & (max_assoc-1)) != 0)
+    fatal("sweep maximum associativity must be a positive power of two");
+
+  sd = (struct stackdist_t *)calloc(1, sizeof(struct stackdist_t));
+  if (!sd)
+    fatal("out of virtual memory");
+
+  sd->name = mystrdup(name);
+  sd->bsize = bsize;
+  sd->min_sets = min_sets;
+  sd->max_sets = max_sets;
+  sd->max_assoc = max_assoc;
+  sd->blk_shift = log_base2(bsize);
+  sd->nlevels = log_base2(max_sets) - log_base2(min_sets) + 1;
+
+  sd->stacks = (md_addr_t **)calloc(sd->nlevels, sizeof(md_addr_t *));
+  sd->hits = (counter_t **)calloc(sd->nlevels, sizeof(counter_t *));
+  if (!sd->stacks || !sd->hits)
+    fatal("out of virtual memory");
+
+  for (level=0; level < sd->nlevels; level++)
+    {
+      nentries = (min_sets << level) * max_assoc;
+      sd->stacks[level] = (md_addr_t *)malloc(nentries * sizeof(md_addr_t));
+      sd->hits[level] = (counter_t *)calloc(max_assoc, sizeof(counter_t));
+      if (!sd->stacks[level] || !sd->hits[level])
+	fatal("out of virtual memory");
+      for (i=0; i < nentries; i++)
+	sd->stacks[level][i] = STACKDIST_EMPTY;
+    }
+
+  sd->refs = 0;
+
+  return sd;
+}
+
+/* reference address ADDR in every cache of sweep SD */
+void
+stackdist_access(struct stackdist_t *sd,	/* sweep to access */
+		 md_addr_t addr)		/* address of access */
+{
+  md_addr_t blk = addr >> sd->blk_shift, *stack;
+  int level, depth, max_assoc = sd->max_assoc;
+
+  sd->refs++;
+
+  for (level=0; level < sd->nlevels; level++)
+    {
+      stack = sd->stacks[level]
+	+ (blk & ((sd->min_sets << level) - 1)) * max_assoc;
+
+      /* find the depth of the block in its set's stack, a hit in every
+	 cache of this many sets and more ways than the depth */
+      for (depth=0; depth < max_assoc && stack[depth] != blk; depth++)
+	/* nada */;
+
+      if (depth < max_assoc)
+	sd->hits[level][depth]++;
+      else
+	{
+	  /* miss in all associativities, the LRU block falls off */
+	  depth = max_assoc - 1;
+	}
+
+      /* make the block most recently used */
+      memmove(stack + 1, stack, depth * sizeof(md_addr_t));
+      stack[0] = blk;
+    }
+}
+
+/* flush every cache of sweep SD */
+void
+stackdist_flush(struct stackdist_t *sd)		/* sweep to flush */
+{
+  int level, i, nentries;
+
+  for (level=0; level < sd->nlevels; level++)
+    {
+      nentries = (sd->min_sets << level) * sd->max_assoc;
+      for (i=0; i < nentries; i++)
+	sd->stacks[level][i] = STACKDIST_EMPTY;
+    }
+}
+
+/* misses of the cache of NSETS sets and ASSOC ways in sweep SD */
+counter_t				/* total number of misses */
+stackdist_misses(struct stackdist_t *sd,	/* sweep instance */
+		 int nsets,			/* number of sets */
+		 int assoc)			/* associativity */
+{
+  int level, depth;
+  counter_t misses = sd->refs;
+
+  if (nsets < sd->min_sets || nsets > sd->max_sets
+      || (nsets & (nsets-1)) != 0)
+    panic("sweep `%s' does not simulate %d sets", sd->name, nsets);
+  if (assoc <= 0 || assoc > sd->max_assoc)
+    panic("sweep `%s' does not simulate %d ways", sd->name, assoc);
+
+  level = log_base2(nsets) - log_base2(sd->min_sets);
+  for (depth=0; depth < assoc; depth++)
+    misses -= sd->hits[level][depth];
+
+  return misses;
+}
+
+/* register sweep stats */
+void
+stackdist_reg_stats(struct stackdist_t *sd,	/* sweep instance */
+		    struct stat_sdb_t *sdb)	/* stats database */
+{
+  char buf[512], buf1[512];
+
+  sprintf(buf, "%s.refs", sd->name);
+  sprintf(buf1, "total number of references swept (%d byte blocks)",
+	  sd->bsize);
+  stat_reg_counter(sdb, buf, buf1, &sd->refs, 0, NULL);
+}
+
+/* print the miss rates of the sweep grid */
+void
+stackdist_print(struct stackdist_t *sd,		/* sweep instance */
+		FILE *stream)			/* output stream */
+{
+  int nsets, assoc;
+
+  fprintf(stream,
+	  "sim: ** LRU miss rates of sweep `%s', %d byte blocks **\n",
+	  sd->name, sd->bsize);
+
+  fprintf(stream, "%8s", "sets");
+  for (assoc=1; assoc <= sd->max_assoc; assoc <<= 1)
+    fprintf(stream, " %7d-way", assoc);
+  fprintf(stream, "\n");
+
+  for (nsets=sd->min_sets; nsets <= sd->max_sets; nsets <<= 1)
+    {
+      fprintf(stream, "%8d", nsets);
+      for (assoc=1; assoc <= sd->max_assoc; assoc <<= 1)
+	fprintf(stream, " %11.4f",
+		sd->refs
+		? (double)stackdist_misses(sd, nsets, assoc) / (double)sd->refs
+		: 0.0);
+      fprintf(stream, "\n");
+    }
+
+  fprintf(stream, "\n");
+}
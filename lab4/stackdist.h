@@ -0,0 +1,136 @@
+/* stackdist.h - LRU stack distance cache sweep interfaces */
+
+/* SimpleScalar(TM) Tool Suite
+ * Copyright (C) 1994-2003 by Todd M. Austin, Ph.D. and SimpleScalar, LLC.
+ * All Rights Reserved. 
+ * 
+ * THIS IS A LEGAL DOCUMENT, BY USING SIMPLESCALAR,
+ * YOU ARE AGREEING TO THESE TERMS AND CONDITIONS.
+ * 
+ * No portion of this work may be used by any commercial entity, or for any
+ * commercial purpose, without the prior, written permission of SimpleScalar,
+ * LLC (info@simplescalar.com). Nonprofit and noncommercial use is permitted
+ * as described below.
+ * 
+ * 1. SimpleScalar is provided AS IS, with no warranty of any kind, express
+ * or implied. The user of the program accepts full responsibility for the
+ * application of the program and the use of any results.
+ * 
+ * 2. Nonprofit and noncommercial use is encouraged. SimpleScalar may be
+ * downloaded, compiled, executed, copied, and modified solely for nonprofit,
+ * educational, noncommercial research, and noncommercial scholarship
+ * purposes provided that this notice in its entirety accompanies all copies.
+ * Copies of the modified software can be delivered to persons who use it
+ * solely for nonprofit, educational, noncommercial research, and
+ * noncommercial scholarship purposes provided that this notice in its
+ * entirety accompanies all copies.
+ * 
+ * 3. ALL COMMERCIAL USE, AND ALL USE BY FOR PROFIT ENTITIES, IS EXPRESSLY
+ * PROHIBITED WITHOUT A LICENSE FROM SIMPLESCALAR, LLC (info@simplescalar.com).
+ * 
+ * 4. No nonprofit user may place any restrictions on the use of this software,
+ * including as modified by the user, by any other authorized user.
+ * 
+ * 5. Noncommercial and nonprofit users may distribute copies of SimpleScalar
+ * in compiled or executable form as set forth in Section 2, provided that
+ * either: (A) it is accompanied by the corresponding machine-readable source
+ * code, or (B) it is accompanied by a written offer, with no time limit, to
+ * give anyone a machine-readable copy of the corresponding source code in
+ * return for reimbursement of the cost of distribution. This written offer
+ * must permit verbatim duplication by anyone, or (C) it is distributed by
+ * someone who received only the executable form, and is accompanied by a
+ * copy of the written offer of source code.
+ * 
+ * 6. SimpleScalar was developed by Todd M. Austin, Ph.D. The tool suite is
+ * currently maintained by SimpleScalar LLC (info@simplescalar.com). US Mail:
+ * 2395 Timbercrest Court, Ann Arbor, MI 48105.
+ * 
+ * Copyright (C) 1994-2003 by Todd M. Austin, Ph.D. and SimpleScalar, LLC.
+ */
+
+#ifndef STACKDIST_H
+#define STACKDIST_H
+
+#include <stdio.h>
+
+#include "host.h"
+#include "misc.h"
+#include "machine.h"
+#include "stats.h"
+
+/*
+ * This module simulates a whole grid of LRU caches in one pass over a
+ * reference stream: every power of two number of sets from MIN_SETS to
+ * MAX_SETS, with every associativity up to MAX_ASSOC, all with the same
+ * block size.  For each number of sets it keeps the LRU stack of each set,
+ * MAX_ASSOC blocks deep.  A reference found at depth D of its set's stack
+ * hits in every cache of that many sets and more than D ways, so one
+ * histogram of stack depths per number of sets gives the misses of every
+ * associativity at once (Mattson et al., "Evaluation Techniques for Storage
+ * Hierarchies").
+ *
+ * The caches are write-allocate and count reads and writes alike, so the
+ * misses of each grid point are those of the equivalent sim-cache cache
+ * with LRU replacement and no prefetcher.
+ */
+
+/* stack distance sweep definition */
+struct stackdist_t
+{
+  /* parameters */
+  char *name;			/* sweep name */
+  int bsize;			/* block size in bytes */
+  int min_sets;			/* fewest sets simulated */
+  int max_sets;			/* most sets simulated */
+  int max_assoc;		/* highest associativity simulated */
+
+  /* derived data */
+  int blk_shift;		/* log2 of the block size */
+  int nlevels;			/* numbers of sets simulated */
+
+  /* per number of sets MIN_SETS << LEVEL, the LRU stack of each set,
+     MAX_ASSOC blocks deep, most recently used block first */
+  md_addr_t **stacks;
+
+  /* per number of sets, hits at each stack depth */
+  counter_t **hits;
+
+  /* stats */
+  counter_t refs;		/* total number of references */
+};
+
+/* create a sweep of caches of BSIZE byte blocks, MIN_SETS to MAX_SETS
+   sets, and 1 to MAX_ASSOC ways */
+struct stackdist_t *			/* pointer to sweep created */
+stackdist_create(char *name,		/* name of the sweep */
+		 int bsize,		/* block size of all caches */
+		 int min_sets,		/* fewest sets */
+		 int max_sets,		/* most sets */
+		 int max_assoc);	/* highest associativity */
+
+/* reference address ADDR in every cache of sweep SD */
+void
+stackdist_access(struct stackdist_t *sd,	/* sweep to access */
+		 md_addr_t addr);		/* address of access */
+
+/* flush every cache of sweep SD */
+void
+stackdist_flush(struct stackdist_t *sd);	/* sweep to flush */
+
+/* misses of the cache of NSETS sets and ASSOC ways in sweep SD */
+counter_t				/* total number of misses */
+stackdist_misses(struct stackdist_t *sd,	/* sweep instance */
+		 int nsets,			/* number of sets */
+		 int assoc);			/* associativity */
+
+/* register sweep stats */
+void
+stackdist_reg_stats(struct stackdist_t *sd,	/* sweep instance */
+		    struct stat_sdb_t *sdb);	/* stats database */
+
+/* print the miss rates of the sweep grid */
+void
+stackdist_print(struct stackdist_t *sd,		/* sweep instance */
+		FILE *stream);			/* output stream */
+
+#endif /* STACKDIST_H */